@@ -0,0 +1,555 @@
+/*
+	File: Benchmark.cpp - Benchmark suite for our Huffman engines
+
+	Times each of our code paths (counting symbols, building a tree, encoding,
+	decoding, and the tree file paths) on a set of corpora that are generated
+	the same way every run, so numbers from two builds can be compared directly.
+	Each measurement is repeated and we report the 10th, 50th, 90th and 99th
+	percentile times, the median throughput in MB/s and the compression ratio.
+
+	Usage: bench [-s sizes] [-c corpora] [-o operations] [-r runs] [-f file]... [-t tempdir] [-csv]
+	  sizes are a comma separated list like 1K,64K,1M,1G (default 1K,64K,1M,16M)
+	  corpora are any of text, exe, compressed, skewed, uniform, zeros, sensor (default all of them)
+	  operations are any of histogram, tree, encode, decode, file-encode, file-decode,
+	  tree-file, tree-encode, parallel-encode, parallel-decode, canonical-encode,
+	  canonical-decode, interleaved-encode, interleaved-decode, interleaved8-encode,
+	  interleaved8-decode, adaptive-encode, adaptive-decode, context-encode,
+	  context-decode, wide-encode, wide-decode, filter-encode, filter-decode,
+	  daemon-encode, daemon-decode (default all of them)
+	  -f adds a real file to the corpora, at its own size
+
+	Author: Quinn Kleinfelter
+	Class: EECS 2510-001 Non Linear Data Structures Spring 2020
+	Instructor: Dr. Thomas
+	Copyright: Copyright 2020 by Quinn Kleinfelter. All rights reserved.
+*/
+
+#include "../HUFF/Huffman.h"
+#include "../HUFF/Histogram.h"
+#include "../HUFF/Daemon.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+struct corpus // One set of input data we run every operation on
+{
+	string name; // The name we print for it
+	vector<unsigned char> data; // The data itself
+};
+
+struct operation // One code path we time
+{
+	string name; // The name we print for it
+	bool makesOutput; // Whether it encodes, so we can report a compression ratio
+};
+
+static const operation allOperations[] = {
+	{ "histogram", false }, // countSymbols on the whole buffer
+	{ "tree", false }, // BuildSharedTree, which counts, builds a canonical tree and its code and decode tables
+	{ "encode", true }, // EncodeBuffer, canonical codes into memory
+	{ "decode", false }, // DecodeBuffer of what encode wrote
+	{ "file-encode", true }, // EncodeFile (-e), the original format
+	{ "file-decode", false }, // DecodeFile (-d) of what file-encode wrote
+	{ "tree-file", false }, // MakeTreeBuilder (-t)
+	{ "tree-encode", true }, // EncodeFileWithTree (-et) using the tree tree-file wrote
+	{ "parallel-encode", true }, // EncodeFileParallel (-ep)
+	{ "parallel-decode", false }, // DecodeFile (-d) of what parallel-encode wrote
+	{ "canonical-encode", true }, // EncodeFileCanonical (-ec), a single stream to compare the interleaved ones against
+	{ "canonical-decode", false }, // DecodeFile (-d) of what canonical-encode wrote
+	{ "interleaved-encode", true }, // EncodeFileInterleaved (-ei) with 4 streams
+	{ "interleaved-decode", false }, // DecodeFile (-d) of what interleaved-encode wrote
+	{ "interleaved8-encode", true }, // EncodeFileInterleaved (-ei8) with 8 streams
+	{ "interleaved8-decode", false }, // DecodeFile (-d) of what interleaved8-encode wrote
+	{ "adaptive-encode", true }, // EncodeFileAdaptive (-eo), one pass with no tree, to compare against the two pass canonical-encode
+	{ "adaptive-decode", false }, // DecodeFile (-d) of what adaptive-encode wrote
+	{ "context-encode", true }, // EncodeFileContext (-e1), order 1 codes picked by the previous symbol, to compare against the order 0 canonical-encode
+	{ "context-decode", false }, // DecodeFile (-d) of what context-encode wrote
+	{ "wide-encode", true }, // EncodeFileWide (-e16), codes for 16 bit symbols, best compared against canonical-encode on the sensor corpus
+	{ "wide-decode", false }, // DecodeFile (-d) of what wide-encode wrote
+	{ "filter-encode", true }, // EncodeFileFiltered (-ef auto), canonical codes after whichever filter suits the corpus, to compare against canonical-encode
+	{ "filter-decode", false }, // DecodeFile (-d) of what filter-encode wrote
+	{ "daemon-encode", true }, // A -client -et request to a running server, from connecting to the answer, to compare against tree-encode
+	{ "daemon-decode", false }, // A -client -d request to a running server of what tree-encode wrote
+};
+
+static unsigned long long randomState = 0x9E3779B97F4A7C15ULL; // Our random number generator's state, always starting from the same seed
+
+static unsigned long long nextRandom()
+{
+	// Returns the next number from a simple xorshift generator. We don't use <random> so the
+	// corpora come out exactly the same on every compiler and standard library
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return randomState;
+}
+
+static size_t parseSize(string text)
+{
+	// Turns a size like 64K, 16M or 2G into a number of bytes
+	size_t multiplier = 1;
+	char suffix = text.empty() ? 0 : (char)toupper(text.back());
+	if (suffix == 'K') multiplier = (size_t)1 << 10;
+	if (suffix == 'M') multiplier = (size_t)1 << 20;
+	if (suffix == 'G') multiplier = (size_t)1 << 30;
+	if (multiplier != 1) text.pop_back();
+	return (size_t)stoull(text) * multiplier;
+}
+
+static string formatSize(size_t size)
+{
+	// Turns a number of bytes back into a short size like 64K for printing
+	const char* suffixes[] = { "", "K", "M", "G" };
+	int suffix = 0;
+	while (suffix < 3 && size >= 1024 && size % 1024 == 0)
+	{
+		size /= 1024;
+		suffix++;
+	}
+	return to_string(size) + suffixes[suffix];
+}
+
+static vector<string> splitList(const string& text)
+{
+	// Splits a comma separated list into its items
+	vector<string> items;
+	stringstream stream(text);
+	string item;
+	while (getline(stream, item, ','))
+		if (!item.empty()) items.push_back(item);
+	return items;
+}
+
+static void tile(vector<unsigned char>& data, size_t size)
+{
+	// Repeats the start of data over and over until it is exactly size bytes long
+	size_t patternLength = data.size();
+	data.resize(size);
+	for (size_t i = patternLength; i < size; i++)
+		data[i] = data[i - patternLength];
+}
+
+static vector<unsigned char> makeText(size_t size)
+{
+	// English-like text: words picked with a Zipf-like bias toward the common ones, with some punctuation and line breaks
+	static const char* words[] = { "the", "of", "and", "to", "a", "in", "is", "it", "that", "for", "was", "on", "are", "with",
+		"as", "be", "this", "have", "from", "or", "by", "tree", "node", "symbol", "frequency", "encoding", "decode", "bits",
+		"weight", "merge", "table", "file", "stream", "header", "block", "length", "Huffman", "Thomas", "structure", "data" };
+	const int wordCount = sizeof(words) / sizeof(words[0]);
+	vector<unsigned char> data;
+	data.reserve(size + 16);
+	int lineLength = 0;
+	while (data.size() < size)
+	{
+		int word = (int)(nextRandom() % wordCount);
+		word = (int)(nextRandom() % (word + 1)); // Picking below a random bound makes the early (common) words much more likely
+		for (const char* c = words[word]; *c; c++)
+			data.push_back((unsigned char)*c);
+		lineLength += (int)strlen(words[word]) + 1;
+		unsigned long long punctuation = nextRandom() % 20;
+		if (punctuation == 0) data.push_back('.');
+		else if (punctuation == 1) data.push_back(',');
+		if (lineLength > 72)
+		{
+			data.push_back('\n');
+			lineLength = 0;
+		}
+		else
+			data.push_back(' ');
+	}
+	data.resize(size);
+	return data;
+}
+
+static vector<unsigned char> makeExecutable(size_t size)
+{
+	// Something with the flavor of machine code, lots of zero padding, small numbers and common opcodes, repeated
+	// to fill out the size. We make it rather than reading a real executable (our own would change with every
+	// build), so use -f to time a real one
+	static const unsigned char opcodes[] = { 0x48, 0x89, 0x8B, 0xE8, 0xC3, 0x0F, 0x83, 0xFF, 0x74, 0x75, 0x31, 0xC0, 0x24, 0x41 };
+	vector<unsigned char> data;
+	while (data.size() < min(size, (size_t)1 << 20))
+	{
+		unsigned long long kind = nextRandom() % 10;
+		if (kind < 2)
+			data.insert(data.end(), (size_t)(nextRandom() % 64), 0); // Zero padding
+		else if (kind < 7)
+			data.push_back(opcodes[nextRandom() % sizeof(opcodes)]);
+		else
+			data.push_back((unsigned char)(nextRandom() % (kind == 9 ? 256 : 16))); // Small operands, now and then a random one
+	}
+	tile(data, size);
+	return data;
+}
+
+static vector<unsigned char> makeCompressed(size_t size)
+{
+	// Something like already compressed data: frames of random bytes, each after a small header of a magic number
+	// and a length, like a container of compressed blocks. We make it without our encoder, since a corpus that
+	// changed along with the code it is timing couldn't be compared between builds
+	vector<unsigned char> data;
+	data.reserve(min(size, (size_t)1 << 20) + 8);
+	while (data.size() < min(size, (size_t)1 << 20))
+	{
+		unsigned int frameLength = 256 + (unsigned int)(nextRandom() % 3840); // Frames of 256 bytes to 4K
+		unsigned char header[] = { 0x28, 0xB5, 0x2F, 0xFD, (unsigned char)frameLength, (unsigned char)(frameLength >> 8) };
+		data.insert(data.end(), header, header + sizeof(header));
+		for (unsigned int i = 0; i < frameLength; i += 8)
+		{
+			unsigned long long bits = nextRandom();
+			for (unsigned int j = i; j < min(frameLength, i + 8); j++, bits >>= 8)
+				data.push_back((unsigned char)bits);
+		}
+	}
+	data.resize(min(size, data.size()));
+	tile(data, size);
+	return data;
+}
+
+static vector<unsigned char> makeSkewed(size_t size)
+{
+	// A very skewed distribution: each symbol is half as likely as the one before it, so the codes get long
+	vector<unsigned char> data(size);
+	for (size_t i = 0; i < size; i++)
+	{
+		unsigned long long bits = nextRandom() | (1ULL << 63); // The number of 0 bits at the bottom picks the symbol
+		int symbol = 0;
+		while (!(bits & 1))
+		{
+			bits >>= 1;
+			symbol++;
+		}
+		data[i] = (unsigned char)(symbol * 7); // Spread them out so they aren't all next to each other
+	}
+	return data;
+}
+
+static vector<unsigned char> makeUniform(size_t size)
+{
+	// Every byte equally likely, which can't be compressed at all
+	vector<unsigned char> data(size);
+	for (size_t i = 0; i < size; i += 8)
+	{
+		unsigned long long bits = nextRandom();
+		for (size_t j = i; j < min(size, i + 8); j++, bits >>= 8)
+			data[j] = (unsigned char)bits;
+	}
+	return data;
+}
+
+static vector<unsigned char> makeSensor(size_t size)
+{
+	// 16 bit little-endian readings from a slowly drifting sensor: each reading is a small random step from the one
+	// before, so a few thousand values show up and neither of their bytes says much without the other
+	vector<unsigned char> data(size);
+	unsigned int reading = 0x8000; // Start in the middle so we don't wrap around
+	for (size_t i = 0; i + 1 < size; i += 2)
+	{
+		reading = (reading + (unsigned int)(nextRandom() % 41) - 20) & 0xFFFF; // A step of -20 to 20
+		data[i] = (unsigned char)reading;
+		data[i + 1] = (unsigned char)(reading >> 8);
+	}
+	return data;
+}
+
+static vector<unsigned char> makeCorpus(const string& name, size_t size)
+{
+	// Makes the corpus with the given name, returning an empty buffer if we don't know it
+	randomState = 0x9E3779B97F4A7C15ULL; // Every corpus starts from the same seed, so it doesn't matter which ones we pick
+	if (name == "text") return makeText(size);
+	if (name == "exe") return makeExecutable(size);
+	if (name == "compressed") return makeCompressed(size);
+	if (name == "skewed") return makeSkewed(size);
+	if (name == "uniform") return makeUniform(size);
+	if (name == "zeros") return vector<unsigned char>(size, 0);
+	if (name == "sensor") return makeSensor(size);
+	return vector<unsigned char>();
+}
+
+static bool writeFile(const string& fileName, const vector<unsigned char>& data)
+{
+	// Writes data out to fileName, for the operations that work on files
+	FILE* file = fopen(fileName.c_str(), "wb");
+	if (file == nullptr) return false;
+	bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+	return fclose(file) == 0 && ok;
+}
+
+static long long fileSize(const string& fileName)
+{
+	// Returns the size of fileName, or -1 if it isn't there
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (file == nullptr) return -1;
+	fseek(file, 0, SEEK_END);
+	long long size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+static double percentile(vector<double> times, double fraction)
+{
+	// Returns the given percentile of times, picking the nearest run
+	sort(times.begin(), times.end());
+	size_t index = (size_t)(fraction * (times.size() - 1) + 0.5);
+	return times[index];
+}
+
+int main(int argc, char* argv[])
+{
+	vector<size_t> sizes = { (size_t)1 << 10, (size_t)1 << 16, (size_t)1 << 20, (size_t)1 << 24 }; // The sizes of the synthetic corpora
+	vector<string> corpusNames = { "text", "exe", "compressed", "skewed", "uniform", "zeros", "sensor" }; // Which synthetic corpora to run
+	vector<string> operationNames; // Which operations to run, all of them if this stays empty
+	vector<string> realFiles; // Real files to run along with the synthetic corpora
+	int runs = 7; // How many times we repeat each measurement
+	string tempDirectory = "/tmp"; // Where the file based operations put their files
+	bool csv = false; // Whether to print comma separated values instead of a table
+	for (int i = 1; i < argc; i++)
+	{
+		// Read in our command line
+		string flag = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (flag == "-s" && hasValue)
+		{
+			sizes.clear();
+			for (string size : splitList(argv[++i]))
+				sizes.push_back(parseSize(size));
+		}
+		else if (flag == "-c" && hasValue) corpusNames = splitList(argv[++i]);
+		else if (flag == "-o" && hasValue) operationNames = splitList(argv[++i]);
+		else if (flag == "-r" && hasValue) runs = max(1, atoi(argv[++i]));
+		else if (flag == "-f" && hasValue) realFiles.push_back(argv[++i]);
+		else if (flag == "-t" && hasValue) tempDirectory = argv[++i];
+		else if (flag == "-csv") csv = true;
+		else
+		{
+			cout << "Usage: bench [-s sizes] [-c corpora] [-o operations] [-r runs] [-f file]... [-t tempdir] [-csv]" << endl;
+			return flag == "-h" ? 0 : 1;
+		}
+	}
+	vector<operation> operations; // The operations we are actually going to run
+	for (const operation& op : allOperations)
+	{
+		if (operationNames.empty() || find(operationNames.begin(), operationNames.end(), op.name) != operationNames.end())
+			operations.push_back(op);
+	}
+
+	string inputFile = tempDirectory + "/huff_bench_input"; // The files our file based operations use
+	string encodedFile = tempDirectory + "/huff_bench_encoded";
+	string parallelFile = tempDirectory + "/huff_bench_parallel";
+	string canonicalFile = tempDirectory + "/huff_bench_canonical";
+	string interleavedFile = tempDirectory + "/huff_bench_interleaved";
+	string adaptiveFile = tempDirectory + "/huff_bench_adaptive";
+	string contextFile = tempDirectory + "/huff_bench_context";
+	string wideFile = tempDirectory + "/huff_bench_wide";
+	string filterFile = tempDirectory + "/huff_bench_filter";
+	string treeFile = tempDirectory + "/huff_bench_tree";
+	string treeEncodedFile = tempDirectory + "/huff_bench_tree_encoded";
+	string decodedFile = tempDirectory + "/huff_bench_decoded";
+	string socketFile = tempDirectory + "/huff_bench.sock"; // Where our server listens, for the daemon operations
+	stringstream discard; // The file operations print a line about what they did, which we throw away
+	streambuf* realCout = cout.rdbuf();
+
+	Daemon daemon; // The server the daemon operations talk to, if we are running any
+	thread server;
+	DaemonClient client;
+	for (const operation& op : operations)
+	{
+		if (op.name.compare(0, 6, "daemon") != 0 || server.joinable()) continue;
+		cout.rdbuf(discard.rdbuf()); // The server announces itself, which we throw away
+		server = thread([&daemon, socketFile]() { daemon.Serve(socketFile); });
+		for (int attempt = 0; attempt < 1000 && !client.Connect(socketFile); attempt++)
+			this_thread::sleep_for(chrono::milliseconds(1)); // Wait until it is listening
+		client.Close();
+		cout.rdbuf(realCout);
+	}
+
+	if (csv)
+		cout << "corpus,size,operation,runs,p10_ms,p50_ms,p90_ms,p99_ms,mb_per_s,ratio" << endl;
+	else
+		cout << left << setw(12) << "corpus" << right << setw(7) << "size" << "  " << left << setw(20) << "operation" << right
+			<< setw(11) << "p10 ms" << setw(11) << "p50 ms" << setw(11) << "p90 ms" << setw(11) << "p99 ms" << setw(10) << "MB/s" << setw(8) << "ratio" << endl;
+
+	// Put together every corpus we are going to run, the real files first
+	vector<pair<string, size_t>> plan; // The name of each corpus and its size (0 for a real file)
+	for (const string& file : realFiles)
+		plan.push_back({ file, 0 });
+	for (const string& name : corpusNames)
+		for (size_t size : sizes)
+			plan.push_back({ name, size });
+
+	for (const auto& entry : plan)
+	{
+		corpus input;
+		input.name = entry.first;
+		if (entry.second == 0)
+		{
+			// A real file, read in whole
+			MappedFile file;
+			if (!file.Open(entry.first))
+			{
+				cerr << "Could not open " << entry.first << endl;
+				continue;
+			}
+			input.data.assign(file.Data(), file.Data() + file.Size());
+			size_t slash = input.name.find_last_of("/\\");
+			if (slash != string::npos) input.name = input.name.substr(slash + 1);
+		}
+		else
+		{
+			input.data = makeCorpus(entry.first, entry.second);
+			if (input.data.size() != entry.second)
+			{
+				cerr << "Unknown corpus " << entry.first << endl;
+				continue;
+			}
+		}
+		if (!writeFile(inputFile, input.data))
+		{
+			cerr << "Could not write to " << tempDirectory << endl;
+			return 1;
+		}
+
+		Huffman huffman; // One object for every operation on this corpus, which also checks that it can be reused
+		vector<unsigned char> encoded, decoded; // Buffers for the memory operations
+		MappedFile treeEncoded; // What tree-encode wrote, which daemon-decode sends to the server
+		for (const operation& op : operations)
+		{
+			// Set up anything this operation needs that we don't want to time
+			if (op.name == "decode")
+			{
+				encoded.clear();
+				huffman.EncodeBuffer(input.data.data(), input.data.size(), encoded);
+			}
+			cout.rdbuf(discard.rdbuf());
+			if (op.name == "file-decode") huffman.EncodeFile(inputFile, encodedFile);
+			if (op.name == "tree-encode" || op.name == "daemon-encode") huffman.MakeTreeBuilder(inputFile, treeFile);
+			if (op.name == "daemon-decode")
+			{
+				huffman.MakeTreeBuilder(inputFile, treeFile);
+				huffman.EncodeFileWithTree(inputFile, treeFile, treeEncodedFile);
+				treeEncoded.Open(treeEncodedFile);
+			}
+			if (op.name == "parallel-decode") huffman.EncodeFileParallel(inputFile, parallelFile);
+			if (op.name == "canonical-decode") huffman.EncodeFileCanonical(inputFile, canonicalFile);
+			if (op.name == "interleaved-decode") huffman.EncodeFileInterleaved(inputFile, interleavedFile, 4);
+			if (op.name == "interleaved8-decode") huffman.EncodeFileInterleaved(inputFile, interleavedFile, 8);
+			if (op.name == "adaptive-decode") huffman.EncodeFileAdaptive(inputFile, adaptiveFile);
+			if (op.name == "context-decode") huffman.EncodeFileContext(inputFile, contextFile);
+			if (op.name == "wide-decode") huffman.EncodeFileWide(inputFile, wideFile);
+			if (op.name == "filter-decode") huffman.EncodeFileFiltered(inputFile, filterFile, "auto");
+			cout.rdbuf(realCout);
+
+			vector<double> times; // How long each run took, in milliseconds
+			long long outputSize = -1; // How big the encoded output was, for the ratio
+			bool correct = true; // Whether decoding gave us back the input
+			string serverError; // Why the server didn't answer, if it didn't, in which case there is nothing to report
+			for (int run = 0; run < runs; run++)
+			{
+				unsigned long long counts[256] = { 0 };
+				encoded.reserve(Huffman::EncodedBufferBound(input.data.size())); // Keep allocation out of the timing
+				decoded.reserve(input.data.size());
+				if (op.name == "encode") encoded.clear();
+				decoded.clear();
+				cout.rdbuf(discard.rdbuf());
+				auto start = chrono::steady_clock::now();
+				if (op.name == "histogram") countSymbols(input.data.data(), input.data.size(), counts);
+				else if (op.name == "tree") huffman.BuildSharedTree(input.data.data(), input.data.size());
+				else if (op.name == "encode") huffman.EncodeBuffer(input.data.data(), input.data.size(), encoded);
+				else if (op.name == "decode") huffman.DecodeBuffer(encoded.data(), encoded.size(), decoded);
+				else if (op.name == "file-encode") huffman.EncodeFile(inputFile, encodedFile);
+				else if (op.name == "file-decode") huffman.DecodeFile(encodedFile, decodedFile);
+				else if (op.name == "tree-file") huffman.MakeTreeBuilder(inputFile, treeFile);
+				else if (op.name == "tree-encode") huffman.EncodeFileWithTree(inputFile, treeFile, treeEncodedFile);
+				else if (op.name == "parallel-encode") huffman.EncodeFileParallel(inputFile, parallelFile);
+				else if (op.name == "parallel-decode") huffman.DecodeFile(parallelFile, decodedFile);
+				else if (op.name == "canonical-encode") huffman.EncodeFileCanonical(inputFile, canonicalFile);
+				else if (op.name == "canonical-decode") huffman.DecodeFile(canonicalFile, decodedFile);
+				else if (op.name == "interleaved-encode") huffman.EncodeFileInterleaved(inputFile, interleavedFile, 4);
+				else if (op.name == "interleaved8-encode") huffman.EncodeFileInterleaved(inputFile, interleavedFile, 8);
+				else if (op.name == "interleaved-decode" || op.name == "interleaved8-decode") huffman.DecodeFile(interleavedFile, decodedFile);
+				else if (op.name == "adaptive-encode") huffman.EncodeFileAdaptive(inputFile, adaptiveFile);
+				else if (op.name == "adaptive-decode") huffman.DecodeFile(adaptiveFile, decodedFile);
+				else if (op.name == "context-encode") huffman.EncodeFileContext(inputFile, contextFile);
+				else if (op.name == "context-decode") huffman.DecodeFile(contextFile, decodedFile);
+				else if (op.name == "wide-encode") huffman.EncodeFileWide(inputFile, wideFile);
+				else if (op.name == "wide-decode") huffman.DecodeFile(wideFile, decodedFile);
+				else if (op.name == "filter-encode") huffman.EncodeFileFiltered(inputFile, filterFile, "auto");
+				else if (op.name == "filter-decode") huffman.DecodeFile(filterFile, decodedFile);
+				else if (op.name == "daemon-encode" || op.name == "daemon-decode")
+				{
+					bool answered = client.Connect(socketFile) && (op.name == "daemon-encode"
+						? client.Call(Daemon::opEncodeWithTree, treeFile, input.data.data(), input.data.size(), encoded)
+						: client.Call(Daemon::opDecode, "", treeEncoded.Data(), treeEncoded.Size(), decoded));
+					if (!answered) serverError = client.LastError();
+				}
+				client.Close();
+				auto end = chrono::steady_clock::now();
+				cout.rdbuf(realCout);
+				discard.str(""); // Throw away whatever the operation printed
+				times.push_back(chrono::duration<double, milli>(end - start).count());
+				if (op.name == "tree") huffman.ClearSharedTree(); // So the next operation builds its own trees again
+			}
+			if (!serverError.empty())
+			{
+				cerr << "Warning: " << op.name << " of " << input.name << " failed: " << serverError << endl;
+				continue; // We didn't time anything, so don't report a time
+			}
+			if (op.name == "encode") outputSize = (long long)encoded.size();
+			if (op.name == "file-encode") outputSize = fileSize(encodedFile);
+			if (op.name == "tree-encode") outputSize = fileSize(treeEncodedFile);
+			if (op.name == "parallel-encode") outputSize = fileSize(parallelFile);
+			if (op.name == "canonical-encode") outputSize = fileSize(canonicalFile);
+			if (op.name == "interleaved-encode" || op.name == "interleaved8-encode") outputSize = fileSize(interleavedFile);
+			if (op.name == "adaptive-encode") outputSize = fileSize(adaptiveFile);
+			if (op.name == "context-encode") outputSize = fileSize(contextFile);
+			if (op.name == "wide-encode") outputSize = fileSize(wideFile);
+			if (op.name == "filter-encode") outputSize = fileSize(filterFile);
+			if (op.name == "daemon-encode") outputSize = (long long)encoded.size();
+			if (op.name == "decode" || op.name == "daemon-decode") correct = decoded == input.data;
+			if (op.name == "file-decode" || op.name == "parallel-decode" || op.name == "canonical-decode" || op.name == "interleaved-decode" || op.name == "interleaved8-decode" || op.name == "adaptive-decode" || op.name == "context-decode" || op.name == "wide-decode" || op.name == "filter-decode")
+			{
+				MappedFile result;
+				correct = result.Open(decodedFile) && result.Size() == input.data.size() && equal(input.data.begin(), input.data.end(), result.Data());
+			}
+			if (!correct)
+				cerr << "Warning: " << op.name << " of " << input.name << " did not give back the original data" << endl;
+
+			double median = percentile(times, 0.5);
+			double megabytesPerSecond = median > 0 ? input.data.size() / (median / 1000) / 1e6 : 0; // Throughput in terms of the original data
+			double ratio = outputSize >= 0 && !input.data.empty() ? (double)outputSize / input.data.size() : 0;
+			string size = formatSize(input.data.size());
+			if (csv)
+			{
+				cout << input.name << "," << input.data.size() << "," << op.name << "," << runs << "," << fixed << setprecision(3)
+					<< percentile(times, 0.1) << "," << median << "," << percentile(times, 0.9) << "," << percentile(times, 0.99) << "," << setprecision(1) << megabytesPerSecond << ",";
+				if (op.makesOutput) cout << setprecision(4) << ratio;
+				cout << endl;
+			}
+			else
+			{
+				cout << left << setw(12) << input.name << right << setw(7) << size << "  " << left << setw(20) << op.name << right << fixed
+					<< setprecision(3) << setw(11) << percentile(times, 0.1) << setw(11) << median << setw(11) << percentile(times, 0.9) << setw(11) << percentile(times, 0.99)
+					<< setprecision(1) << setw(10) << megabytesPerSecond;
+				if (op.makesOutput) cout << setprecision(4) << setw(8) << ratio;
+				cout << endl;
+			}
+		}
+	}
+	for (const string& file : { inputFile, encodedFile, parallelFile, canonicalFile, interleavedFile, adaptiveFile, contextFile, wideFile, filterFile, treeFile, treeEncodedFile, decodedFile })
+		remove(file.c_str()); // Clean up after ourselves
+	if (server.joinable())
+	{
+		// Ask our server to stop, and wait for it to clean up its socket
+		vector<unsigned char> unused;
+		if (client.Connect(socketFile)) client.Call(Daemon::opStop, "", nullptr, 0, unused);
+		client.Close();
+		server.join();
+	}
+	return 0;
+}
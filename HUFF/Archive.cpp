@@ -0,0 +1,413 @@
+/*
+	File: Archive.cpp - Implementation of a multi-file archive
+	c.f.: Archive.h
+
+	Compressing thousands of small files one process at a time spends most of
+	its time starting up and writing out headers. An archive takes all of them
+	in one go: files are encoded a batch at a time, one per thread, each with
+	its own Huffman object, and written out back to back. Every entry is just
+	an EncodeBuffer result, so it carries a compact canonical tree instead of a
+	510 byte merge list. At the end we write a central index with the name,
+	position and sizes of every entry, followed by a small trailer pointing
+	at the index, so a reader can jump straight to any one entry.
+
+	Author: Quinn Kleinfelter
+	Class: EECS 2510-001 Non Linear Data Structures Spring 2020
+	Instructor: Dr. Thomas
+	Copyright: Copyright 2020 by Quinn Kleinfelter. All rights reserved.
+*/
+
+#include "Archive.h"
+#include "Huffman.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <atomic>
+#include <unordered_map>
+
+void Archive::Create(string archiveFile, const vector<string>& inputs)
+{
+	// This method packs every file named by inputs into archiveFile. Directories are walked
+	// recursively and an input starting with @ names a text file listing one path per line.
+	// This implements the -ea command line parameter
+	start = chrono::steady_clock::now(); // Start timing from now
+	bytesIn = bytesOut = 0;
+	vector<pair<string, string>> files; // Every file we are packing, as (path on disk, name in archive)
+	if (!CollectFiles(inputs, files)) return; // Find all of our files, CollectFiles already explained what went wrong
+	for (const auto& file : files)
+	{
+		error_code error;
+		if (filesystem::equivalent(file.first, archiveFile, error))
+		{
+			// We can't pack the archive into itself, so display an error and exit
+			cout << "Input File can not be equal to Output File" << endl;
+			return;
+		}
+	}
+	ofstream output(archiveFile, ios::out | ios::binary); // Open up our archive
+	if (output.fail())
+	{
+		// If we can't open our archive, let the user know and exit
+		cout << "Unable to open output file: " << archiveFile << endl;
+		return;
+	}
+	unsigned char header[archiveHeaderSize] = { 'H', 'F', archiveFormat };
+	output.write((char*)header, archiveHeaderSize); // Write out our magic bytes and format
+	unsigned long long position = archiveHeaderSize; // Where the next entry goes
+
+	// Encode a batch of files at a time, each with its own Huffman object, and write them out in order.
+	// Batches keep us from holding every encoded file in memory at once
+	ThreadPool pool; // Our pool of worker threads, one per core
+	size_t batchFiles = (size_t)pool.Size() * batchesPerThread; // The number of files we encode per batch
+	vector<Huffman> coders(batchFiles); // One Huffman object per file in the batch, reused between batches
+	vector<vector<unsigned char>> outputs(batchFiles); // The encoded file in each slot of the batch
+	vector<string> errors(batchFiles); // Anything that went wrong in each slot
+	entries.clear();
+	for (size_t firstFile = 0; firstFile < files.size(); firstFile += batchFiles)
+	{
+		size_t filesInBatch = min(batchFiles, files.size() - firstFile); // The number of files in this batch
+		pool.ParallelFor(filesInBatch, [&](size_t slot)
+		{
+			MappedFile input; // Map the file in on whichever thread is encoding it
+			outputs[slot].clear();
+			errors[slot].clear();
+			if (!input.Open(files[firstFile + slot].first))
+				errors[slot] = "Unable to open input file: " + files[firstFile + slot].first;
+			else if (!coders[slot].EncodeBuffer(input.Data(), input.Size(), outputs[slot]))
+				errors[slot] = "Unable to encode " + files[firstFile + slot].first + ": " + coders[slot].LastError();
+		});
+		for (size_t slot = 0; slot < filesInBatch; slot++)
+		{
+			if (!errors[slot].empty())
+			{
+				// If any file failed, let the user know and leave the archive unfinished, without an index it can't be read
+				cout << errors[slot] << endl;
+				return;
+			}
+			entry item; // Record where this file went
+			item.name = files[firstFile + slot].second;
+			item.offset = position;
+			item.encodedSize = outputs[slot].size();
+			item.originalSize = loadLittleEndian64(outputs[slot].data() + 3); // EncodeBuffer's header holds the original size right after the magic bytes
+			entries.push_back(item);
+			output.write((char*)outputs[slot].data(), outputs[slot].size()); // And write it out
+			position += item.encodedSize;
+			bytesIn += item.originalSize;
+		}
+	}
+
+	// Finally write out the index: for every entry its offset, encoded size, original size, and name,
+	// then the trailer holding where the index starts and how many entries it has
+	vector<unsigned char> index; // The index, built up in memory so we write it in one go
+	for (const entry& item : entries)
+	{
+		unsigned char fixed[entryFixedSize];
+		storeLittleEndian64(fixed, item.offset);
+		storeLittleEndian64(fixed + 8, item.encodedSize);
+		storeLittleEndian64(fixed + 16, item.originalSize);
+		fixed[24] = (unsigned char)item.name.size(); // Name length, lowest byte first
+		fixed[25] = (unsigned char)(item.name.size() >> 8);
+		index.insert(index.end(), fixed, fixed + entryFixedSize);
+		index.insert(index.end(), item.name.begin(), item.name.end());
+	}
+	unsigned char trailer[trailerSize];
+	storeLittleEndian64(trailer, position);
+	storeLittleEndian32(trailer + 8, (unsigned int)entries.size());
+	index.insert(index.end(), trailer, trailer + trailerSize);
+	output.write((char*)index.data(), index.size());
+	bytesOut = position + index.size(); // The whole archive
+	output.close();
+	if (output.fail())
+	{
+		cout << "Unable to write output file: " << archiveFile << endl;
+		return;
+	}
+	cout << "Entries: " << entries.size() << "   ";
+	printActionDetail(); // Print info about what we did
+}
+
+void Archive::ExtractAll(string archiveFile, string outputDirectory)
+{
+	// This method unpacks every entry of archiveFile under outputDirectory, recreating
+	// the directories they came from. Entries are spread across a pool of worker threads,
+	// each decoding straight out of the mapped archive with a Huffman object of its own.
+	// This implements the -da command line parameter
+	start = chrono::steady_clock::now(); // Start timing from now
+	bytesIn = bytesOut = 0;
+	if (!openArchive(archiveFile)) return; // Read in our index, openArchive already explained what went wrong
+	filesystem::path root = outputDirectory.empty() ? filesystem::path(".") : filesystem::path(outputDirectory);
+	for (const entry& item : entries)
+	{
+		// Make every directory up front, so threads never race to create the same one
+		error_code error;
+		filesystem::create_directories((root / item.name).parent_path(), error);
+	}
+
+	ThreadPool pool; // Our pool of worker threads, one per core
+	size_t batchFiles = (size_t)pool.Size() * batchesPerThread; // The number of entries we decode per batch
+	vector<Huffman> coders(batchFiles); // One Huffman object per entry in the batch, reused between batches
+	atomic<bool> failed{ false }; // Set if any entry couldn't be extracted
+	for (size_t firstEntry = 0; firstEntry < entries.size(); firstEntry += batchFiles)
+	{
+		size_t entriesInBatch = min(batchFiles, entries.size() - firstEntry); // The number of entries in this batch
+		pool.ParallelFor(entriesInBatch, [&](size_t slot)
+		{
+			const entry& item = entries[firstEntry + slot];
+			if (!extract(item, (root / item.name).string(), coders[slot]))
+				failed = true;
+		});
+	}
+	for (const entry& item : entries)
+	{
+		bytesIn += item.encodedSize; // Add up our totals for the report
+		bytesOut += item.originalSize;
+	}
+	archiveMap.Close(); // We are done with the archive
+	if (failed) return; // extract already explained what went wrong
+	cout << "Entries: " << entries.size() << "   ";
+	printActionDetail(); // Print info about what we did
+}
+
+void Archive::ExtractEntry(string archiveFile, string entryName, string outputFile)
+{
+	// This method unpacks a single entry. We find it in the index and decode only its bytes,
+	// so the rest of the archive is never read.
+	// This implements the -xa command line parameter
+	start = chrono::steady_clock::now(); // Start timing from now
+	bytesIn = bytesOut = 0;
+	if (!openArchive(archiveFile)) return; // Read in our index, openArchive already explained what went wrong
+	auto found = find_if(entries.begin(), entries.end(), [&](const entry& item) { return item.name == entryName; });
+	if (found == entries.end())
+	{
+		// If there is no such entry, let the user know and exit
+		cout << "No entry named " << entryName << " in " << archiveFile << endl;
+		archiveMap.Close();
+		return;
+	}
+	if (outputFile == "")
+	{
+		// If our output file is empty, use the entry's own file name in the current directory
+		outputFile = filesystem::path(entryName).filename().string();
+	}
+	Huffman huffman; // Our decoder
+	bool extracted = extract(*found, outputFile, huffman);
+	archiveMap.Close(); // We are done with the archive
+	if (!extracted) return; // extract already explained what went wrong
+	bytesIn = found->encodedSize;
+	bytesOut = found->originalSize;
+	printActionDetail(); // Print info about what we did
+}
+
+void Archive::List(string archiveFile)
+{
+	// This method prints out every entry in archiveFile with its original and encoded sizes.
+	// This implements the -la command line parameter
+	if (!openArchive(archiveFile)) return; // Read in our index, openArchive already explained what went wrong
+	for (const entry& item : entries)
+		cout << item.originalSize << "\t" << item.encodedSize << "\t" << item.name << endl;
+	archiveMap.Close();
+}
+
+bool Archive::CollectFiles(const vector<string>& inputs, vector<pair<string, string>>& files)
+{
+	// This method turns our inputs into the list of files to pack. A file is stored under
+	// the path it was given by, a directory contributes every regular file under it (named by its
+	// path including the directory), and @list reads more inputs from list, one per line
+	for (const string& input : inputs)
+	{
+		if (input.size() > 1 && input[0] == '@')
+		{
+			// Read more inputs out of a list file
+			ifstream list(input.substr(1));
+			if (list.fail())
+			{
+				cout << "Unable to open file list: " << input.substr(1) << endl;
+				return false;
+			}
+			vector<string> listed; // The paths in the list, skipping blank lines
+			string line;
+			while (getline(list, line))
+			{
+				if (!line.empty() && line.back() == '\r') line.pop_back(); // Lists written on Windows end their lines with \r\n
+				if (!line.empty()) listed.push_back(line);
+			}
+			if (!CollectFiles(listed, files)) return false;
+			continue;
+		}
+		error_code error;
+		if (filesystem::is_directory(input, error))
+		{
+			// Walk the whole directory, sorting what we find so the archive comes out the same every time
+			vector<string> found;
+			for (filesystem::recursive_directory_iterator walk(input, error), end; !error && walk != end; walk.increment(error))
+			{
+				if (walk->is_regular_file(error))
+					found.push_back(walk->path().string());
+			}
+			if (error)
+			{
+				cout << "Unable to read directory: " << input << endl;
+				return false;
+			}
+			sort(found.begin(), found.end());
+			for (const string& path : found)
+			{
+				if (!addFile(path, path, files)) return false;
+			}
+		}
+		else if (!addFile(input, input, files))
+			return false;
+	}
+	if (files.empty())
+	{
+		cout << "No input files found" << endl;
+		return false;
+	}
+	// The same file can come in more than once (a directory and a file inside of it, say), and storing it twice
+	// would have extracting write the same path from two threads at once. Keep the first of each, and refuse
+	// two different files that would be stored under the same name
+	unordered_map<string, size_t> seen; // Where each name we have kept is in files
+	size_t kept = 0; // How many files we have kept so far
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		auto found = seen.find(files[i].second);
+		if (found == seen.end())
+		{
+			seen[files[i].second] = kept;
+			files[kept++] = files[i];
+			continue;
+		}
+		error_code error;
+		if (!filesystem::equivalent(files[found->second].first, files[i].first, error))
+		{
+			cout << "Can not store both " << files[found->second].first << " and " << files[i].first << " in an archive as " << files[i].second << endl;
+			return false;
+		}
+	}
+	files.resize(kept);
+	return true;
+}
+
+bool Archive::addFile(string path, string name, vector<pair<string, string>>& files)
+{
+	// Helper method that adds path to our list of files, stored under name. Names are kept relative
+	// with / between directories, so an archive made on one system extracts the same way on another
+	filesystem::path stored = filesystem::path(name).lexically_normal().relative_path(); // Drop any leading / or drive
+	string storedName = stored.generic_string();
+	if (!isSafeName(storedName) || storedName.size() > 0xFFFF)
+	{
+		cout << "Can not store " << path << " in an archive, its name must be a relative path without .." << endl;
+		return false;
+	}
+	files.push_back({ path, storedName });
+	return true;
+}
+
+bool Archive::openArchive(string archiveFile)
+{
+	// Helper method that maps archiveFile and reads its index into entries, checking that
+	// every entry lies inside the archive and has a name that is safe to extract
+	entries.clear();
+	if (!archiveMap.Open(archiveFile))
+	{
+		cout << "Unable to open input file: " << archiveFile << endl;
+		return false;
+	}
+	const unsigned char* data = archiveMap.Data();
+	size_t size = archiveMap.Size();
+	bool valid = size >= (size_t)(archiveHeaderSize + trailerSize) && data[0] == 'H' && data[1] == 'F' && data[2] == archiveFormat;
+	unsigned long long indexStart = valid ? loadLittleEndian64(data + size - trailerSize) : 0; // Where the index starts
+	unsigned int entryCount = valid ? loadLittleEndian32(data + size - trailerSize + 8) : 0; // And how many entries it has
+	size_t indexEnd = size - trailerSize; // The index runs right up to the trailer
+	valid = valid && indexStart >= (unsigned long long)archiveHeaderSize && indexStart <= indexEnd;
+	size_t position = (size_t)indexStart;
+	for (unsigned int i = 0; valid && i < entryCount; i++)
+	{
+		if (indexEnd - position < (size_t)entryFixedSize)
+		{
+			valid = false;
+			break;
+		}
+		entry item;
+		item.offset = loadLittleEndian64(data + position);
+		item.encodedSize = loadLittleEndian64(data + position + 8);
+		item.originalSize = loadLittleEndian64(data + position + 16);
+		size_t nameLength = data[position + 24] | (data[position + 25] << 8);
+		position += entryFixedSize;
+		if (indexEnd - position < nameLength)
+		{
+			valid = false;
+			break;
+		}
+		item.name.assign((const char*)data + position, nameLength);
+		position += nameLength;
+		valid = item.offset >= (unsigned long long)archiveHeaderSize && item.offset <= indexStart && item.encodedSize <= indexStart - item.offset && isSafeName(item.name);
+		entries.push_back(item);
+	}
+	if (!valid || position != indexEnd)
+	{
+		cout << "Input file is not a valid archive" << endl;
+		archiveMap.Close();
+		entries.clear();
+		return false;
+	}
+	return true;
+}
+
+bool Archive::extract(const entry& item, string outputFile, Huffman& huffman)
+{
+	// Helper method that decodes one entry, straight out of the mapped archive, into outputFile.
+	// Errors are collected into one message so threads extracting at the same time don't interleave them
+	vector<unsigned char> decoded; // The decoded entry
+	string problem; // What went wrong, if anything
+	if (item.originalSize / 8 + (item.originalSize % 8 != 0) > item.encodedSize)
+	{
+		// Every symbol takes at least a bit, so the index can't be right, and we don't go making room for it
+		problem = "Entry " + item.name + " is corrupt: its size does not match the index";
+	}
+	else
+	{
+		decoded.reserve((size_t)item.originalSize);
+		if (!huffman.DecodeBuffer(archiveMap.Data() + item.offset, (size_t)item.encodedSize, decoded))
+			problem = "Entry " + item.name + " is corrupt: " + huffman.LastError();
+		else if (decoded.size() != item.originalSize)
+			problem = "Entry " + item.name + " is corrupt: its size does not match the index";
+		else
+		{
+			ofstream output(outputFile, ios::out | ios::binary);
+			output.write((char*)decoded.data(), decoded.size());
+			output.close();
+			if (output.fail())
+				problem = "Unable to write output file: " + outputFile;
+		}
+	}
+	if (!problem.empty())
+	{
+		cout << problem + "\n" << flush; // One write, so it comes out in one piece
+		return false;
+	}
+	return true;
+}
+
+bool Archive::isSafeName(const string& name)
+{
+	// Helper method that checks name is a relative path with no .. in it, so extracting it
+	// can never write anywhere outside of the directory we are extracting into
+	filesystem::path path(name);
+	if (name.empty() || path.has_root_name() || path.has_root_directory()) return false;
+	for (const auto& part : path)
+	{
+		if (part == "..") return false;
+	}
+	return true;
+}
+
+void Archive::printActionDetail()
+{
+	// Helper method to print out information for what work we did, in the same form Huffman does
+	double secondsElapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count(); // Determine the wall time elapsed since we started
+	cout << "Time: " << secondsElapsed << " seconds.   ";
+	cout << "Bytes in / Bytes Out: " << bytesIn << " / " << bytesOut << endl;
+}
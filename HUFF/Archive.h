@@ -0,0 +1,58 @@
+/*
+	Quinn Kleinfelter
+	EECS 2520-001 Non Linear Data Structures Spring 2020
+	Dr. Thomas
+
+	Header file to contain the class definition for an archive,
+	which packs many files into one container. Each file is encoded
+	on its own with canonical codes, spread across a pool of worker
+	threads, and a central index at the end of the archive records
+	where every entry lives so any one of them can be pulled back out
+	without reading the others.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+#include "MappedFile.h"
+using namespace std;
+
+class Huffman;
+
+class Archive
+{
+public:
+	void Create(string archiveFile, const vector<string>& inputs); // Packs every file in inputs (files, directories, or @lists of paths) into archiveFile
+	void ExtractAll(string archiveFile, string outputDirectory); // Unpacks every entry of archiveFile into outputDirectory, in parallel
+	void ExtractEntry(string archiveFile, string entryName, string outputFile); // Unpacks just entryName from archiveFile into outputFile, or into its own file name if outputFile is empty
+	void List(string archiveFile); // Prints out the name and sizes of every entry in archiveFile
+	static bool CollectFiles(const vector<string>& inputs, vector<pair<string, string>>& files); // Expands inputs (files, directories, or @lists of paths) into (path on disk, name in archive) pairs, printing why if it can't
+
+private:
+	struct entry // Where one file lives in an archive
+	{
+		string name; // The name of the file, a relative path using / between directories
+		unsigned long long offset = 0; // Where the encoded file starts in the archive
+		unsigned long long encodedSize = 0; // The size of the encoded file
+		unsigned long long originalSize = 0; // The size of the file before encoding
+	};
+
+	const static int archiveFormat = 'A'; // Format byte for an archive, after the 'H' 'F' magic bytes
+	const static int archiveHeaderSize = 3; // Size of an archive's header: just the magic bytes and format
+	const static int trailerSize = 12; // Size of the trailer at the very end of an archive: where the index starts and how many entries it has
+	const static int entryFixedSize = 26; // Size of an index entry without its name: offset, encoded size, original size and name length
+	const static int batchesPerThread = 4; // How many files each thread gets per batch, so our memory use doesn't depend on how many files there are
+
+	vector<entry> entries; // The entries of the archive we are working with
+	MappedFile archiveMap; // The archive we are extracting from, mapped into memory
+	chrono::steady_clock::time_point start; // When we started the current operation
+	unsigned long long bytesIn = 0; // How many bytes we read in, for our report
+	unsigned long long bytesOut = 0; // How many bytes we wrote out, for our report
+
+	static bool addFile(string path, string name, vector<pair<string, string>>& files); // Helper method that adds one file to files, making sure its name is safe to store
+	bool openArchive(string archiveFile); // Helper method that maps archiveFile and reads in its index
+	bool extract(const entry& item, string outputFile, Huffman& huffman); // Helper method that decodes one entry into outputFile with huffman
+	static bool isSafeName(const string& name); // Helper method that checks a name is a relative path that stays inside the directory we extract into
+	void printActionDetail(); // Helper method to print out how long we took and how many bytes we read and wrote
+};
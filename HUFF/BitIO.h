@@ -0,0 +1,102 @@
+/*
+	Quinn Kleinfelter
+	EECS 2520-001 Non Linear Data Structures Spring 2020
+	Dr. Thomas
+
+	Header file containing small inline helpers for reading bits
+	out of, and writing bits into, a byte buffer. Our files store codes
+	with the first bit of each code in the highest bit of a byte, so
+	everything in here works most significant bit first. It also has the
+	helpers we use to store the numbers in our file headers.
+*/
+
+#pragma once
+
+inline unsigned long long loadBigEndian64(const unsigned char* bytes)
+{
+	// Loads 8 bytes starting at bytes into one 64 bit number, with the first byte
+	// in the highest position. Written out byte by byte so it doesn't care about
+	// alignment or the endianness of the machine, compilers turn this into a single
+	// load + byte swap
+	return ((unsigned long long)bytes[0] << 56) | ((unsigned long long)bytes[1] << 48) |
+		((unsigned long long)bytes[2] << 40) | ((unsigned long long)bytes[3] << 32) |
+		((unsigned long long)bytes[4] << 24) | ((unsigned long long)bytes[5] << 16) |
+		((unsigned long long)bytes[6] << 8) | (unsigned long long)bytes[7];
+}
+
+inline unsigned int peekBits(const unsigned char* data, unsigned long long bitPosition, int count)
+{
+	// Returns the next count bits (count <= 32) starting at bitPosition without consuming them.
+	// The caller must make sure at least 8 bytes are readable starting at the byte bitPosition is in
+	unsigned long long window = loadBigEndian64(data + (bitPosition >> 3)); // Grab the 8 bytes around our position
+	window <<= (bitPosition & 7); // Shift off the bits of the first byte we already used, leaving at least 57 good bits
+	return (unsigned int)(window >> (64 - count)); // And hand back just the top count bits
+}
+
+struct BitWriter // Packs codes into bytes, collecting them in a 64 bit register and writing them out 32 bits at a time
+{
+	unsigned long long bitBuffer = 0; // The bits we haven't written out yet, in the lowest bitCount bits
+	int bitCount = 0; // How many bits are waiting in bitBuffer, always less than 32 between calls
+	unsigned char* position = nullptr; // Where the next byte we write out goes, the caller makes sure there is room
+
+	inline void putBits(unsigned int bits, int count)
+	{
+		// Adds the lowest count bits (count <= 32) of bits onto the end of our output
+		bitBuffer = (bitBuffer << count) | bits; // Shift the new bits in at the bottom of the register
+		bitCount += count; // Keep track of how many we have waiting
+		if (bitCount >= 32)
+		{
+			// Once we have a whole word waiting, write it out in one go
+			bitCount -= 32; // The word is the 32 bits above the ones we are keeping
+			unsigned int word = (unsigned int)(bitBuffer >> bitCount); // Grab those 32 bits
+			position[0] = (unsigned char)(word >> 24); // And write them out, highest byte first
+			position[1] = (unsigned char)(word >> 16);
+			position[2] = (unsigned char)(word >> 8);
+			position[3] = (unsigned char)word;
+			position += 4; // Move past the bytes we just wrote
+		}
+	}
+
+	inline void flushBytes()
+	{
+		// Writes out every complete byte we have waiting, leaving at most 7 bits behind
+		while (bitCount >= 8)
+		{
+			bitCount -= 8;
+			*position++ = (unsigned char)(bitBuffer >> bitCount);
+		}
+	}
+};
+
+inline void storeLittleEndian32(unsigned char* bytes, unsigned int value)
+{
+	// Stores a 32 bit number into 4 bytes, lowest byte first. Unlike our bitstreams,
+	// all of the numbers in our file headers are stored this way
+	for (int i = 0; i < 4; i++)
+		bytes[i] = (unsigned char)(value >> (8 * i));
+}
+
+inline void storeLittleEndian64(unsigned char* bytes, unsigned long long value)
+{
+	// Stores a 64 bit number into 8 bytes, lowest byte first
+	for (int i = 0; i < 8; i++)
+		bytes[i] = (unsigned char)(value >> (8 * i));
+}
+
+inline unsigned int loadLittleEndian32(const unsigned char* bytes)
+{
+	// Loads a 32 bit number stored lowest byte first
+	unsigned int value = 0;
+	for (int i = 3; i >= 0; i--)
+		value = (value << 8) | bytes[i];
+	return value;
+}
+
+inline unsigned long long loadLittleEndian64(const unsigned char* bytes)
+{
+	// Loads a 64 bit number stored lowest byte first
+	unsigned long long value = 0;
+	for (int i = 7; i >= 0; i--)
+		value = (value << 8) | bytes[i];
+	return value;
+}
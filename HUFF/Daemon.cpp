@@ -0,0 +1,496 @@
+/*
+	File: Daemon.cpp - Implementation of the compression server and its client
+	c.f.: Daemon.h
+
+	Running HUFF once per small file spends most of its time starting the
+	process and rebuilding the same tree and tables over and over. The server
+	starts once and answers requests sent over a Unix domain socket, one
+	connection per worker thread. Every request is handed to a Huffman object
+	that has already built the tree the request uses, when we have one: for
+	-et that is the tree file, and for decoding it is the tree stored at the
+	front of the encoded data, both of which Huffman skips rebuilding when it
+	sees the same tree again. We keep objects for the most recently used trees
+	and throw away the least recently used ones once there are too many.
+
+	A request is the 'H' 'D' magic bytes, an operation byte, the length and
+	text of a tree file path (empty unless the operation needs one), then
+	the 8 byte length of the payload and the payload itself. A response is a
+	status byte and the 8 byte length of what follows, which is the output
+	or an error message. Lengths are little-endian, like our file headers,
+	and a client can send as many requests as it likes on one connection.
+
+	Author: Quinn Kleinfelter
+	Class: EECS 2510-001 Non Linear Data Structures Spring 2020
+	Instructor: Dr. Thomas
+	Copyright: Copyright 2020 by Quinn Kleinfelter. All rights reserved.
+*/
+
+#include "Daemon.h"
+#include "Huffman.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <new>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+Daemon::Daemon(size_t cacheSize)
+{
+	this->cacheSize = cacheSize > 0 ? cacheSize : 1; // We always keep at least the tree we just used
+}
+
+void Daemon::SetTreeStore(string directory)
+{
+	// This method sets the directory every one of our objects loads trained trees from
+	treeStore = directory;
+}
+
+bool Daemon::handleRequest(int op, const string& treePath, const vector<unsigned char>& payload, vector<unsigned char>& output, string& error)
+{
+	// Helper method that runs one request on an object from our cache, setting output to what the
+	// equivalent command line would have written, or error to why it couldn't be done
+	treeFile tree; // The tree file, for an encode with a tree
+	bool cached = false; // Whether we already had the tree file, so there is nothing to remember
+	string& treeData = tree.contents;
+	string key; // The tree this request uses, which picks out the object to run it on
+	if (op == opEncodeWithTree)
+	{
+		if (!readTreeFile(treePath, tree, cached, error)) return false;
+		// A canonical tree file holds the same compact tree a canonical file starts with, and an original tree
+		// file holds the same tree builder information an original file starts with, so both key the same
+		// object as decoding files encoded with that tree
+		bool canonical = treeData.size() >= 3 && treeData[0] == 'H' && treeData[1] == 'F' && treeData[2] == 'T'; // 'T' is the format byte of a -tc tree file
+		key = canonical ? treeData.substr(3) : treeData;
+	}
+	else if (op == opDecode)
+		key = Huffman::TreeKey(payload.data(), payload.size());
+	else if (op != opEncodeCanonical)
+	{
+		error = "Unknown request";
+		return false;
+	}
+	unique_ptr<Huffman> huffman = acquire(key);
+	bool succeeded;
+	output.clear();
+	if (op == opEncodeWithTree)
+		succeeded = huffman->EncodeBufferWithTree(payload.data(), payload.size(), (const unsigned char*)treeData.data(), treeData.size(), output);
+	else if (op == opDecode)
+		succeeded = huffman->DecodeBuffer(payload.data(), payload.size(), output);
+	else
+		succeeded = huffman->EncodeBuffer(payload.data(), payload.size(), output);
+	if (!succeeded)
+		error = huffman->LastError().empty() ? "Input is corrupt" : huffman->LastError();
+	else if (op == opEncodeWithTree && !cached)
+		rememberTreeFile(treePath, tree); // Only a file that held a tree is worth keeping
+	release(key, move(huffman)); // Whatever happened, the object can take the next request
+	return succeeded;
+}
+
+bool Daemon::readTreeFile(const string& path, treeFile& file, bool& cached, string& error)
+{
+	// Helper method that reads in the tree file at path, setting cached if it is our copy from an earlier request.
+	// We only read a file again if its size or modification time has changed, so a busy tree costs one stat per
+	// request. Clients pick the path, so we never read in anything bigger than a tree file can be
+	error_code statError;
+	unsigned long long size = filesystem::file_size(path, statError);
+	long long modified = statError ? 0 : (long long)filesystem::last_write_time(path, statError).time_since_epoch().count();
+	if (statError)
+	{
+		error = "Unable to open tree file: " + path;
+		return false;
+	}
+	if (size > Huffman::maxTreeFileSize)
+	{
+		error = "Tree file does not contain a tree: " + path;
+		return false;
+	}
+	{
+		lock_guard<mutex> lock(cacheMutex);
+		auto found = treeFiles.find(path);
+		if (found != treeFiles.end() && found->second.size == size && found->second.modified == modified)
+		{
+			file = found->second; // We have read this one before and it hasn't changed
+			cached = true;
+			return true;
+		}
+	}
+	ifstream input(path, ios::binary); // Otherwise read the whole thing in
+	file.contents.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+	if (input.bad() || file.contents.size() != size)
+	{
+		error = "Unable to read tree file: " + path;
+		return false;
+	}
+	file.modified = modified;
+	file.size = size;
+	cached = false;
+	return true;
+}
+
+void Daemon::rememberTreeFile(const string& path, const treeFile& file)
+{
+	// Helper method that keeps the tree file at path, which EncodeBufferWithTree has accepted, for the next request that uses it
+	lock_guard<mutex> lock(cacheMutex);
+	if (treeFiles.size() >= cacheSize && treeFiles.find(path) == treeFiles.end())
+		treeFiles.clear(); // Tree files are small, so rather than track which is oldest we start over once there are too many
+	treeFiles[path] = file;
+}
+
+unique_ptr<Huffman> Daemon::acquire(const string& key)
+{
+	// Helper method that hands out an object to run a request on. When we have an idle object that
+	// already built tree key we use it, otherwise we make a new one, which builds the tree as it goes
+	{
+		lock_guard<mutex> lock(cacheMutex);
+		vector<unique_ptr<Huffman>>* idle = &generalObjects; // Requests without a tree we can reuse share any object
+		if (!key.empty())
+		{
+			auto found = cache.find(key);
+			idle = found != cache.end() ? &found->second.idle : nullptr;
+			if (idle != nullptr)
+				recentTrees.splice(recentTrees.begin(), recentTrees, found->second.recent); // This tree is now the most recently used
+		}
+		if (idle != nullptr && !idle->empty())
+		{
+			unique_ptr<Huffman> huffman = move(idle->back());
+			idle->pop_back();
+			return huffman;
+		}
+	}
+	unique_ptr<Huffman> huffman(new Huffman());
+	huffman->SetOutputLimit(maxOutput); // A request fails rather than growing its response without end
+	if (!treeStore.empty())
+		huffman->SetTreeStore(treeStore);
+	return huffman;
+}
+
+void Daemon::release(const string& key, unique_ptr<Huffman> huffman)
+{
+	// Helper method that puts an object back once its request has finished, under the tree it now has built.
+	// We never keep more idle objects for one tree than we have workers, since no more can be busy at once
+	lock_guard<mutex> lock(cacheMutex);
+	if (key.empty())
+	{
+		if (generalObjects.size() < workers)
+			generalObjects.push_back(move(huffman));
+		return;
+	}
+	auto found = cache.find(key);
+	if (found == cache.end())
+	{
+		// A tree we don't have any objects for yet, so it goes in as the most recently used
+		recentTrees.push_front(key);
+		found = cache.emplace(key, cacheEntry()).first;
+		found->second.recent = recentTrees.begin();
+	}
+	if (found->second.idle.size() < workers)
+		found->second.idle.push_back(move(huffman));
+	while (cache.size() > cacheSize)
+	{
+		// Forget the least recently used trees until we are back under our limit
+		cache.erase(recentTrees.back());
+		recentTrees.pop_back();
+	}
+}
+
+string DaemonClient::LastError()
+{
+	// This method returns why the last Connect or Call failed
+	return lastError;
+}
+
+#ifdef _WIN32
+
+bool Daemon::Serve(string socketPath, unsigned int workerCount)
+{
+	// Unix domain sockets are all we listen on, so there is no server on Windows
+	cout << "The compression server is not supported on Windows" << endl;
+	return false;
+}
+
+void Daemon::serveConnection(int connection)
+{
+}
+
+DaemonClient::~DaemonClient()
+{
+}
+
+bool DaemonClient::Connect(string socketPath)
+{
+	lastError = "The compression server is not supported on Windows";
+	return false;
+}
+
+bool DaemonClient::Call(int op, string treePath, const unsigned char* data, size_t length, vector<unsigned char>& output)
+{
+	lastError = "Not connected";
+	return false;
+}
+
+void DaemonClient::Close()
+{
+}
+
+#else
+
+static bool sendAll(int socketHandle, const unsigned char* data, size_t length)
+{
+	// Helper function that sends all of data, returning false if the other end went away. We ask for no
+	// SIGPIPE so a client hanging up in the middle of a response doesn't take the whole server down
+	while (length > 0)
+	{
+		ssize_t sent = send(socketHandle, data, length, MSG_NOSIGNAL);
+		if (sent <= 0) return false;
+		data += sent;
+		length -= sent;
+	}
+	return true;
+}
+
+static bool receiveAll(int socketHandle, unsigned char* data, size_t length)
+{
+	// Helper function that receives exactly length bytes, returning false if the other end went away or took too long
+	while (length > 0)
+	{
+		ssize_t received = recv(socketHandle, data, length, 0);
+		if (received <= 0) return false;
+		data += received;
+		length -= received;
+	}
+	return true;
+}
+
+static void putLength(unsigned char* bytes, unsigned long long value, int size)
+{
+	// Helper function that writes value into size bytes, least significant byte first
+	for (int i = 0; i < size; i++)
+		bytes[i] = (unsigned char)(value >> (8 * i));
+}
+
+static unsigned long long getLength(const unsigned char* bytes, int size)
+{
+	// Helper function that reads a value of size bytes, least significant byte first
+	unsigned long long value = 0;
+	for (int i = 0; i < size; i++)
+		value |= (unsigned long long)bytes[i] << (8 * i);
+	return value;
+}
+
+static bool sendResponse(int socketHandle, int status, const unsigned char* data, size_t length)
+{
+	// Helper function that sends a response: its status, its length, then its data
+	unsigned char header[Daemon::responseHeaderSize];
+	header[0] = (unsigned char)status;
+	putLength(&header[1], length, 8);
+	return sendAll(socketHandle, header, Daemon::responseHeaderSize) && sendAll(socketHandle, data, length);
+}
+
+bool Daemon::Serve(string socketPath, unsigned int workerCount)
+{
+	// This method listens on socketPath and answers requests until a client asks us to stop. Each
+	// connection is handed to a worker thread, so up to workerCount clients are served at once and
+	// the rest wait their turn. This implements the -serve command line parameter
+	sockaddr_un address = {};
+	if (socketPath.size() >= sizeof(address.sun_path))
+	{
+		cout << "Socket path is too long: " << socketPath << endl;
+		return false;
+	}
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socketPath.c_str());
+	listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(socketPath.c_str()); // Clear out the socket a previous server left behind, if there is one
+	if (listenSocket < 0 || ::bind(listenSocket, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenSocket, SOMAXCONN) != 0)
+	{
+		// If we can't listen on our socket, let the user know and exit
+		cout << "Unable to listen on socket: " << socketPath << endl;
+		if (listenSocket >= 0) close(listenSocket);
+		listenSocket = -1;
+		return false;
+	}
+	workers = workerCount > 0 ? workerCount : max(1u, thread::hardware_concurrency());
+	stopping = false;
+	cout << "Listening on " << socketPath << " with " << workers << " workers" << endl;
+	{
+		ThreadPool pool(workers + 1); // The pool counts the calling thread, which is busy accepting connections
+		while (!stopping)
+		{
+			int connection = accept(listenSocket, nullptr, nullptr);
+			if (connection < 0)
+			{
+				if (errno == EINTR || errno == ECONNABORTED) continue; // Nothing wrong with us, just try again
+				break; // Our socket was shut down to stop us, or something went badly wrong
+			}
+			pool.Submit([this, connection]() { serveConnection(connection); });
+		}
+	} // The pool finishes the connections it has before it goes away
+	close(listenSocket);
+	listenSocket = -1;
+	unlink(socketPath.c_str());
+	return true;
+}
+
+void Daemon::serveConnection(int connection)
+{
+	// Helper method that answers one request after another on connection until the client hangs up,
+	// goes quiet for too long, or sends us something we don't understand
+	timeval timeout = { idleSeconds, 0 };
+	setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)); // Don't let an idle client tie up a worker forever
+	vector<unsigned char> payload; // The payload of the request we are working on
+	vector<unsigned char> output; // What we send back for it
+	while (!stopping)
+	{
+		try
+		{
+			unsigned char header[requestHeaderSize];
+			if (!receiveAll(connection, header, requestHeaderSize)) break; // The client is done with us
+			unsigned int pathLength = (unsigned int)getLength(&header[3], 4);
+			if (header[0] != 'H' || header[1] != 'D' || pathLength > maxPathLength)
+			{
+				string error = "Not a valid request";
+				sendResponse(connection, statusError, (const unsigned char*)error.data(), error.size());
+				break; // We can't tell where the next request would start, so hang up
+			}
+			int op = header[2];
+			string treePath(pathLength, '\0');
+			unsigned char lengthBytes[8];
+			if (!receiveAll(connection, (unsigned char*)&treePath[0], pathLength) || !receiveAll(connection, lengthBytes, 8)) break;
+			unsigned long long payloadLength = getLength(lengthBytes, 8);
+			if (payloadLength > maxPayload)
+			{
+				string error = "Request is too large";
+				sendResponse(connection, statusError, (const unsigned char*)error.data(), error.size());
+				break;
+			}
+			payload.resize(payloadLength);
+			if (!receiveAll(connection, payload.data(), payloadLength)) break;
+			if (op == opStop)
+			{
+				// A client wants us to stop, so stop taking connections. Shutting down our socket wakes up accept
+				stopping = true;
+				shutdown(listenSocket, SHUT_RDWR);
+				sendResponse(connection, statusOK, nullptr, 0);
+				break;
+			}
+			string error;
+			bool succeeded = false;
+			try
+			{
+				succeeded = handleRequest(op, treePath, payload, output, error);
+			}
+			catch (const bad_alloc&)
+			{
+				error = "Not enough memory to answer this request"; // The object that ran out is dropped rather than kept for the next request
+			}
+			catch (const exception& problem)
+			{
+				error = string("Unable to answer this request: ") + problem.what();
+			}
+			if (!succeeded)
+				output = vector<unsigned char>(); // Give back whatever a failed request built up
+			bool sent = succeeded
+				? sendResponse(connection, statusOK, output.data(), output.size())
+				: sendResponse(connection, statusError, (const unsigned char*)error.data(), error.size());
+			if (!sent) break;
+		}
+		catch (const exception&)
+		{
+			// Something outside of running the request failed, like making room for its payload. We may be in the
+			// middle of reading it, so let the client know and hang up rather than taking down the whole server
+			string error = "Unable to answer this request";
+			sendResponse(connection, statusError, (const unsigned char*)error.data(), error.size());
+			break;
+		}
+	}
+	close(connection);
+}
+
+DaemonClient::~DaemonClient()
+{
+	Close();
+}
+
+bool DaemonClient::Connect(string socketPath)
+{
+	// This method connects us to the server listening on socketPath
+	Close(); // Hang up on anyone we were already talking to
+	sockaddr_un address = {};
+	if (socketPath.size() >= sizeof(address.sun_path))
+	{
+		lastError = "Socket path is too long: " + socketPath;
+		return false;
+	}
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socketPath.c_str());
+	connection = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (connection < 0 || connect(connection, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		lastError = "Unable to connect to a server on socket: " + socketPath;
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool DaemonClient::Call(int op, string treePath, const unsigned char* data, size_t length, vector<unsigned char>& output)
+{
+	// This method sends one request to the server and waits for its answer. On success output holds
+	// exactly what the equivalent command line would have written, and on failure lastError says why
+	output.clear();
+	if (connection < 0)
+	{
+		lastError = "Not connected";
+		return false;
+	}
+	unsigned char header[Daemon::requestHeaderSize] = { 'H', 'D', (unsigned char)op };
+	putLength(&header[3], treePath.size(), 4);
+	unsigned char lengthBytes[8];
+	putLength(lengthBytes, length, 8);
+	unsigned char response[Daemon::responseHeaderSize];
+	if (!sendAll(connection, header, Daemon::requestHeaderSize) || !sendAll(connection, (const unsigned char*)treePath.data(), treePath.size())
+		|| !sendAll(connection, lengthBytes, 8) || !sendAll(connection, data, length) || !receiveAll(connection, response, Daemon::responseHeaderSize))
+	{
+		lastError = "Lost the connection to the server";
+		Close();
+		return false;
+	}
+	unsigned long long responseLength = getLength(&response[1], 8);
+	if (responseLength > Daemon::maxOutput)
+	{
+		lastError = "Response from the server is too large";
+		Close(); // We can't tell where the next response would start
+		return false;
+	}
+	output.resize(responseLength);
+	if (!receiveAll(connection, output.data(), output.size()))
+	{
+		lastError = "Lost the connection to the server";
+		output.clear();
+		Close();
+		return false;
+	}
+	if (response[0] != Daemon::statusOK)
+	{
+		lastError.assign(output.begin(), output.end()); // An error response carries its message instead of output
+		output.clear();
+		return false;
+	}
+	return true;
+}
+
+void DaemonClient::Close()
+{
+	// This method hangs up on the server, if we are connected
+	if (connection >= 0) close(connection);
+	connection = -1;
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+	Quinn Kleinfelter
+	EECS 2520-001 Non Linear Data Structures Spring 2020
+	Dr. Thomas
+
+	Header file to contain the class definitions for a long-lived
+	server that encodes and decodes requests sent over a Unix domain
+	socket, and the small client that talks to it. Starting up a new
+	process, reading a tree file and building its tables costs more
+	than coding a small file does, so the server keeps Huffman objects
+	around with their trees and tables already built, in a cache that
+	forgets the least recently used trees first.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+using namespace std;
+
+class Huffman;
+
+class Daemon
+{
+public:
+	Daemon(size_t cacheSize = 64); // Sets up a server that keeps the tables for up to cacheSize trees
+	void SetTreeStore(string directory); // Sets the directory trained trees are loaded from when decoding files encoded with them
+	bool Serve(string socketPath, unsigned int workerCount = 0); // Answers requests on socketPath with workerCount threads (or one per core) until a client asks us to stop, returning false if we couldn't start
+
+	const static int opEncodeWithTree = 'E'; // Request to encode the payload with a tree file, like -et
+	const static int opEncodeCanonical = 'C'; // Request to encode the payload with canonical codes, like -ec
+	const static int opDecode = 'D'; // Request to decode the payload, like -d
+	const static int opStop = 'S'; // Request for the server to stop once the requests it is working on finish
+	const static int statusOK = 0; // Status byte of a response carrying our output
+	const static int statusError = 1; // Status byte of a response carrying an error message
+	const static int requestHeaderSize = 7; // Size of a request before its tree file path: the 'H' 'D' magic bytes, the operation and the length of the path
+	const static int responseHeaderSize = 9; // Size of a response before its data: the status and the length of the data
+	const static unsigned long long maxPayload = 1ULL << 30; // The largest payload we accept, so a bad request can't make us allocate everything
+	const static unsigned long long maxOutput = 1ULL << 31; // The largest response we build, so a small corrupt payload can't decode into more than we can hold. Twice maxPayload, since any payload we accept encodes into less
+	const static unsigned int maxPathLength = 4096; // The longest tree file path we accept
+	const static int idleSeconds = 30; // How long a connection can sit without sending a request before we hang up on it
+
+private:
+	struct treeFile // The contents of a tree file, and enough about it to tell if it has changed
+	{
+		long long modified = 0; // When the file was last written
+		unsigned long long size = 0; // How big the file was
+		string contents; // What was in it
+	};
+
+	struct cacheEntry // The Huffman objects we keep around for one tree
+	{
+		list<string>::iterator recent; // Where this tree sits in recentTrees
+		vector<unique_ptr<Huffman>> idle; // Objects with this tree built that aren't working on a request
+	};
+
+	size_t cacheSize; // The most trees we keep objects around for
+	string treeStore; // The directory trained trees are loaded from, or empty for the default
+	unsigned int workers = 0; // How many connections we answer at once
+	int listenSocket = -1; // The socket we accept connections on
+	atomic<bool> stopping{ false }; // Set once a client has asked us to stop
+	mutex cacheMutex; // Mutex protecting everything below
+	list<string> recentTrees; // The trees we have objects for, most recently used first
+	unordered_map<string, cacheEntry> cache; // The objects we have for each tree, keyed by the tree itself
+	vector<unique_ptr<Huffman>> generalObjects; // Objects for requests that don't use a tree we can reuse
+	unordered_map<string, treeFile> treeFiles; // The tree files we have read in, keyed by path
+
+	void serveConnection(int connection); // Helper method that answers every request on connection until the client hangs up
+	bool handleRequest(int op, const string& treePath, const vector<unsigned char>& payload, vector<unsigned char>& output, string& error); // Helper method that runs one request, setting output or error
+	bool readTreeFile(const string& path, treeFile& file, bool& cached, string& error); // Helper method that reads in a tree file, or hands back our copy if it hasn't changed
+	void rememberTreeFile(const string& path, const treeFile& file); // Helper method that keeps our copy of a tree file once it has turned out to hold a tree
+	unique_ptr<Huffman> acquire(const string& key); // Helper method that hands out an object, one that already has tree key built if we have one
+	void release(const string& key, unique_ptr<Huffman> huffman); // Helper method that takes an object back once it has finished, forgetting the least recently used trees if we have too many
+};
+
+class DaemonClient
+{
+public:
+	~DaemonClient();
+	bool Connect(string socketPath); // Connects to the server listening on socketPath, returning false if nobody is
+	bool Call(int op, string treePath, const unsigned char* data, size_t length, vector<unsigned char>& output); // Sends one request and replaces output with the server's answer, returning false if the server reported an error or went away
+	string LastError(); // Returns why the last Connect or Call failed
+	void Close(); // Hangs up on the server
+
+private:
+	int connection = -1; // Our socket connected to the server
+	string lastError; // Why the last thing we did failed
+};
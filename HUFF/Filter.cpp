@@ -0,0 +1,315 @@
+/*
+	File: Filter.cpp - Implementation of our reversible filters
+	c.f.: Filter.h
+
+	The delta filter stores each byte as the difference from the byte one
+	record before it, so columns of slowly changing numbers turn into runs
+	of small differences. The branch filter finds x86 call (E8) and jump
+	(E9) instructions and replaces their 32 bit relative targets with
+	absolute ones, so calls to the same function from all over a program
+	become the same bytes. Both are written to run at memory speed: the
+	delta filter works 16 bytes at a time with SSE2, and the branch filter
+	uses SSE2 to skip over the 16 byte stretches that have no E8 or E9.
+
+	Author: Quinn Kleinfelter
+	Class: EECS 2510-001 Non Linear Data Structures Spring 2020
+	Instructor: Dr. Thomas
+	Copyright: Copyright 2020 by Quinn Kleinfelter. All rights reserved.
+*/
+
+#include "Filter.h"
+#include "Histogram.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FILTER_SSE2
+#endif
+
+namespace
+{
+	const int vectorSize = 16; // The number of bytes our SSE2 loops work on at once
+	const int branchSize = 5; // The length of a call or jump: the E8 or E9 opcode and a 32 bit target
+	const int autoMaxStride = 16; // The widest record chooseFilter tries a delta filter on
+	const int filterSamplePieces = 16; // How many places in the input chooseFilter takes its samples from
+
+	void deltaEncode(const unsigned char* input, unsigned char* output, size_t length, int stride)
+	{
+		// Writes every byte of input minus the byte stride bytes before it to output, with the first stride bytes
+		// as they are. Every difference only depends on input, so they can all be worked out side by side
+		size_t i = min((size_t)stride, length);
+		memcpy(output, input, i); // Nothing comes before the first record
+#ifdef FILTER_SSE2
+		for (; i + vectorSize <= length; i += vectorSize)
+		{
+			__m128i current = _mm_loadu_si128((const __m128i*)(input + i));
+			__m128i before = _mm_loadu_si128((const __m128i*)(input + i - stride));
+			_mm_storeu_si128((__m128i*)(output + i), _mm_sub_epi8(current, before));
+		}
+#endif
+		for (; i < length; i++)
+			output[i] = (unsigned char)(input[i] - input[i - stride]);
+	}
+
+	void deltaDecode(unsigned char* data, size_t start, size_t length, int stride)
+	{
+		// Adds back the byte stride bytes before each byte of data from start to length, in place. The bytes before
+		// start are already decoded. Each byte needs the decoded byte before it, so for strides of 16 or more a whole
+		// vector's worth is ready at once, and strides of 1, 2, 4 or 8 add up each vector with a few shifts and then
+		// add on the last record of the vector before it. Other strides go a byte at a time
+		size_t i = start;
+#ifdef FILTER_SSE2
+		if (stride >= vectorSize)
+		{
+			for (; i + vectorSize <= length; i += vectorSize)
+			{
+				__m128i differences = _mm_loadu_si128((const __m128i*)(data + i));
+				__m128i before = _mm_loadu_si128((const __m128i*)(data + i - stride));
+				_mm_storeu_si128((__m128i*)(data + i), _mm_add_epi8(differences, before));
+			}
+		}
+		else if (stride == 1 || stride == 2 || stride == 4 || stride == 8)
+		{
+			for (; i + vectorSize <= length; i += vectorSize)
+			{
+				__m128i sums = _mm_loadu_si128((const __m128i*)(data + i));
+				// Add every lane onto the lanes one, two, four and then eight records after it, which leaves each
+				// lane holding the sum of its own record's differences back to the start of the vector
+				if (stride == 1) sums = _mm_add_epi8(sums, _mm_slli_si128(sums, 1));
+				if (stride <= 2) sums = _mm_add_epi8(sums, _mm_slli_si128(sums, 2));
+				if (stride <= 4) sums = _mm_add_epi8(sums, _mm_slli_si128(sums, 4));
+				sums = _mm_add_epi8(sums, _mm_slli_si128(sums, 8));
+				__m128i last; // The last record before this vector, repeated across it
+				if (stride == 1)
+					last = _mm_set1_epi8((char)data[i - 1]);
+				else if (stride == 2)
+				{
+					short record;
+					memcpy(&record, data + i - 2, 2);
+					last = _mm_set1_epi16(record);
+				}
+				else if (stride == 4)
+				{
+					int record;
+					memcpy(&record, data + i - 4, 4);
+					last = _mm_set1_epi32(record);
+				}
+				else
+				{
+					long long record;
+					memcpy(&record, data + i - 8, 8);
+					last = _mm_set1_epi64x(record);
+				}
+				_mm_storeu_si128((__m128i*)(data + i), _mm_add_epi8(sums, last));
+			}
+		}
+#endif
+		for (; i < length; i++)
+			data[i] = (unsigned char)(data[i] + data[i - stride]);
+	}
+
+	size_t branchConvert(unsigned char* data, size_t length, unsigned long long offset, bool encoding)
+	{
+		// Converts the target of every call and jump in data from relative to absolute (encoding) or back again,
+		// where offset is how far into the whole input data starts. Returns where we stopped, the first place a
+		// branch would run off the end of data. Only targets within 16 MB of the branch get converted, since
+		// those are the real calls, and they are converted within those same 2^25 values so the decoder can
+		// tell which ones we converted just by looking. The target after every E8 or E9 is skipped over whether
+		// we convert it or not, so no two targets overlap and the decoder checks exactly the same bytes we did
+		size_t i = 0;
+#ifdef FILTER_SSE2
+		const __m128i opcodeMask = _mm_set1_epi8((char)0xFE); // E8 and E9 only differ in their lowest bit
+		const __m128i opcode = _mm_set1_epi8((char)0xE8);
+#endif
+		while (i + branchSize <= length)
+		{
+#ifdef FILTER_SSE2
+			if (i + vectorSize + branchSize - 1 <= length)
+			{
+				// Jump straight to the next E8 or E9, which in most code is several vectors away
+				__m128i bytes = _mm_loadu_si128((const __m128i*)(data + i));
+				int found = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(bytes, opcodeMask), opcode));
+				if (found == 0)
+				{
+					i += vectorSize;
+					continue;
+				}
+				int skip = 0; // The position of the lowest set bit of found
+				while (!(found & (1 << skip)))
+					skip++;
+				i += skip;
+			}
+			else if ((data[i] & 0xFE) != 0xE8)
+			{
+				i++;
+				continue;
+			}
+#else
+			if ((data[i] & 0xFE) != 0xE8)
+			{
+				i++;
+				continue;
+			}
+#endif
+			unsigned int target = data[i + 1] | (data[i + 2] << 8) | (data[i + 3] << 16) | ((unsigned int)data[i + 4] << 24);
+			if (((target + 0x01000000) & 0xFE000000) != 0)
+			{
+				i += branchSize; // The top byte isn't 00 or FF, so this isn't a real call, but we still skip it so no later branch can change the bytes we just looked at
+				continue;
+			}
+			unsigned int address = (unsigned int)(offset + i + branchSize); // Targets are relative to the end of the instruction
+			target = (encoding ? target + address : target - address) & 0x01FFFFFF;
+			if (target & 0x01000000)
+				target |= 0xFE000000; // Put the top byte back to 00 or FF
+			data[i + 1] = (unsigned char)target;
+			data[i + 2] = (unsigned char)(target >> 8);
+			data[i + 3] = (unsigned char)(target >> 16);
+			data[i + 4] = (unsigned char)(target >> 24);
+			i += branchSize;
+		}
+		return i;
+	}
+
+	double estimateBits(const unsigned long long* counts)
+	{
+		// Returns about how many bits order 0 codes would take for symbols with the given counts, from their entropy
+		unsigned long long total = 0;
+		for (int symbol = 0; symbol < 256; symbol++)
+			total += counts[symbol];
+		double bits = 0;
+		for (int symbol = 0; symbol < 256; symbol++)
+		{
+			if (counts[symbol] > 0)
+				bits += counts[symbol] * log2((double)total / counts[symbol]);
+		}
+		return bits;
+	}
+}
+
+bool parseFilter(const string& name, int& type, int& parameter)
+{
+	// Reads a filter name from the command line. A delta filter defaults to a stride of 1 (plain differences
+	// between neighboring bytes), and delta:4 would be for a table of 32 bit numbers
+	parameter = 0;
+	if (name == "none") type = filterNone;
+	else if (name == "bcj" || name == "x86") type = filterBranch;
+	else if (name == "auto") type = filterAuto;
+	else if (name == "delta")
+	{
+		type = filterDelta;
+		parameter = 1;
+	}
+	else if (name.compare(0, 6, "delta:") == 0 && name.length() > 6 && name.length() <= 9 && name.find_first_not_of("0123456789", 6) == string::npos)
+	{
+		type = filterDelta;
+		parameter = stoi(name.substr(6));
+	}
+	else
+		return false;
+	return type != filterDelta || (parameter >= 1 && parameter <= maxDeltaStride);
+}
+
+bool validFilter(int type, int parameter)
+{
+	// Returns whether a file's header names a filter we can undo
+	if (type == filterDelta) return parameter >= 1 && parameter <= maxDeltaStride;
+	return type == filterBranch && parameter == 0;
+}
+
+void chooseFilter(const unsigned char* data, size_t length, int& type, int& parameter)
+{
+	// Tries the branch filter and a delta filter for every record width up to autoMaxStride on samples of data,
+	// and picks whichever makes them smallest. The samples are spread evenly over data, since files often start
+	// with headers that look nothing like the rest. A filter has to save at least 1% to be worth it, otherwise
+	// we leave the data alone
+	size_t pieceLength = min(length, filterSampleSize) / filterSamplePieces; // How long each sample is
+	vector<unsigned char> filtered(pieceLength); // A sample after a filter
+	type = filterNone;
+	parameter = 0;
+	if (pieceLength == 0) return; // Too small to be worth filtering at all
+	double best = 0; // What a filter has to beat
+	for (int stride = -1; stride <= autoMaxStride; stride++)
+	{
+		int candidate = stride < 0 ? filterNone : stride == 0 ? filterBranch : filterDelta; // Stride -1 is the data as it is, and 0 stands for the branch filter
+		unsigned long long counts[256] = { 0 };
+		for (int piece = 0; piece < filterSamplePieces; piece++)
+		{
+			const unsigned char* sample = data + (length - pieceLength) / (filterSamplePieces - 1) * piece; // The first sample is at the start and the last at the end
+			applyFilter(candidate, max(stride, 0), sample, filtered.data(), pieceLength);
+			countSymbols(filtered.data(), pieceLength, counts);
+		}
+		double bits = estimateBits(counts);
+		if (candidate == filterNone)
+			best = bits * 0.99;
+		else if (bits < best)
+		{
+			best = bits;
+			type = candidate;
+			parameter = stride;
+		}
+	}
+}
+
+void applyFilter(int type, int parameter, const unsigned char* input, unsigned char* output, size_t length)
+{
+	// Runs a filter over all of input. The branch filter works in place, so it starts from a copy
+	if (type == filterDelta)
+		deltaEncode(input, output, length, parameter);
+	else
+	{
+		memcpy(output, input, length);
+		if (type == filterBranch)
+			branchConvert(output, length, 0, true);
+	}
+}
+
+void InverseFilter::Start(int type, int parameter)
+{
+	// Starts undoing a filter at the very beginning of the data
+	this->type = type;
+	this->parameter = parameter;
+	position = 0;
+	pending.clear();
+}
+
+bool InverseFilter::IsActive()
+{
+	// Returns whether we are undoing a filter
+	return type != filterNone;
+}
+
+void InverseFilter::Decode(const unsigned char* data, size_t length, vector<unsigned char>& output)
+{
+	// Undoes our filter on the next piece of data. Both filters work on the bytes we held back from last time
+	// followed by the new ones: a delta filter needs the last stride bytes it decoded, which it keeps but doesn't
+	// hand out again, and a branch filter needs whole branches, so it holds back a branch that got cut off
+	output.assign(pending.begin(), pending.end());
+	output.insert(output.end(), data, data + length);
+	if (type == filterDelta)
+	{
+		size_t history = pending.size(); // The bytes we already handed out, which only the first record of this piece needs
+		size_t start = max(history, min((size_t)parameter, output.size())); // The very first record has nothing before it, so it was stored as it is
+		deltaDecode(output.data(), start, output.size(), parameter);
+		size_t keep = min((size_t)parameter, output.size()); // Hang on to the last record for the next piece
+		pending.assign(output.end() - keep, output.end());
+		output.erase(output.begin(), output.begin() + history); // And don't hand out the old one again
+	}
+	else
+	{
+		size_t done = branchConvert(output.data(), output.size(), position, false); // Everything before here is back to how it was
+		pending.assign(output.begin() + done, output.end());
+		output.resize(done);
+		position += done;
+	}
+}
+
+void InverseFilter::Finish(vector<unsigned char>& output)
+{
+	// Hands out what we held back and stops. A delta filter already handed out everything, and a branch filter's
+	// last few bytes were too close to the end for the encoder to convert, so they are already as they were
+	output.clear();
+	if (type == filterBranch)
+		output.swap(pending);
+	Start(filterNone, 0);
+}
@@ -0,0 +1,46 @@
+/*
+	Quinn Kleinfelter
+	EECS 2520-001 Non Linear Data Structures Spring 2020
+	Dr. Thomas
+
+	Header file containing the reversible filters we can run over a file
+	before encoding it. Huffman codes only see how often each byte shows
+	up, so data whose bytes are related to the bytes around them (tables
+	of numbers, or x86 code full of call addresses) codes poorly as it is.
+	A filter rewrites it into bytes that are more skewed, and its inverse
+	puts the original back after decoding, a piece at a time as the
+	decoder writes its output.
+*/
+
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+using namespace std;
+
+const int filterNone = 0; // No filter, the data is coded as it is
+const int filterDelta = 1; // Every byte minus the byte stride bytes before it, for tables of fixed-width numbers
+const int filterBranch = 2; // x86 call and jump targets turned from relative into absolute addresses, for executables
+const int filterAuto = -1; // Not a filter, asks chooseFilter to pick one
+const int maxDeltaStride = 255; // The widest record a delta filter handles, so its stride fits in a byte
+const size_t filterSampleSize = (size_t)256 << 10; // How much of the input chooseFilter tries each filter on, all of its samples together
+
+bool parseFilter(const string& name, int& type, int& parameter); // Reads a filter name (none, delta, delta:stride, bcj or auto) into a type and parameter, returning false if we don't know it
+bool validFilter(int type, int parameter); // Returns whether type and parameter make a filter we can undo, for checking file headers
+void chooseFilter(const unsigned char* data, size_t length, int& type, int& parameter); // Picks whichever filter makes a sample of data smallest with order 0 codes, which may be filterNone
+void applyFilter(int type, int parameter, const unsigned char* input, unsigned char* output, size_t length); // Runs a filter over the whole of input, writing length bytes to output
+
+class InverseFilter // Undoes a filter on data that arrives a piece at a time, holding back whatever it can't undo yet
+{
+public:
+	void Start(int type, int parameter); // Starts undoing the given filter from the beginning of the data
+	bool IsActive(); // Returns whether we have a filter started
+	void Decode(const unsigned char* data, size_t length, vector<unsigned char>& output); // Undoes the filter on the next piece of data, replacing output with the original bytes that are ready
+	void Finish(vector<unsigned char>& output); // Replaces output with whatever we held back, and stops
+
+private:
+	int type = filterNone; // The filter we are undoing
+	int parameter = 0; // Its stride, for a delta filter
+	unsigned long long position = 0; // Where in the data the first byte of pending sits
+	vector<unsigned char> pending; // The last stride bytes we decoded for a delta filter, or the bytes a branch filter couldn't look at yet
+};
@@ -0,0 +1,154 @@
+/*
+	File: Histogram.cpp - Implementation of our symbol counting functions
+	c.f.: Histogram.h
+
+	Counting symbols the simple way (counts[data[i]]++) is slow whenever the
+	same symbol shows up many times in a row, since every increment has to
+	wait for the one before it to land in memory. We spread consecutive bytes
+	across several separate tables so neighboring increments don't depend on
+	each other, skip over runs of a single repeated byte 32 at a time, and add
+	the tables together at the end.
+
+	Author: Quinn Kleinfelter
+	Class: EECS 2510-001 Non Linear Data Structures Spring 2020
+	Instructor: Dr. Thomas
+	Copyright: Copyright 2020 by Quinn Kleinfelter. All rights reserved.
+*/
+
+#include "Histogram.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HISTOGRAM_SSE2
+#endif
+
+namespace
+{
+	const int laneCount = 4; // The number of separate tables we count into
+	const size_t laneLimit = (size_t)1 << 30; // The most bytes we count into our 32 bit tables before adding them onto the 64 bit counts
+	const size_t parallelSliceSize = (size_t)1 << 22; // How many bytes each thread counts at a time when we do split a buffer up
+
+	inline bool isRun(const unsigned char* data)
+	{
+		// Returns whether the 32 bytes starting at data are all the same byte. Uses a vector
+		// compare when the compiler lets us, or compares them 8 bytes at a time otherwise
+#if defined(__AVX2__)
+		__m256i bytes = _mm256_loadu_si256((const __m256i*)data);
+		__m256i first = _mm256_set1_epi8((char)data[0]);
+		return _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, first)) == -1;
+#elif defined(HISTOGRAM_SSE2)
+		__m128i first = _mm_set1_epi8((char)data[0]);
+		__m128i low = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)data), first);
+		__m128i high = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), first);
+		return _mm_movemask_epi8(_mm_and_si128(low, high)) == 0xFFFF;
+#else
+		unsigned long long words[4];
+		memcpy(words, data, sizeof(words)); // memcpy so we don't care about alignment, compilers turn this into plain loads
+		return words[0] == data[0] * 0x0101010101010101ULL && words[1] == words[0] && words[2] == words[0] && words[3] == words[0];
+#endif
+	}
+
+	void countPiece(const unsigned char* data, size_t length, unsigned long long* counts)
+	{
+		// Counts a piece of at most laneLimit bytes into laneCount 32 bit tables, then adds them onto counts.
+		// Each group of 8 bytes is split across the tables, so no two neighboring bytes share a counter
+		unique_ptr<unsigned int[]> lanes(new unsigned int[laneCount * 256]()); // Our tables, all starting at 0
+		unsigned int* lane0 = lanes.get();
+		unsigned int* lane1 = lane0 + 256;
+		unsigned int* lane2 = lane1 + 256;
+		unsigned int* lane3 = lane2 + 256;
+		size_t i = 0;
+		for (; i + 32 <= length; i += 32)
+		{
+			if (isRun(data + i))
+			{
+				// A run of one byte, like the zero padding in binaries, gets counted all at once
+				lane0[data[i]] += 32;
+				continue;
+			}
+			for (size_t j = i; j < i + 32; j += 8)
+			{
+				unsigned long long word;
+				memcpy(&word, data + j, 8); // Grab 8 bytes at a time, and pull the symbols out of the word
+				lane0[word & 0xFF]++;
+				lane1[(word >> 8) & 0xFF]++;
+				lane2[(word >> 16) & 0xFF]++;
+				lane3[(word >> 24) & 0xFF]++;
+				lane0[(word >> 32) & 0xFF]++;
+				lane1[(word >> 40) & 0xFF]++;
+				lane2[(word >> 48) & 0xFF]++;
+				lane3[word >> 56]++;
+			}
+		}
+		for (; i < length; i++)
+			lane0[data[i]]++; // Whatever is left over doesn't fill a whole group
+		for (int symbol = 0; symbol < 256; symbol++)
+			counts[symbol] += (unsigned long long)lane0[symbol] + lane1[symbol] + lane2[symbol] + lane3[symbol]; // Add our tables together into the real counts
+	}
+}
+
+void countSymbols(const unsigned char* data, size_t length, unsigned long long* counts)
+{
+	// Counts every symbol in data onto counts. Our tables are only 32 bits, so anything bigger
+	// than laneLimit is counted in pieces, with each piece added onto the 64 bit counts
+	for (size_t position = 0; position < length; position += laneLimit)
+		countPiece(data + position, min(laneLimit, length - position), counts);
+}
+
+void countSymbolsParallel(const unsigned char* data, size_t length, unsigned long long* counts, ThreadPool& pool)
+{
+	// Counts every symbol in data onto counts, splitting it into slices spread across pool. Each
+	// slice gets its own set of counts so threads never share a counter, and we add them up at the end
+	if (length < parallelCountThreshold || pool.Size() == 1)
+	{
+		countSymbols(data, length, counts); // Not worth the trouble of splitting up
+		return;
+	}
+	size_t sliceCount = (length + parallelSliceSize - 1) / parallelSliceSize; // The number of slices, the last one may be short
+	vector<unsigned long long> sliceCounts(sliceCount * 256); // A separate set of counts for each slice
+	pool.ParallelFor(sliceCount, [&](size_t slice)
+	{
+		size_t start = slice * parallelSliceSize; // Where this slice starts
+		countSymbols(data + start, min(parallelSliceSize, length - start), &sliceCounts[slice * 256]);
+	});
+	for (size_t i = 0; i < sliceCounts.size(); i++)
+		counts[i % 256] += sliceCounts[i]; // Add every slice's counts into the real counts
+}
+
+void countPairs(const unsigned char* data, size_t length, unsigned char previous, unsigned long long* counts)
+{
+	// Counts every pair of neighboring symbols in data onto counts, a row of 256 counts for each symbol that can
+	// come first. Neighboring pairs land in different rows unless a symbol repeats, so this doesn't have the
+	// problem countSymbols works around, and a table of 65536 counts is too big to keep several copies of anyway
+	for (size_t i = 0; i < length; i++)
+	{
+		counts[previous * 256 + data[i]]++;
+		previous = data[i];
+	}
+}
+
+void countPairsParallel(const unsigned char* data, size_t length, unsigned long long* counts, ThreadPool& pool)
+{
+	// Counts every pair of neighboring symbols in data onto counts, giving each thread in pool one piece of
+	// data and a table of its own. Each piece starts from the last symbol of the piece before it, so no pair is lost
+	if (length < parallelCountThreshold || pool.Size() == 1)
+	{
+		countPairs(data, length, 0, counts); // Not worth the trouble of splitting up
+		return;
+	}
+	size_t pieceCount = pool.Size(); // One piece for each thread
+	size_t pieceLength = (length + pieceCount - 1) / pieceCount;
+	vector<unsigned long long> pieceCounts(pieceCount * 256 * 256); // A separate table for each piece
+	pool.ParallelFor(pieceCount, [&](size_t piece)
+	{
+		size_t start = piece * pieceLength; // Where this piece starts
+		if (start < length)
+			countPairs(data + start, min(pieceLength, length - start), start > 0 ? data[start - 1] : 0, &pieceCounts[piece * 256 * 256]);
+	});
+	for (size_t i = 0; i < pieceCounts.size(); i++)
+		counts[i % (256 * 256)] += pieceCounts[i]; // Add every piece's table into the real counts
+}
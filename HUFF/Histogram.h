@@ -0,0 +1,21 @@
+/*
+	Quinn Kleinfelter
+	EECS 2520-001 Non Linear Data Structures Spring 2020
+	Dr. Thomas
+
+	Header file containing the functions we use to count how many
+	times each symbol appears in a buffer. Counting is the first
+	thing every encode does, so it is written to keep the CPU busy
+	instead of waiting on the same few counters over and over.
+*/
+
+#pragma once
+#include <cstddef>
+#include "ThreadPool.h"
+
+const size_t parallelCountThreshold = (size_t)1 << 23; // Buffers smaller than this aren't worth splitting across threads
+
+void countSymbols(const unsigned char* data, size_t length, unsigned long long* counts); // Adds the number of times each symbol appears in data onto counts[0] through counts[255]
+void countSymbolsParallel(const unsigned char* data, size_t length, unsigned long long* counts, ThreadPool& pool); // Same as countSymbols, but splits large buffers across the threads in pool
+void countPairs(const unsigned char* data, size_t length, unsigned char previous, unsigned long long* counts); // Adds the number of times each symbol follows each other symbol in data onto counts[previous * 256 + symbol], with previous coming before data[0]
+void countPairsParallel(const unsigned char* data, size_t length, unsigned long long* counts, ThreadPool& pool); // Same as countPairs starting from a previous symbol of 0, but splits large buffers across the threads in pool
@@ -3,8 +3,9 @@
 	c.f.: Huffman.h
 
 	This class implements a Huffman encoding of a given file using a tree.
-	Each node contains a symbol, the number of times the symbol appears in the input, 
-	and a pointer to its left and right children.
+	Each node contains a symbol, the number of times the symbol appears in the input,
+	and the indexes of its left and right children. All of the nodes live in one array
+	(tree[]), so building a tree never allocates and deleting one is just a reset.
 
 	Author: Quinn Kleinfelter
 	Class: EECS 2510-001 Non Linear Data Structures Spring 2020
@@ -15,42 +16,65 @@
 
 
 #include "Huffman.h"
+#include "ThreadPool.h"
+#include "Histogram.h"
 #include <iostream>
-#include <time.h>
+#include <algorithm>
+#include <iterator>
+#include <string.h>
+#include <filesystem>
+#include <sstream>
+#include <climits>
+#include <cerrno>
+#include <cmath>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
 
-Huffman::Huffman() : nodes{ nullptr }, frequencyTable { 0 }
+Huffman::Huffman() : frequencyTable{ 0 }
 {
 	// Constructor, not much to do here except start out our clock and make sure our
-	// arrays are initialized to nullptr and 0, as seen above, to ensure we don't get
-	// warnings from Visual Studio
-	start = clock();
+	// arrays are initialized, our frequencies to 0 as seen above and our (empty) tree
+	// by deleteTree, to ensure we don't get warnings from Visual Studio
+	deleteTree();
+	start = chrono::steady_clock::now();
 }
 
 Huffman::~Huffman()
 {
-	// Destructor, all we need to do here is loop through all of our nodes and if the
-	// current spot isn't null delete it and its subtrees
+	// Destructor, our tree lives in tree[] so there is nothing to free
+}
+
+void Huffman::deleteTree()
+{
+	// Helper method that deletes the tree we built, so we can build a new one.
+	// Our nodes all live in tree[], so all we need to do is forget about them
+	nodeCount = 0;
+	fill(nodes, nodes + numChars, noNode); // Every slot starts out empty
 	for (int i = 0; i < numChars; i++)
-	{
-		if (nodes[i] != nullptr)
-			deleteSubtree(nodes[i]);
-	}
+		encodingStrings[i] = ""; // The old codes don't mean anything for the next tree
+	paddingBits = ""; // Our padding came from the old tree, so it needs to be found again too
+	hasSharedTree = false; // Whatever tree we had is gone, so it can't be shared anymore
+	sharedTreeTrained = false;
+	trainedTreeLoaded = false; // Nor is it a trained tree anymore
+	decodeTableCurrent = false; // And our decode tables don't match the next tree
+	codeTableCurrent = false; // Nor do our codes
+	treeSource.clear(); // And the next tree comes from somewhere else
 }
 
-void Huffman::deleteSubtree(node* startingNode)
+unsigned short Huffman::addNode(unsigned char symbol, unsigned long long weight, unsigned short left, unsigned short right)
 {
-	// Helper method that deletes the subtrees of a node
-	if (startingNode->left != nullptr)
-	{
-		// If the left child isn't null, recursively delete its subtrees
-		deleteSubtree(startingNode->left);
-	}
-	if (startingNode->right != nullptr)
-	{
-		// If the right child isn't null, recursively delete its subtrees
-		deleteSubtree(startingNode->right);
-	}
-	delete startingNode; // Once we've deleted its children it is safe to delete the start
+	// Helper method that takes the next free node in tree[], fills it in, and returns its index.
+	// A tree with 256 leaves has exactly 511 nodes, which is how big tree[] is
+	node& newNode = tree[nodeCount];
+	newNode.symbol = symbol;
+	newNode.weight = weight;
+	newNode.left = left;
+	newNode.right = right;
+	return (unsigned short)nodeCount++;
 }
 
 void Huffman::MakeTreeBuilder(string inputFile, string outputFile)
@@ -67,24 +91,13 @@ void Huffman::MakeTreeBuilder(string inputFile, string outputFile)
 	if (outputFile == "")
 	{
 		// If we don't have an output file, we want to figure it out based on our input
-		// First we look for a period
-		auto dotLoc = inputFile.find(".");
-		if (dotLoc == string::npos)
-		{
-			// If there isn't a period (meaning no extension), we simply append
-			// .htree to the inputFile name for our output
-			outputFile = inputFile + ".htree";
-		}
-		else
-		{
-			// Otherwise, we want to remove the extension and replace it with .htree
-			string fileNameWithoutExtension = inputFile.substr(0, dotLoc);
-			outputFile = fileNameWithoutExtension + ".htree";
-		}
+		outputFile = defaultOutputFile(inputFile, ".htree");
 	}
 	if(!openFiles(inputFile, outputFile, "")) return; // Open up our input and output streams, we don't need a tree stream for this, return and exit if any fail
 	buildFrequencyTable(); // Build out a frequency table from our input file
-	buildTree(); // Build the tree based on that frequency table
+	unsigned char treeBuilder[treeBuilderSize]; // The tree builder information for our tree
+	buildTree(treeBuilder); // Build the tree based on that frequency table
+	writeOutput(treeBuilder, treeBuilderSize); // And write out its tree builder information
 	closeFiles(); // Close out the files since that's all we want to do!
 	printActionDetail(); // Print out information about what we did!
 }
@@ -101,57 +114,32 @@ void Huffman::EncodeFile(string inputFile, string outputFile)
 	if (outputFile == "")
 	{
 		// If the output file isn't specified, we need to determine it from the inputfile
-		auto dotLoc = inputFile.find("."); // Check if a . exists in the inputFile name
-		if (dotLoc == string::npos)
-		{
-			// If there isn't a . in the inputFile name, simply append .huf to the inputFile and make it the output
-			outputFile = inputFile + ".huf";
-		}
-		else
-		{
-			// Otherwise, since a . exists, grab the subtring before that dot
-			string fileNameWithoutExtension = inputFile.substr(0, dotLoc);
-			outputFile = fileNameWithoutExtension + ".huf"; // And make the output file equal to the inputFile but with its extension changed to .huf
-		}
+		outputFile = defaultOutputFile(inputFile, ".huf");
 	}
 	if (!openFiles(inputFile, outputFile, "")) return;  // Open up our files into our streams, treeFile is not needed so we don't use it, return and exit if any fail
 	buildFrequencyTable(); // Build the frequency table from our input file
-	buildTree(); // Build the tree based on our frequency table
+	unsigned char treeBuilder[treeBuilderSize]; // The tree builder information for our tree
+	buildTree(treeBuilder); // Build the tree based on our frequency table
 	buildEncodingStrings(nodes[0], ""); // Build our list of encoding strings based on the tree
-	encode(); // Actually encode the file
-	printActionDetail(); // Print out the runtime / space information
-}
-
-int Huffman::getSmallestNodeIndex(int indexToSkip)
-{
-	// This is a helper function that loops through our nodes array
-	// to find the node that has the smallest weight and return its index.
-	// We include an index we want to skip so we can run this method twice and
-	// not get the same index both times
-	unsigned int smallestWeight = INT32_MAX; // Initialize a smallest weight to be the maximum number our unsigned int can hold
-	int smallestIndex = -1; // Set up a variable to hold our smallest index, which by default is -1
-	for (int i = 0; i < numChars; i++)
+	buildCodeTable(); // Turn those strings into numeric codes we can write out quickly
+	if (!storeIfSmaller(treeBuilderSize + codedBytes())) // Data that won't get any smaller (already compressed, say) is just stored
 	{
-		// Loop through the array
-		if (i == indexToSkip || nodes[i] == nullptr) continue; // If we are at the index we want to skip, or the current node is null, continue on to the next iteration
-		if (nodes[i]->weight < smallestWeight) // If the weight of our current node is smaller than the smallest weight we have seen yet
-		{
-			smallestIndex = i; // Set the smallest index to our current index
-			smallestWeight = nodes[i]->weight; // Set the smallest weight to our current weight
-		}
+		writeOutput(treeBuilder, treeBuilderSize); // Otherwise write out the tree at the start of the file, so we can decode it later
+		encode(); // And actually encode the file
 	}
-	return smallestIndex; // Once we've looped through the whole thing, return the index of the smallest weight node
-
+	closeFiles(); // Close our files, so the output is all there as soon as we return
+	printActionDetail(); // Print out the runtime / space information
 }
 
-void Huffman::buildEncodingStrings(node* startingPoint, string currentPath)
+void Huffman::buildEncodingStrings(unsigned short startingPoint, string currentPath)
 {
 	// Recursive helper method to build out a table of encoding strings for the symbols
-	if (startingPoint == nullptr) return; // If the node we are at is null, return
+	if (startingPoint == noNode) return; // If there is no node here, return
+	if (currentPath.empty()) enterPhase(phaseCodeTable); // The outermost call is the start of building our codes
 	if (isLeaf(startingPoint))
 	{
 		// We arrived at a leaf so we need to keep track of the path
-		encodingStrings[startingPoint->symbol] = currentPath; // Set the encoding string for the symbol we are at to the currentPath
+		encodingStrings[tree[startingPoint].symbol] = currentPath; // Set the encoding string for the symbol we are at to the currentPath
 		if (currentPath.length() > 7) // If our currentPath has a length greater than 7 we know it is fine to use as padding
 		{
 			paddingBits = currentPath; // Set our padding to be the current path since its long enough
@@ -159,15 +147,15 @@ void Huffman::buildEncodingStrings(node* startingPoint, string currentPath)
 
 		return; // There is nothing more we need to do on this path so return our
 	}
-	if (startingPoint->left != nullptr)
+	if (tree[startingPoint].left != noNode)
 	{
 		// If the left child isn't null recursively build the encoding strings down that path, adding a 0 to the current path
-		buildEncodingStrings(startingPoint->left, currentPath + "0");
+		buildEncodingStrings(tree[startingPoint].left, currentPath + "0");
 	}
-	if (startingPoint->right != nullptr)
+	if (tree[startingPoint].right != noNode)
 	{
 		// If the right child isn't null recursively build the encoding strings down that path, adding a 1 to the current path
-		buildEncodingStrings(startingPoint->right, currentPath + "1");
+		buildEncodingStrings(tree[startingPoint].right, currentPath + "1");
 	}
 }
 
@@ -182,309 +170,3478 @@ void Huffman::DecodeFile(string inputFile, string outputFile)
 		return;
 	}
 	if (!openFiles(inputFile, outputFile, "")) return;  // Open up our input and output files, we don't need a tree stream here, return and exit if any fail
-	buildTreeFromFile(inputStream, false); // Build a tree from our input file, since our input must contain tree builder info
-	decode(); // Decode the file based on the tree we built
+	decodeInput(); // Figure out which format the file is in and decode it
 	closeFiles(); // Close out the files now that we're done
 	printActionDetail(); // Print info about the work we did
 }
 
-void Huffman::EncodeFileWithTree(string inputFile, string treeFile, string outputFile)
+void Huffman::DecodeFileRange(string inputFile, unsigned long long offset, unsigned long long length, string outputFile)
 {
-	// This method encodes an input file into an output file,
-	// using tree builder information from a third tree file
-	// This implements the -et command line parameter
+	// This method decodes just length bytes of the original file, starting at offset. Files written with
+	// checkpoints (-ek) let us start at the checkpoint right before offset, so the time this takes depends
+	// on the size of the range and not of the file. Canonical files without them (-ec) still work, they
+	// just have to be decoded from the beginning up to the range.
+	// This implements the -dr command line parameter
 	if (inputFile == outputFile)
 	{
-		// Our input and output files can't be the same so display an error and exit
+		// Our input can't be the same as our output, so display an error and exit
 		cout << "Input File can not be equal to Output File" << endl;
 		return;
 	}
-	if (outputFile == "")
-	{
-		// If our output file is empty, we want to decide it based on
-		// our input file, so first we look for a period
-		auto dotLoc = inputFile.find(".");
-		if (dotLoc == string::npos)
-		{
-			// If we don't have a period in the input file simply append .huf to it for our output
-			outputFile = inputFile + ".huf";
-		}
-		else
-		{
-			// Otherwise, replace the extension with .huf
-			string fileNameWithoutExtension = inputFile.substr(0, dotLoc);
-			outputFile = fileNameWithoutExtension + ".huf";
-		}
-	}
-	if (!openFiles(inputFile, outputFile, treeFile)) return;  // Open up all three of our files as we need, return and exit if any fail
-	buildTreeFromFile(treeStream, true); // Build our tree based on the information from our treeStream
-	buildEncodingStrings(nodes[0], ""); // Build our table of encoding strings from that tree
-	encode(); // Encode the file
-	closeFiles(); // Close our files since we are done
-	printActionDetail(); // Print info about what we did
+	if (!openFiles(inputFile, outputFile, "")) return;  // Open up our input and output files, we don't need a tree stream here, return and exit if any fail
+	inputPrefetch.Stop(); // We only read the part of the file our range is in, so reading the whole thing ahead would just waste time
+	int format = readFormat(); // Check which format the file is in
+	if (format == checkpointFormat || format == canonicalFormat)
+		decodeRange(format, offset, length); // Decode just the range we want
+	else if (format == storedFormat)
+		decodeStored(offset, length); // A stored file is already in the clear, so just copy the range out
+	else
+		reportError("Ranges can only be decoded from files written by -ek or -ec");
+	closeFiles(); // Close out the files now that we're done
+	printActionDetail(); // Print info about the work we did
 }
 
-void Huffman::DisplayHelp()
+void Huffman::BuildSharedTree(const unsigned char* sample, size_t length)
 {
-	// This is a method to display help information about our project
-	cout << "Available command line options" << endl;
-	cout << "HUFF -h | -? | -help will display this message again" << endl;
-	cout << "HUFF -e file1 [file2] will encode file1, placing the output into file2, or file1 with extension changed to .huf" << endl;
-	cout << "HUFF -d file1 file2 Decodes Huffman-Encoded file1 into file2" << endl;
-	cout << "HUFF -t file1 [file2] will create 510 byte tree building information and output it into file2, or file1 with extension changed to .htree" << endl;
-	cout << "HUFF -et file1 file2 [file3] will encode file1, using tree building information in file2, and output into file3, or file1 with extension changed to .huf" << endl;
+	// This method builds a canonical tree from sample, which every EncodeBuffer after it uses
+	// until ClearSharedTree is called (or a file operation builds a tree of its own). Every symbol
+	// gets a code, even ones the sample doesn't have, so any buffer can be encoded with it, and
+	// since the tree never changes we only have to build our code and decode tables once
+	resetState(); // Clear out anything left from before
+	countSymbols(sample, length, frequencyTable); // Count the symbols in the sample
+	buildCanonicalLengths(true); // Figure out the length of each symbol's code, including the ones that never appear
+	buildCanonicalTree(); // Build the tree those lengths describe
+	buildEncodingStrings(nodes[0], ""); // Build our list of encoding strings based on the tree
+	buildCodeTable(); // Turn those strings into numeric codes we can write out quickly
+	buildDecodeTable(); // And build our decode tables too, so buffers using this tree decode right away
+	sharedTreeData.resize(maxCanonicalTreeSize);
+	sharedTreeData.resize(writeCanonicalTree(sharedTreeData.data())); // Keep the compact form around so we can recognize it
+	hasSharedTree = true;
 }
 
-void Huffman::buildFrequencyTable()
+bool Huffman::UseTrainedTree(string treeId)
 {
-	// Helper method to build out our frequency table
-	char character; // Variable to store the next character from the file
-	while (inputStream.get(character)) // inputStream.get(char) returns true if it was able to place the next char from the file into its parameter, so we can just loop on that
+	// This method makes a trained tree from the tree store our shared tree, the same way BuildSharedTree
+	// does, except that EncodeBuffer then writes just the tree's ID instead of the tree itself. The
+	// tree and its decode tables are only loaded from the store the first time we see its ID
+	failed = false;
+	lastError = "";
+	unsigned long long id = 0; // The ID, which is 16 hex digits
+	bool validId = treeId.size() == 16;
+	for (size_t i = 0; validId && i < treeId.size(); i++)
+	{
+		int digit = isdigit((unsigned char)treeId[i]) ? treeId[i] - '0' : (isxdigit((unsigned char)treeId[i]) ? tolower(treeId[i]) - 'a' + 10 : -1);
+		validId = digit >= 0;
+		id = (id << 4) | (unsigned int)max(digit, 0);
+	}
+	if (!validId)
 	{
-		unsigned char realChar = (unsigned char)character; // Once we know we have read a character we want to cast it into an unsigned char so that we don't have array access errors
-		frequencyTable[realChar]++; // Increment the frequencyTable in the appropriate location (an unsigned char will automatically cast into its int ASCII value for array access)
+		reportError(treeId + " is not a tree ID, which is 16 hex digits");
+		return false;
 	}
+	if (hasSharedTree && sharedTreeTrained && sharedTreeId == id) return true; // We are already using it
+	if (!loadTrainedTree(id)) return false;
+	buildEncodingStrings(nodes[0], ""); // Build our list of encoding strings based on the tree
+	buildCodeTable(); // Turn those strings into numeric codes we can write out quickly
+	sharedTreeData = trainedTrees[id].treeData; // Keep the compact form around so we can recognize it
+	hasSharedTree = sharedTreeTrained = true;
+	sharedTreeId = id;
+	return true;
 }
 
-bool Huffman::openFiles(string inputFile, string outputFile, string treeFile)
+void Huffman::ClearSharedTree()
 {
-	// Helper method to open up the given files
-	inputStream.open(inputFile, ios::binary); // We ALWAYS want to open up an inputFile, in binary mode
-	outputStream.open(outputFile, ios::binary); // We ALWAYS want to open up an outputFile, in binary mode
-	if (treeFile.length() > 0) // If our treeFile string has a length greater than 0, we must want it so try to open it
+	// This method gets rid of our shared tree, so each EncodeBuffer builds a tree of its own again
+	if (hasSharedTree)
+		deleteTree();
+	sharedTreeData.clear();
+	sharedTreeTrained = false;
+}
+
+bool Huffman::EncodeBuffer(const unsigned char* data, size_t length, vector<unsigned char>& output)
+{
+	// This method encodes data onto the end of output, in the same canonical format as -ec, so the
+	// result can also be written to a file and decoded with -d. With a shared tree we skip counting
+	// and building a tree, otherwise the buffer gets a tree of its own built from its symbols
+	resetState(); // Clear out anything left from the last operation
+	inputMap.Wrap(data, length); // Read the buffer as if it were our input file
+	memoryOutput = &output; // And send our output onto the end of the caller's buffer
+	output.reserve(output.size() + EncodedBufferBound(length)); // Make sure we don't have to grow it while we write
+	encodeCanonical(); // Encode the buffer
+	closeFiles(); // Let go of the buffer, the caller still owns it
+	return !failed;
+}
+
+bool Huffman::EncodeBufferWithTree(const unsigned char* data, size_t length, const unsigned char* treeData, size_t treeLength, vector<unsigned char>& output)
+{
+	// This method encodes data onto the end of output with the tree in treeData, the contents of a tree file,
+	// giving exactly the bytes -et would write. When we encode buffer after buffer with the same tree file,
+	// only the first one pays for building the tree and its codes
+	resetState(); // Clear out anything left from the last operation
+	inputMap.Wrap(data, length); // Read the buffer as if it were our input file
+	memoryOutput = &output; // And send our output onto the end of the caller's buffer
+	output.reserve(output.size() + treeBuilderSize + encodedSizeBound(length)); // Make sure we don't have to grow it while we write
+	encodeWithTree(treeData, treeLength);
+	closeFiles(); // Let go of the buffer, the caller still owns it
+	return !failed;
+}
+
+bool Huffman::EncodeBuffer(const unsigned char* data, size_t length, unsigned char* output, size_t capacity, size_t& outputLength)
+{
+	// This method encodes data into a buffer the caller gives us. We encode into our scratch buffer
+	// first (which we keep between calls, so it only allocates while it is growing) and then copy it over
+	scratchBuffer.clear();
+	outputLength = 0;
+	if (!EncodeBuffer(data, length, scratchBuffer)) return false;
+	if (scratchBuffer.size() > capacity)
 	{
-		treeStream.open(treeFile, ios::binary); // Open up the treeFile, in binary mode
-		if (treeStream.fail()) // If we fail to open, display an error and return false
-		{
-			cout << "Tree stream failed to open" << endl;
-			return false;
-		}
+		reportError("Output buffer is too small for the encoded data");
+		return false;
 	}
-	if (inputStream.fail()) // If we failed to open the inputFile display an error and return false
+	copy(scratchBuffer.begin(), scratchBuffer.end(), output);
+	outputLength = scratchBuffer.size();
+	return true;
+}
+
+bool Huffman::DecodeBuffer(const unsigned char* data, size_t length, vector<unsigned char>& output)
+{
+	// This method decodes data onto the end of output. It takes anything we can write out, so it
+	// works on EncodeBuffer's output as well as the contents of any of our encoded files
+	resetState(); // Clear out anything left from the last operation
+	inputMap.Wrap(data, length); // Read the buffer as if it were our input file
+	memoryOutput = &output; // And send our output onto the end of the caller's buffer
+	decodeInput(); // Figure out which format the buffer is in and decode it
+	closeFiles(); // Let go of the buffer, the caller still owns it
+	return !failed;
+}
+
+bool Huffman::DecodeBuffer(const unsigned char* data, size_t length, unsigned char* output, size_t capacity, size_t& outputLength)
+{
+	// This method decodes data into a buffer the caller gives us, going through our scratch buffer the same way EncodeBuffer does
+	scratchBuffer.clear();
+	outputLength = 0;
+	if (!DecodeBuffer(data, length, scratchBuffer)) return false;
+	if (scratchBuffer.size() > capacity)
 	{
-		cout << "Input stream failed to open" << endl;
+		reportError("Output buffer is too small for the decoded data");
 		return false;
 	}
-	if (outputStream.fail()) // If we failed to open the outputFile display an error and return false
+	copy(scratchBuffer.begin(), scratchBuffer.end(), output);
+	outputLength = scratchBuffer.size();
+	return true;
+}
+
+bool Huffman::DecodeBufferRange(const unsigned char* data, size_t length, unsigned long long offset, unsigned long long count, vector<unsigned char>& output)
+{
+	// This method decodes count bytes starting at offset of the original data onto the end of output,
+	// the same way DecodeFileRange does for a file
+	resetState(); // Clear out anything left from the last operation
+	inputMap.Wrap(data, length); // Read the buffer as if it were our input file
+	memoryOutput = &output; // And send our output onto the end of the caller's buffer
+	int format = readFormat(); // Check which format the buffer is in
+	if (format == checkpointFormat || format == canonicalFormat)
+		decodeRange(format, offset, count); // Decode just the range we want
+	else if (format == storedFormat)
+		decodeStored(offset, count); // A stored buffer is already in the clear, so just copy the range out
+	else
+		reportError("Ranges can only be decoded from canonical data");
+	closeFiles(); // Let go of the buffer, the caller still owns it
+	return !failed;
+}
+
+string Huffman::TreeKey(const unsigned char* data, size_t length)
+{
+	// This method returns the bytes that pick out the tree encoded data was written with: the tree builder
+	// information at the start of an original file, or the compact tree of a canonical one. Inputs with the
+	// same key decode with the same tree, so whoever keeps Huffman objects around can hand each input to one
+	// that already has that tree and its decode tables built. Every other format gets an empty key
+	if (length >= 3 && data[0] == 'H' && data[1] == 'F')
 	{
-		cout << "Output stream failed to open" << endl;
-		return false;
+		if (data[2] != canonicalFormat || length < 13) return ""; // Only canonical files carry one tree we can reuse
+		size_t size = canonicalTreeSize(data + 11); // The compact tree comes right after the magic bytes and the original length
+		return size != 0 && length >= 11 + size ? string((const char*)data + 11, size) : "";
 	}
-	return true; // If we made it here, everything is open so we can return true
+	return length >= treeBuilderSize ? string((const char*)data, treeBuilderSize) : ""; // An original file starts with its tree builder information
 }
 
-void Huffman::buildTree()
+size_t Huffman::EncodedBufferBound(size_t length)
 {
-	// Helper method to build our tree from the frequency table
-	for (int i = 0; i < numChars; i++)
+	// This method returns the most bytes EncodeBuffer can write for length bytes of data: our header
+	// with the largest compact tree, then every symbol using the longest canonical code, then the
+	// biggest checkpoint index we could write for it
+	return 15 + maxCanonicalTreeSize + (length / 8) * maxCanonicalLength + maxCanonicalLength + 1 + (length / minCheckpointInterval) * 8;
+}
+
+string Huffman::LastError()
+{
+	// This method returns the message for whatever went wrong last, or an empty string if nothing did
+	return lastError;
+}
+
+void Huffman::decodeInput()
+{
+	// Helper method that checks which format our input is in, and decodes it into our output
+	int format = readFormat(); // Check which format our input is in
+	if (format == blockFormat)
 	{
-		// Loop through all of the characters in the frequency table,
-		// building a node for each one with its given frequency
-		node* newNode = new node(); // Create a new node
-		newNode->weight = frequencyTable[i]; // Set the weight of the node equal to its value from the frequency table
-		newNode->symbol = (unsigned char)i; // Make the symbol of the node equal to its int value casted to an unsigned char
-		newNode->left = newNode->right = nullptr; // Make the left and right children nullptr (redundant)
-		nodes[i] = newNode; // Set our current location in the nodes array to be the node we just made
+		// If the file was written by EncodeFileParallel, decode its blocks in parallel
+		decodeBlocks();
 	}
-	for (int i = 0; i < numChars - 1; i++)
+	else if (format == streamFormat)
 	{
-		// Loop through the number of characters we have - 1, this is the amount we always need to build a tree
-		int smallestNodeIndex = getSmallestNodeIndex(-1); // Grab the index of the smallest node in our nodes array, without skipping any indexes
-		int nextSmallestNodeIndex = getSmallestNodeIndex(smallestNodeIndex); // Grab the index of the next smallest node in our nodes array, making sure we skip the smallest index
-		node* smallestNode = nodes[smallestNodeIndex]; // Grab the node that is the smallest
-		node* nextSmallestNode = nodes[nextSmallestNodeIndex]; // Grab the node that is the next smallest
-		node* parent = new node(); // Make a new parent node to hold these nodes
-		parent->weight = smallestNode->weight + nextSmallestNode->weight; // Set the weight of the parent to be the weights of the nodes added together
-		if (smallestNodeIndex < nextSmallestNodeIndex) // If smallestNode occurs earlier in the list, we make it the left child
-		{
-			parent->left = smallestNode; // Make our parents left child smallestNode
-			parent->right = nextSmallestNode; // Make our parents right child nextSmallestNode
-			nodes[nextSmallestNodeIndex] = nullptr; // Set the location in nodes[] where nextSmallestNode used to be equal to nullptr
-			nodes[smallestNodeIndex] = parent; // Set the location in nodes[] where smallestNode used to be equal to the parent
-			outputStream.put((char)smallestNodeIndex); // Output the smallestNodeIndex casted to a char, so others can build the tree as needed
-			outputStream.put((char)nextSmallestNodeIndex); // Output the nextSmallestNodeIndex casted to a char, so others can build the tree as needed
-			bytesOut += 2; // Increase our bytesOut by 2 since we printed 2 to the file
-		}
-		else // If we get here, we know nextSmallestNode occurs earlier in the list, so it should be our left child
-		{
-			parent->left = nextSmallestNode; // Make our parents left child nextSmallestNode
-			parent->right = smallestNode; // Make our parents right child smallestNode
-			nodes[smallestNodeIndex] = nullptr; // Set the location in nodes[] where smallestNode used to be equal to nullptr
-			nodes[nextSmallestNodeIndex] = parent; // Set the location in nodes[] where nextSmallestNode used to be equal to the parent
-			outputStream.put((char)nextSmallestNodeIndex); // Output the nextSmallestNodeIndex casted to a char, so others can build the tree as needed
-			outputStream.put((char)smallestNodeIndex); // Output the SmallestNodeIndex casted to a char, so others can build the tree as needed
-			bytesOut += 2; // Increase our bytesOut by 2 since we printed 2 to the file
-		}
-	}
-}
-
-void Huffman::encode()
-{
-	inputStream.clear(); // Clear out any errors we may have in our inputStream
-	inputStream.seekg(0); // Make sure our input is at the beginning of the file
-	char character; // Character to get the input into 
-	string buffer = ""; // A buffer string that we will fill up with encoding strings
-	while (inputStream.get(character)) // Loop through the input, getting each character into character
-	{
-		bytesIn++; // We read in a byte so increment it
-		unsigned char realChar = character; // Coerce our character into an unsigned char so we don't get array access errors
-		buffer += encodingStrings[realChar]; // Add the encoding string for our current character to the buffer
-		while (buffer.length() >= 8) // While our buffer length is greater than or equal to 8, we need to encode it into our output file
-		{
-			unsigned char byte = 0; // Make a new unsigned char to keep track of our byte
-			for (int i = 0; i <= 7; i++) // Loop 8 times
+		// If the file was written by EncodeStream, decode it one chunk at a time
+		decodeStreamChunks();
+	}
+	else if (format == interleavedFormat)
+	{
+		// If the file was written by EncodeFileInterleaved, decode the streams of each block side by side
+		decodeInterleaved();
+	}
+	else if (format == referenceFormat)
+	{
+		// If the file was written with a trained tree, it only holds the tree's ID, so we find the tree in our store
+		unsigned char header[referenceHeaderSize - 3]; // The tree ID and the length of the original file
+		if (!readInput(header, sizeof(header)))
+		{
+			reportError("Input file is too short to contain a tree ID");
+		}
+		else if (loadTrainedTree(loadLittleEndian64(header)))
+		{
+			unsigned long long originalLength = loadLittleEndian64(header + 8);
+			if (!plausibleLength(originalLength))
+			{
+				reportError("Input file ended before all of its data was decoded"); // Too short to hold that many symbols, so don't go making room for them
+			}
+			else if (originalLength > 0)
+			{
+				// Our decode tables came along with the tree, so go straight to decoding
+				if (reserveOutput(originalLength) && decode(originalLength) != originalLength)
+					reportError("Input file ended before all of its data was decoded");
+			}
+		}
+	}
+	else if (format == storedFormat)
+	{
+		// If the file was stored because it wouldn't compress, just copy it out
+		decodeStored(0, ~0ULL);
+	}
+	else if (format == contextFormat)
+	{
+		// If the file was written with order 1 codes, read in its tables and decode it
+		decodeContext();
+	}
+	else if (format == filteredFormat)
+	{
+		// If the file was run through a filter before it was encoded, decode what is inside and undo the filter on the way out
+		decodeFiltered();
+	}
+	else if (format == wideFormat)
+	{
+		// If the file was written with 16 bit symbols, read in their codes and decode it
+		decodeWide();
+	}
+	else if (format == adaptiveFormat)
+	{
+		// If the file was written with adaptive codes, there is no tree, we just follow along with the encoder
+		decodeAdaptive();
+	}
+	else if (format == checkpointFormat)
+	{
+		// If the file was written with checkpoints, decode the whole thing as one range
+		decodeRange(format, 0, ~0ULL);
+	}
+	else if (format == canonicalFormat)
+	{
+		// If the file was written with canonical codes, read in the original length and the code lengths
+		unsigned char length[8]; // The length of the original file
+		if (readInput(length, 8) && readCanonicalTree() && (loadLittleEndian64(length) == 0 || hasCodes())) // Only an empty file can have a tree without any codes
+		{
+			unsigned long long originalLength = loadLittleEndian64(length);
+			if (!plausibleLength(originalLength))
+			{
+				reportError("Input file ended before all of its data was decoded"); // Too short to hold that many symbols, so don't go making room for them
+			}
+			else if (originalLength > 0)
 			{
-				bool on = buffer[i] == '1'; // Make a boolean variable to determine if the current spot we are on in the buffer is 1 or not
-				byte |= (on << (7 - i)); // Use the bitwise or operator on our byte to set the current location (0-7) to that locations value in the buffer
+				buildDecodeTable(); // Build our decode lookup tables from the tree the lengths describe
+				// Then decode the file, stopping once we've written out the original length
+				if (reserveOutput(originalLength) && decode(originalLength) != originalLength)
+					reportError("Input file ended before all of its data was decoded");
 			}
-			outputStream.put(byte); // Output our byte to the file
-			bytesOut++; // Increment our bytesOut counter
-			buffer = buffer.substr(8); // Set our buffer equal to the substring from position 8 (after the bits we have encoded) to the end
 		}
+		else
+		{
+			reportError("Input file does not contain a valid canonical tree");
+		}
+	}
+	else if (format != originalFormat)
+	{
+		reportError("Input file is in a format we don't know about");
 	}
-	if (buffer.length() < 8 && buffer.length() > 0) // If we still have something left in our buffer after looping through then we need to handle padding
+	else
 	{
-		buffer += paddingBits; // Add our padding bits onto the buffer
-		// Now do the same encoding process as above, but only once
-		unsigned char byte = 0; // Make a new unsigned char to keep track of our byte
-		for (int i = 0; i <= 7; i++) // Loop 8 times
+		unsigned char treeBuilder[treeBuilderSize]; // The tree builder information at the start of our input
+		if (!readInput(treeBuilder, treeBuilderSize)) // Grab it out of the input, if the file is long enough to have it
 		{
-			bool on = buffer[i] == '1'; // Make a boolean variable to determine if the current spot we are on in the buffer is 1 or not
-			byte |= (on << (7 - i)); // Use the bitwise or operator on our byte to set the current location (0-7) to that locations value in the buffer
+			reportError("Input file is too short to contain a tree");
+		}
+		else if (!buildTreeFromBuilder(treeBuilder, false)) // Build a tree from it
+		{
+			reportError("Input file does not start with a valid tree");
+		}
+		else
+		{
+			buildDecodeTable(); // Build our decode lookup tables from that tree
+			decode(); // Decode the file based on the tree we built
 		}
-		outputStream.put(byte); // Output our byte to the file
-		bytesOut++; // Increment our bytesOut counter
 	}
 }
 
-void Huffman::buildTreeFromFile(ifstream& file, bool writeTree)
+void Huffman::EncodeFileWithTree(string inputFile, string treeFile, string outputFile)
 {
-	// This method builds a tree based on the information from a file,
-	// which we can choose by passing in the correct ifstream
-	for (int i = 0; i < numChars; i++)
+	// This method encodes an input file into an output file,
+	// using tree builder information from a third tree file
+	// This implements the -et command line parameter
+	if (inputFile == outputFile)
 	{
-		// Loop through the number of characters we have, creating empty nodes for
-		// each one, in our nodes array
-		node* newNode = new node();
-		newNode->weight = 0; // We don't care about their weight since we know the combination order
-		newNode->symbol = (unsigned char)i; // Make sure our symbol is based on the correct location in the list
-		newNode->left = newNode->right = nullptr; // Make sure their child pointers are null
-		nodes[i] = newNode; // Set the location we are at in nodes[] to be the new node
+		// Our input and output files can't be the same so display an error and exit
+		cout << "Input File can not be equal to Output File" << endl;
+		return;
 	}
-	for (int i = 0; i < numChars - 1; i++)
+	if (outputFile == "")
 	{
-		// Loop through the number of characters we have - 1, since we can always combine
-		// All of our nodes into one tree in this many passes
-		char character1, character2; // Character variables to hold our input info
-		file.get(character1); // Grab the next character and put it in character1
-		file.get(character2); // Grab the next character and put it in character2
-		bytesIn += 2; // Increment our bytesIn counter by 2 since we read in 2 bytes
-		unsigned char char1 = character1; // Coerce character1 into an unsigned char so we don't get array access errors
-		unsigned char char2 = character2; // Coerce character2 into an unsigned char so we don't get array access errors
-		node* parent = new node(); // Create a parent node to hold these 2
-		parent->weight = 0; // Weight is 0, since we don't care about it 
-		parent->symbol = NULL; // Symbol is NULL since we aren't at a leaf
-		parent->left = nodes[char1]; // The left child will always be whatever was our first of the 2 chars read in
-		parent->right = nodes[char2]; // The right child will always be whatever was our second of the 2 chars read in
-		if (writeTree)
-		{
-			outputStream.put(char1);
-			outputStream.put(char2);
-		}
-		bytesOut += 2;
-		nodes[char2] = nullptr; // Set the location where char2 was in the nodes array to null
-		nodes[char1] = parent; // Set the location where char1 was in the nodes array to the new parent node
+		// If our output file is empty, we want to decide it based on our input file
+		outputFile = defaultOutputFile(inputFile, ".huf");
+	}
+	if (!openFiles(inputFile, outputFile, treeFile)) return;  // Open up all three of our files as we need, return and exit if any fail
+	vector<unsigned char> treeData((istreambuf_iterator<char>(treeStream)), istreambuf_iterator<char>()); // Read in the whole tree file, they are never very big
+	bytesIn += treeData.size(); // Increment bytesIn since we read in the whole tree file
+	if (!encodeWithTree(treeData.data(), treeData.size()))
+	{
+		// The tree file isn't a tree, or can't code our input, so our output holds nothing worth keeping.
+		// Close our files and remove it rather than leave it around looking like an encoded file
+		closeFiles();
+		error_code removeError;
+		filesystem::remove(outputFile, removeError);
+		return;
 	}
+	closeFiles(); // Close our files since we are done
+	printActionDetail(); // Print info about what we did
 }
 
-void Huffman::decode()
+bool Huffman::encodeWithTree(const unsigned char* treeData, size_t treeLength)
 {
-	// This function decodes our huffman encoded file
-	char character; // Character variable to be used as a placeholder
-	node* currentNode = nodes[0]; // Our currentNode always starts as nodes[0] since that is the root of our built up tree
-	while (inputStream.get(character))
+	// Helper method that encodes our input with the tree in treeData, which holds either a compact canonical
+	// tree (from -tc) or 510 bytes of tree builder information (from -t). When it is the same tree we used
+	// last time, our tree and codes are already built, so we go straight to encoding
+	if (treeLength >= 3 && treeData[0] == 'H' && treeData[1] == 'F' && treeData[2] == treeFileFormat)
 	{
-		// Loop through all of the characters in the inputStream, placing them into character
-		bytesIn++; // Increment bytesIn for each one, since we read a byte in
-		unsigned char byte = character; // Coerce our character into an unsigned char which is the basis for our byte
-
-		// I chose to simply write out the method 8 times here instead of
-		// pre-calculating powers of 2 and looping through with either running
-		// the method in each step of the loop, or basically inlining the method
-		// in a loop, because it benchmarked faster on MRT.exe over an average
-		// of 4 decodes per method
-		followTree(byte, 128, currentNode); // Use our followTree method to go the correct direction based on the left-most bit (equivalent to 128 in decimal)
-		followTree(byte, 64, currentNode); // Use our followTree method to go the correct direction based on the second to left-most bit (equivalent to 64 in decimal)
-		followTree(byte, 32, currentNode); // Use our followTree method to go the correct direction based on the third to left-most bit (equivalent to 32 in decimal)
-		followTree(byte, 16, currentNode); // Use our followTree method to go the correct direction based on the fourth to left-most bit (equivalent to 16 in decimal)
-		followTree(byte, 8, currentNode); // Use our followTree method to go the correct direction based on the fourth to right-most bit (equivalent to 8 in decimal)
-		followTree(byte, 4, currentNode); // Use our followTree method to go the correct direction based on the third to right-most bit (equivalent to 4 in decimal)
-		followTree(byte, 2, currentNode); // Use our followTree method to go the correct direction based on the second to right-most bit (equivalent to 2 in decimal)
-		followTree(byte, 1, currentNode); // Use our followTree method to go the correct direction based on the right-most bit (equivalent to 1 in decimal)
-		
-		/*
-		for (int i = 0; i < 8; i++)
+		// A canonical tree file from -tc, which holds a code length for each symbol
+		if (treeLength < 5 || treeLength - 3 != canonicalTreeSize(&treeData[3]) || !loadCanonicalTree(&treeData[3]))
 		{
-			followTree(byte, powersOf2[i], currentNode);
+			reportError("Tree file is not a valid canonical tree");
+			return false;
 		}
-		Benchmarked on MRT.exe: avg over 4 runs was 15.90 seconds (about a second and a half slower than just writing the method 8 times)
-		*/
-		/*
-		for (int i = 0; i < 8; i++)
+		for (size_t i = 0; i < inputMap.Size(); i++)
 		{
-			currentNode = byte & powersOf2[i] ? currentNode->right : currentNode->left;
-			if (isLeaf(currentNode))
+			// A canonical tree can leave symbols out, so make sure it has a code for everything in our input first
+			if (codeLengths[inputMap.Data()[i]] == 0)
 			{
-				outputStream.put(currentNode->symbol);
-				bytesOut++;
-				currentNode = nodes[0];
+				reportError("Tree file has no code for symbol " + to_string((int)inputMap.Data()[i]) + " in the input file");
+				return false;
 			}
 		}
-		Benchmarked on MRT.exe: avg over 4 runs was 15.114 seconds (about .75 seconds slower than just writing the method 8 times)
-		*/
+		writeCanonicalHeader(inputMap.Size()); // Write out our header, with the tree from the tree file
+	}
+	else if (treeLength != treeBuilderSize || !buildTreeFromBuilder(treeData, true))
+	{
+		// If the tree file isn't a canonical tree it has to be an original tree file, which is 510 bytes of tree
+		// builder information. We build our tree from it, copying it into our output, and if it isn't one either we fail
+		reportError("Tree file does not contain a tree");
+		return false;
+	}
+	if (!codeTableCurrent)
+	{
+		buildEncodingStrings(nodes[0], ""); // Build our table of encoding strings from that tree
+		buildCodeTable(); // Turn those strings into numeric codes we can write out quickly
 	}
+	encode(); // Encode the input
+	return true;
 }
 
-void Huffman::followTree(unsigned char byte, int checkBit, node*& currentNode)
+void Huffman::EncodeFileCanonical(string inputFile, string outputFile)
 {
-	// Helper method we use to follow our tree from our input to decode the file
+	// This method encodes inputFile into outputFile using canonical codes. Instead of our 510 byte
+	// tree builder information, the header only holds the code length of each symbol that actually
+	// appears, and no code is longer than maxCanonicalLength bits, so small files stay small and
+	// decoding never needs more than one secondary table lookup.
+	// This implements the -ec command line parameter
+	if (inputFile == outputFile)
+	{
+		// Our input and output files can't be the same so display an error and exit
+		cout << "Input File can not be equal to Output File" << endl;
+		return;
+	}
+	if (outputFile == "")
+	{
+		// If our output file is empty, we want to decide it based on our input file
+		outputFile = defaultOutputFile(inputFile, ".huf");
+	}
+	if (!openFiles(inputFile, outputFile, "")) return; // Open up our files, we don't need a tree stream for this, return and exit if any fail
+	ClearSharedTree(); // A file always gets a tree of its own
+	encodeCanonical(); // Build our tree and encode the file
+	closeFiles(); // Close our files since we are done
+	printActionDetail(); // Print info about what we did
+}
 
-	// Adjust the currentNode, first use a bitwise AND on byte and the bit we want to check
-	// If it is true, that means we had a '1' in that spot of the byte, so go right
-	// otherwise, we must have had a '0' in that spot of the byte, so go left
-	currentNode = byte & checkBit ? currentNode->right : currentNode->left;
-	if (isLeaf(currentNode))
+void Huffman::MakeCanonicalTreeBuilder(string inputFile, string outputFile)
+{
+	// This method makes a canonical tree file from inputFile, holding a code length for every
+	// symbol, which can then be used with -et. Unlike -ec we give every symbol a code (treating
+	// symbols that never appear as if they appeared once) so the tree can encode any other file.
+	// This implements the -tc command line parameter
+	if (inputFile == outputFile)
+	{
+		// The input can't also be the output, so we display an error and exit
+		cout << "Input File can not be equal to Output File" << endl;
+		return;
+	}
+	if (outputFile == "")
 	{
-		// If we've reached a leaf, then we want to output the symbol in our leaf to the file
-		outputStream.put(currentNode->symbol);
-		bytesOut++; // We output a byte to the file, so increment the counter
-		currentNode = nodes[0]; // Reset our currentNode to be the top of the tree so we can continue on as normal
+		// If we don't have an output file, we want to figure it out based on our input
+		outputFile = defaultOutputFile(inputFile, ".htree");
 	}
+	if (!openFiles(inputFile, outputFile, "")) return; // Open up our input and output streams, we don't need a tree stream for this, return and exit if any fail
+	buildFrequencyTable(); // Build out a frequency table from our input file
+	buildCanonicalLengths(true); // Figure out the length of each symbol's code, including the ones that never appear
+	unsigned char magic[3] = { 'H', 'F', treeFileFormat }; // The magic bytes that mark this as a canonical tree file
+	writeOutput(magic, 3);
+	unsigned char canonicalTreeData[maxCanonicalTreeSize]; // The code lengths in their compact form
+	writeOutput(canonicalTreeData, writeCanonicalTree(canonicalTreeData)); // Write them out
+	closeFiles(); // Close out the files since that's all we want to do!
+	printActionDetail(); // Print out information about what we did!
 }
 
-void Huffman::closeFiles()
+void Huffman::GenerateCodec(string treeFile, string codecName, string outputFile)
 {
-	// Helper method to close out any files we have open
-	if (inputStream.is_open()) 
-		inputStream.close(); // If the inputStream is open, close it
-	if (outputStream.is_open())
-		outputStream.close(); // If the outputStream is open, close it
-	if (treeStream.is_open())
-		treeStream.close(); // If the treeSteam is open, close it
+	// This method turns a tree file from -t or -tc into a header for StaticCodec.h, so a program that
+	// always encodes with the same tree gets its tables built at compile time. The header holds the
+	// bytes every file written with the tree starts with and the tree itself, as a list of nodes with
+	// the root first, which is all StaticCodec needs to work out the codes and decode tables.
+	// This implements the -gen command line parameter
+	bool validName = !codecName.empty() && !isdigit((unsigned char)codecName[0]); // The name has to work as a C++ identifier
+	for (char c : codecName)
+		validName = validName && (isalnum((unsigned char)c) || c == '_');
+	if (!validName)
+	{
+		// If it doesn't, display an error and exit
+		cout << "Codec name must be a C++ identifier: " << codecName << endl;
+		return;
+	}
+	if (treeFile == outputFile)
+	{
+		// The tree file can't also be the output, so we display an error and exit
+		cout << "Input File can not be equal to Output File" << endl;
+		return;
+	}
+	if (outputFile == "")
+	{
+		// If we don't have an output file, we want to figure it out based on our tree file
+		outputFile = defaultOutputFile(treeFile, ".h");
+	}
+	if (!openFiles(treeFile, outputFile, "")) return; // Open up the tree file as our input, return and exit if either fails
+	const unsigned char* treeData = inputMap.Data();
+	size_t treeLength = inputMap.Size();
+	bool canonical = treeLength >= 3 && treeData[0] == 'H' && treeData[1] == 'F' && treeData[2] == treeFileFormat; // Whether this is a canonical tree file from -tc
+	if (canonical ? treeLength < 5 || treeLength - 3 != canonicalTreeSize(&treeData[3]) || !loadCanonicalTree(&treeData[3]) || !hasCodes()
+		: treeLength != treeBuilderSize || !buildTreeFromBuilder(treeData, false))
+	{
+		// Either way, we build the tree just like -et would, and if it isn't a tree we fail
+		reportError(canonical ? "Tree file is not a valid canonical tree" : "Tree file does not contain a tree");
+		return;
+	}
+	bytesIn += treeLength; // We read in the whole tree file
+
+	// Number every parent node in the order we reach them going down the tree a level at a time, so the root is node 0.
+	// In the header a child below 256 is a leaf for that symbol and anything else is 256 plus the number of a parent
+	vector<unsigned short> parents = { nodes[0] }; // The parents in the order we numbered them
+	vector<unsigned short> numbers(nodeCount, 0); // The number we gave each parent in tree[]
+	for (size_t i = 0; i < parents.size(); i++)
+	{
+		for (unsigned short child : { tree[parents[i]].left, tree[parents[i]].right })
+		{
+			if (child == noNode || isLeaf(child)) continue;
+			numbers[child] = (unsigned short)parents.size();
+			parents.push_back(child);
+		}
+	}
+	auto childValue = [this, &numbers](unsigned short child)
+	{
+		// The value we write out for a child: 0xFFFF for none, the symbol for a leaf, or 256 plus its number for a parent
+		if (child == noNode) return 0xFFFF;
+		return isLeaf(child) ? (int)tree[child].symbol : 256 + numbers[child];
+	};
+
+	const unsigned char* prefix = canonical ? treeData + 3 : treeData; // The bytes every file with this tree starts with, after any magic bytes and length
+	size_t prefixLength = canonical ? treeLength - 3 : treeLength;
+	ostringstream header; // The header we write out
+	header << "/*" << endl;
+	header << "\tGenerated by HUFF -gen from " << filesystem::path(treeFile).filename().string() << ", run it again rather than editing this" << endl;
+	header << "\tif the tree changes. " << codecName << "::Encode writes exactly what HUFF -et writes with" << endl;
+	header << "\tthat tree file, and " << codecName << "::Decode reads those files back." << endl;
+	header << "*/" << endl << endl;
+	header << "#pragma once" << endl;
+	header << "#include \"StaticCodec.h\"" << endl << endl;
+	header << "struct " << codecName << "Tree" << endl << "{" << endl;
+	header << "\tconstexpr static bool canonical = " << (canonical ? "true" : "false") << "; // Whether this is a canonical tree from -tc, rather than an original one from -t" << endl;
+	header << "\tconstexpr static unsigned char tree[" << prefixLength << "] = { // The " << (canonical ? "compact canonical tree" : "tree builder information") << " at the start of every file" << endl;
+	for (size_t i = 0; i < prefixLength; i++)
+		header << (i % 16 == 0 ? "\t\t" : " ") << (int)prefix[i] << (i + 1 < prefixLength ? "," : "") << (i % 16 == 15 || i + 1 == prefixLength ? "\n" : "");
+	header << "\t};" << endl;
+	header << "\tconstexpr static unsigned short children[" << parents.size() << "][2] = { // The left and right child of every parent, the root first" << endl;
+	for (size_t i = 0; i < parents.size(); i++)
+	{
+		header << (i % 8 == 0 ? "\t\t" : " ") << "{ " << childValue(tree[parents[i]].left) << ", " << childValue(tree[parents[i]].right) << " }"
+			<< (i + 1 < parents.size() ? "," : "") << (i % 8 == 7 || i + 1 == parents.size() ? "\n" : "");
+	}
+	header << "\t};" << endl;
+	header << "};" << endl << endl;
+	header << "using " << codecName << " = StaticCodec<" << codecName << "Tree>;" << endl;
+	string text = header.str();
+	writeOutput((const unsigned char*)text.data(), text.size()); // Write out our header
+	closeFiles(); // Close out the files since that's all we want to do!
+	printActionDetail(); // Print out information about what we did!
 }
 
-void Huffman::printActionDetail()
+void Huffman::EncodeFileParallel(string inputFile, string outputFile)
 {
-	// Helper method to print out information for what work we did
-	clock_t end = clock(); // Grab the current time
-	double secondsElapsed = difftime(end, start) / 1000; // Determine the amount of seconds elapsed from when we started our work on the file
-	cout << "Time: " << secondsElapsed << " seconds.   "; // Output the elapsed time followed by a few spaces
-	cout << "Bytes in / Bytes Out: " << formatNumber(bytesIn) << " / " << formatNumber(bytesOut) << endl; // Output our nicely formatted bytesIn and bytesOut numbers using a helper method below
+	// This method encodes inputFile into outputFile as a block container: the input is split
+	// into blocks of blockSize bytes that are each encoded on their own, so we can spread them
+	// across all of our cores both here and when decoding. Every block shares one tree, built
+	// from the combined frequencies of all of the blocks.
+	// This implements the -ep command line parameter
+	if (inputFile == outputFile)
+	{
+		// Our input and output files can't be the same so display an error and exit
+		cout << "Input File can not be equal to Output File" << endl;
+		return;
+	}
+	if (outputFile == "")
+	{
+		// If our output file is empty, we want to decide it based on our input file
+		outputFile = defaultOutputFile(inputFile, ".huf");
+	}
+	if (!openFiles(inputFile, outputFile, "")) return; // Open up our files, we don't need a tree stream for this, return and exit if any fail
+	ThreadPool pool; // Our pool of worker threads, one per core
+	const unsigned char* input = inputMap.Data(); // Our whole input, straight out of the mapping
+	unsigned long long inputSize = inputMap.Size(); // The size of our input
+	unsigned int blockCount = (unsigned int)((inputSize + blockSize - 1) / blockSize); // The number of blocks we need, the last one may be partial
+	size_t batchBlocks = (size_t)pool.Size() * 4; // We encode a few blocks per thread at a time, so our memory use doesn't depend on the size of the file
+	auto blockLength = [&](size_t block) { return (size_t)min((unsigned long long)blockSize, inputSize - (unsigned long long)block * blockSize); }; // The length of a block, only the last one can be short
+
+	// First pass, count the symbols in the whole input, split across the threads in our pool
+	enterPhase(phaseHistogram);
+	countSymbolsParallel(input, (size_t)inputSize, frequencyTable, pool);
+
+	// Now write out our header: the magic bytes and format, the block size, the size of the input and the number of blocks
+	unsigned char header[blockHeaderSize];
+	header[0] = 'H'; // The magic bytes that mark this as one of our newer formats
+	header[1] = 'F';
+	header[2] = blockFormat; // Followed by which format it is
+	storeLittleEndian32(header + 3, blockSize);
+	storeLittleEndian64(header + 7, inputSize);
+	storeLittleEndian32(header + 15, blockCount);
+	writeOutput(header, blockHeaderSize);
+	unsigned char treeBuilder[treeBuilderSize]; // The tree builder information for our tree
+	buildTree(treeBuilder); // Build the tree from our combined frequencies
+	writeOutput(treeBuilder, treeBuilderSize); // And write out its tree builder information after our header
+	buildEncodingStrings(nodes[0], ""); // Build our list of encoding strings based on the tree
+	buildCodeTable(); // Turn those strings into numeric codes we can write out quickly
+	unsigned long long indexPosition = bytesOut; // Remember where our block index goes, everything we've written so far comes before it
+	vector<unsigned char> blockIndex((size_t)blockCount * 8); // The block index holds where each block ends, relative to the end of the index
+	writeOutput(blockIndex.data(), blockIndex.size()); // Write out a placeholder for now, we fill it in once we know the sizes
+
+	// Second pass, encode each batch of blocks in parallel and write them out in order
+	enterPhase(phaseCode);
+	vector<vector<unsigned char>> blockOutputs(batchBlocks); // The encoded output of each block in the batch, reused between batches
+	vector<size_t> blockOutputSizes(batchBlocks); // How many bytes of each block's output are valid
+	vector<char> blockStored(batchBlocks); // Whether each block is kept as it is, since coding didn't make it any smaller
+	unsigned long long blockEnd = 0; // Where the last block we wrote ends
+	for (unsigned int firstBlock = 0; firstBlock < blockCount; firstBlock += (unsigned int)batchBlocks)
+	{
+		size_t blocksInBatch = min(batchBlocks, (size_t)(blockCount - firstBlock)); // The number of blocks in this batch
+		pool.ParallelFor(blocksInBatch, [&](size_t block)
+		{
+			size_t blockNumber = firstBlock + block; // The number of this block in the file
+			blockOutputSizes[block] = encodeBlock(input + blockNumber * blockSize, blockLength(blockNumber), blockOutputs[block]); // Encode it on its own
+			blockStored[block] = blockOutputSizes[block] >= blockLength(blockNumber); // Keep it as it is if coding didn't help
+		});
+		for (size_t block = 0; block < blocksInBatch; block++)
+		{
+			// Write out each block in order, and record where it ends in our index, flagging the ones we stored
+			size_t blockNumber = firstBlock + block; // The number of this block in the file
+			if (blockStored[block])
+			{
+				writeOutput(input + blockNumber * blockSize, blockLength(blockNumber));
+				blockEnd += blockLength(blockNumber);
+			}
+			else
+			{
+				writeOutput(blockOutputs[block].data(), blockOutputSizes[block]);
+				blockEnd += blockOutputSizes[block];
+			}
+			storeLittleEndian64(&blockIndex[blockNumber * 8], blockEnd | (blockStored[block] ? storedBlockFlag : 0));
+		}
+		inputPrefetch.Advance((size_t)(firstBlock + blocksInBatch) * blockSize); // Let the prefetch thread move ahead of this batch
+	}
+	bytesIn += inputSize; // We read in the whole input
+	enterPhase(phaseWrite);
+	if (asyncOutput.IsRunning() && !asyncOutput.Finish())
+		reportError("Failed writing to the output file"); // The writer thread has to be done with everything before we can go back and fill in the index
+	outputStream.seekp((streamoff)indexPosition); // Go back to our placeholder
+	outputStream.write((char*)blockIndex.data(), blockIndex.size()); // And fill in the real block index
+	closeFiles(); // Close our files since we are done
+	printActionDetail(); // Print info about what we did
+}
+
+void Huffman::EncodeFileInterleaved(string inputFile, string outputFile, int streamCount)
+{
+	// This method encodes inputFile into outputFile with each block split into streamCount pieces,
+	// each encoded as its own bitstream with the same canonical tree. Decoding a single bitstream is
+	// one long chain where every lookup has to wait for the one before it to know where the next code
+	// starts, but separate bitstreams don't depend on each other at all, so the decoder can step through
+	// all of them together and keep several lookups going at once on a single core.
+	// This implements the -ei (4 streams) and -ei8 (8 streams) command line parameters
+	if (inputFile == outputFile)
+	{
+		// Our input and output files can't be the same so display an error and exit
+		cout << "Input File can not be equal to Output File" << endl;
+		return;
+	}
+	if (outputFile == "")
+	{
+		// If our output file is empty, we want to decide it based on our input file
+		outputFile = defaultOutputFile(inputFile, ".huf");
+	}
+	if (!openFiles(inputFile, outputFile, "")) return; // Open up our files, we don't need a tree stream for this, return and exit if any fail
+	ClearSharedTree(); // A file always gets a tree of its own
+	buildFrequencyTable(); // Build the frequency table from our input file
+	buildCanonicalLengths(sampledBytes > 0); // Figure out the length of each symbol's code, which keeps every code short enough for one or two lookups, giving every symbol one if we only sampled the input
+	buildCanonicalTree(); // Build the tree those lengths describe
+	buildEncodingStrings(nodes[0], ""); // Build our list of encoding strings based on the tree
+	buildCodeTable(); // Turn those strings into numeric codes we can write out quickly
+
+	// Write out our header: the magic bytes and format, the block size, the size of the input,
+	// the number of streams in each block, then the compact tree every block shares
+	const unsigned char* input = inputMap.Data(); // Our whole input, straight out of the mapping
+	unsigned long long inputSize = inputMap.Size(); // The size of our input
+	unsigned char header[interleavedHeaderSize + maxCanonicalTreeSize];
+	header[0] = 'H';
+	header[1] = 'F';
+	header[2] = interleavedFormat;
+	storeLittleEndian32(header + 3, blockSize);
+	storeLittleEndian64(header + 7, inputSize);
+	header[15] = (unsigned char)streamCount;
+	writeOutput(header, interleavedHeaderSize + writeCanonicalTree(header + interleavedHeaderSize));
+
+	// Each block is split into streamCount pieces of (nearly) the same size, and each block
+	// is written out as the encoded length of every stream followed by the streams themselves
+	vector<unsigned char> streams[maxStreams]; // The encoded streams of the block we are on, reused between blocks
+	enterPhase(phaseCode);
+	for (unsigned long long blockStart = 0; blockStart < inputSize; blockStart += blockSize)
+	{
+		size_t length = (size_t)min((unsigned long long)blockSize, inputSize - blockStart); // The length of this block
+		size_t pieceLength = (length + streamCount - 1) / streamCount; // The number of symbols in each stream, the last may have fewer
+		unsigned char streamLengths[4 * maxStreams]; // The encoded length of each stream
+		size_t encodedLengths[maxStreams];
+		size_t totalLength = 0; // The encoded length of all of the streams together
+		for (int stream = 0; stream < streamCount; stream++)
+		{
+			size_t start = min(stream * pieceLength, length); // Where this stream's piece starts in the block
+			size_t end = min(start + pieceLength, length); // And where it ends
+			encodedLengths[stream] = encodeBlock(input + blockStart + start, end - start, streams[stream]); // Encode it on its own
+			storeLittleEndian32(streamLengths + 4 * stream, (unsigned int)encodedLengths[stream]);
+			totalLength += encodedLengths[stream];
+		}
+		if (totalLength >= length)
+		{
+			// Coding didn't make this block any smaller, so mark it as stored and write it out as it is
+			storeLittleEndian32(streamLengths, storedStreams);
+			writeOutput(streamLengths, 4 * streamCount);
+			writeOutput(input + blockStart, length);
+			continue;
+		}
+		writeOutput(streamLengths, 4 * streamCount); // Write out the lengths
+		for (int stream = 0; stream < streamCount; stream++)
+			writeOutput(streams[stream].data(), encodedLengths[stream]); // Then every stream in order
+	}
+	bytesIn += inputSize; // We read in the whole input
+	closeFiles(); // Close our files since we are done
+	printActionDetail(); // Print info about what we did
+}
+
+void Huffman::TrainTree(const vector<string>& corpusFiles)
+{
+	// This method builds a tree from the combined symbols of every file in corpusFiles and saves it
+	// in our tree store as a canonical tree file named by its ID. Files encoded with the tree only
+	// hold that ID, so many small, similar files don't each pay for a tree or their own count.
+	// Every symbol gets a code, even ones the corpus doesn't have, so the tree can encode anything.
+	// This implements the -tr command line parameter
+	resetState(); // Clear out anything left over from the last thing we did
+	for (const string& file : corpusFiles)
+	{
+		MappedFile sample; // Map in each file of the corpus and add its symbols onto our counts
+		if (!sample.Open(file))
+		{
+			cout << "Unable to open corpus file: " << file << endl;
+			return;
+		}
+		enterPhase(phaseHistogram);
+		countSymbols(sample.Data(), sample.Size(), frequencyTable);
+		bytesIn += sample.Size();
+	}
+	buildCanonicalLengths(true); // Figure out the length of each symbol's code, including the ones that never appear
+	unsigned char treeData[3 + maxCanonicalTreeSize] = { 'H', 'F', treeFileFormat }; // The magic bytes that mark this as a canonical tree file, then the tree
+	size_t treeSize = writeCanonicalTree(treeData + 3);
+	string id = formatTreeId(treeDataId(treeData + 3, treeSize)); // Trees are named by a hash of their contents, so the same tree always gets the same ID
+	error_code error;
+	filesystem::create_directories(treeStore, error); // Make our tree store if this is the first tree in it
+	string treeFile = (filesystem::path(treeStore) / (id + ".htree")).string();
+	outputStream.open(treeFile, ios::binary);
+	if (outputStream.fail())
+	{
+		cout << "Unable to write tree file: " << treeFile << endl;
+		return;
+	}
+	writeOutput(treeData, 3 + treeSize); // The file is the same as one from -tc, so it can be used with -et too
+	closeFiles();
+	cout << "Tree ID: " << id << endl; // Let the user know what to call it
+	printActionDetail(); // Print info about what we did
+}
+
+void Huffman::EncodeFileWithTrainedTree(string inputFile, string treeId, string outputFile)
+{
+	// This method encodes inputFile into outputFile with a trained tree from our tree store. Instead of
+	// a tree, the header holds the tree's ID, and we don't need to count the input at all.
+	// This implements the -er command line parameter
+	if (inputFile == outputFile)
+	{
+		// Our input and output files can't be the same so display an error and exit
+		cout << "Input File can not be equal to Output File" << endl;
+		return;
+	}
+	if (outputFile == "")
+	{
+		// If our output file is empty, we want to decide it based on our input file
+		outputFile = defaultOutputFile(inputFile, ".huf");
+	}
+	if (!openFiles(inputFile, outputFile, "")) return; // Open up our files, we don't need a tree stream for this, return and exit if any fail
+	if (!UseTrainedTree(treeId)) return; // Load the tree, UseTrainedTree already explained what went wrong if we can't
+	encodeCanonical(); // Encode the file, which writes the tree's ID since it is a trained tree
+	closeFiles(); // Close our files since we are done
+	printActionDetail(); // Print info about what we did
+}
+
+void Huffman::SetTreeStore(string directory)
+{
+	// This method sets the directory we keep trained trees in
+	treeStore = directory;
+}
+
+void Huffman::SetOverlappedIO(bool enabled)
+{
+	// Turns our prefetch and writer threads on or off for the operations that follow. They only
+	// start for inputs of at least overlapThreshold bytes either way
+	overlappedIO = enabled;
+}
+
+void Huffman::SetSampledHistogram(bool enabled)
+{
+	// Turns sampling on or off for the encodes that follow. Only inputs of at least sampleThreshold
+	// bytes are sampled, and only by the encodes that build one tree for the whole file
+	sampledHistogram = enabled;
+}
+
+void Huffman::SetOutputLimit(unsigned long long limit)
+{
+	// Sets the most bytes any one of our operations may write. Going over it fails the operation the same way
+	// corrupt input does, which is what a server decoding other people's data needs so a small request can't
+	// make it hold gigabytes
+	outputLimit = limit;
+}
+
+void Huffman::SetCheckpointInterval(unsigned int interval)
+{
+	// This method sets how often the canonical files and buffers we write record a checkpoint.
+	// Each one costs 8 bytes, so we don't let them get closer together than minCheckpointInterval
+	checkpointInterval = interval == 0 ? 0 : max(interval, minCheckpointInterval);
+}
+
+void Huffman::EncodeStream()
+{
+	// This method encodes standard input onto standard output so we can run inside of a pipeline.
+	// We can't seek back to the start of a pipe, so instead of reading the input twice we read it
+	// in chunks of up to streamChunkSize bytes and encode each chunk with its own tree. Each chunk
+	// is written out (and flushed) as soon as it's encoded, and memory use stays bounded no matter
+	// how long the stream is. Each chunk has a header with its original length, its encoded length
+	// and the type of tree that follows, and a header with a length of 0 marks the end of the stream.
+	// We write canonical trees, so a chunk only pays for the code lengths of the symbols it uses.
+	// This implements the -es command line parameter
+	useStandardStreams(); // Read from standard input and write to standard output
+	unsigned char magic[3] = { 'H', 'F', streamFormat }; // The magic bytes and format at the start of every stream
+	writeOutput(magic, 3);
+	vector<unsigned char> chunk(streamChunkSize); // Buffer for the chunk we are encoding
+	vector<unsigned char> encoded; // Buffer for the encoded chunk, grows as needed
+	while (cin)
+	{
+		enterPhase(phaseRead);
+		cin.read((char*)chunk.data(), streamChunkSize); // Read in the next chunk, this waits until the chunk is full or the stream ends
+		size_t length = (size_t)cin.gcount(); // Figure out how much we actually got
+		if (length == 0) break; // If there was nothing left we are done
+		bytesIn += length; // Increment bytesIn by the amount we read in
+		fill(frequencyTable, frequencyTable + numChars, 0); // Every chunk gets its own frequencies
+		enterPhase(phaseHistogram);
+		countSymbols(chunk.data(), length, frequencyTable); // Count every symbol in the chunk
+		buildCanonicalLengths(false); // Figure out the code lengths for this chunk, leaving out symbols it doesn't use
+		buildCanonicalTree(); // Build the tree those lengths describe
+		buildEncodingStrings(nodes[0], ""); // Build our list of encoding strings based on the tree
+		buildCodeTable(); // Turn those strings into numeric codes we can write out quickly
+		enterPhase(phaseCode);
+		size_t encodedLength = encodeBlock(chunk.data(), length, encoded); // Encode the chunk
+		unsigned char header[streamChunkHeaderSize]; // This chunk's header
+		unsigned char canonicalTreeData[maxCanonicalTreeSize]; // The chunk's code lengths in their compact form
+		size_t canonicalTreeLength = writeCanonicalTree(canonicalTreeData);
+		bool stored = canonicalTreeLength + encodedLength >= length; // If coding didn't make the chunk any smaller, we keep it as it is
+		storeLittleEndian32(header, (unsigned int)length);
+		storeLittleEndian32(header + 4, (unsigned int)(stored ? length : encodedLength));
+		header[8] = stored ? storedChunk : canonicalTree;
+		writeOutput(header, streamChunkHeaderSize); // Write out the header
+		if (stored)
+			writeOutput(chunk.data(), length); // Then the chunk as it is
+		else
+		{
+			writeOutput(canonicalTreeData, canonicalTreeLength); // Or the compact tree
+			writeOutput(encoded.data(), encodedLength); // And the encoded chunk
+		}
+		outputTarget->flush(); // And push it down the pipeline right away instead of waiting for more
+	}
+	unsigned char endMarker[streamChunkHeaderSize] = { 0 }; // A header with a length of 0 marks the end of the stream
+	writeOutput(endMarker, streamChunkHeaderSize);
+	outputTarget->flush();
+	printActionDetail(); // Print info about what we did, which goes to standard error since standard output has our data
+}
+
+void Huffman::DecodeStream()
+{
+	// This method decodes a stream written by EncodeStream from standard input onto standard output.
+	// Each chunk is decoded and written out as soon as we have read it in.
+	// This implements the -ds command line parameter
+	useStandardStreams(); // Read from standard input and write to standard output
+	unsigned char magic[3]; // The magic bytes and format at the start of the stream
+	if (!readStreamBytes(magic, 3) || magic[0] != 'H' || magic[1] != 'F' || (magic[2] != streamFormat && magic[2] != adaptiveFormat))
+	{
+		reportError("Input is not a Huffman stream");
+		return;
+	}
+	if (magic[2] == adaptiveFormat)
+		decodeAdaptive(); // Decode all of the adaptive frames
+	else
+		decodeStreamChunks(); // Decode all of the chunks
+	outputTarget->flush();
+	printActionDetail(); // Print info about what we did, which goes to standard error since standard output has our data
+}
+
+void Huffman::EncodeFileContext(string inputFile, string outputFile)
+{
+	// This method encodes inputFile into outputFile with order 1 codes: instead of one code table, every
+	// symbol is coded with a table picked by the symbol before it. In text and logs the byte before says a
+	// lot about the next one (a 'q' is nearly always followed by a 'u'), which one table can't take advantage of.
+	// Previous bytes that are followed by similar symbols share a table, so the header stays small.
+	// If one table would do as well we write a canonical file instead.
+	// This implements the -e1 command line parameter
+	if (inputFile == outputFile)
+	{
+		// Our input and output files can't be the same so display an error and exit
+		cout << "Input File can not be equal to Output File" << endl;
+		return;
+	}
+	if (outputFile == "")
+	{
+		// If our output file is empty, we want to decide it based on our input file
+		outputFile = defaultOutputFile(inputFile, ".huf");
+	}
+	if (!openFiles(inputFile, outputFile, "")) return; // Open up our files, we don't need a tree stream for this, return and exit if any fail
+	vector<unsigned char> header; // Our header and tables
+	if (buildContextModel(header))
+	{
+		writeOutput(header.data(), header.size()); // Write out our header and tables
+		encodeContext(); // Then the encoded input
+	}
+	else
+	{
+		fill(frequencyTable, frequencyTable + numChars, 0); // Order 0 codes are just as good, so count the input again from scratch
+		ClearSharedTree(); // A file always gets a tree of its own
+		encodeCanonical(); // And write a canonical (or stored) file
+	}
+	closeFiles(); // Close our files since we are done
+	printActionDetail(); // Print info about what we did
+}
+
+void Huffman::EncodeFileWide(string inputFile, string outputFile)
+{
+	// This method encodes inputFile into outputFile with 16 bit symbols: every little-endian pair of bytes is
+	// coded as one symbol. Readings from a sensor or UTF-16 text repeat whole values, which byte codes only
+	// see as two unrelated halves. Only the symbols that appear go in the header, so a file using a few
+	// thousand of the 65536 possible values has a header of a few KB. If byte codes would do as well we
+	// write a canonical file instead.
+	// This implements the -e16 command line parameter
+	if (inputFile == outputFile)
+	{
+		// Our input and output files can't be the same so display an error and exit
+		cout << "Input File can not be equal to Output File" << endl;
+		return;
+	}
+	if (outputFile == "")
+	{
+		// If our output file is empty, we want to decide it based on our input file
+		outputFile = defaultOutputFile(inputFile, ".huf");
+	}
+	if (!openFiles(inputFile, outputFile, "")) return; // Open up our files, we don't need a tree stream for this, return and exit if any fail
+	vector<unsigned char> header; // Our header and tree
+	if (buildWideModel(header))
+	{
+		writeOutput(header.data(), header.size()); // Write out our header and tree
+		encodeWide(); // Then the encoded input
+	}
+	else
+	{
+		fill(frequencyTable, frequencyTable + numChars, 0); // Byte codes are just as good, so count the input again from scratch
+		ClearSharedTree(); // A file always gets a tree of its own
+		encodeCanonical(); // And write a canonical (or stored) file
+	}
+	closeFiles(); // Close our files since we are done
+	printActionDetail(); // Print info about what we did
+}
+
+void Huffman::EncodeFileFiltered(string inputFile, string outputFile, string filterName)
+{
+	// This method runs inputFile through a reversible filter and encodes the result into outputFile with
+	// canonical codes. The filter and its parameter go in our header, so the decoder can undo it. Filters
+	// turn data whose bytes are tied to their neighbors into bytes that are just skewed, which is all a
+	// Huffman code can take advantage of. With "auto" we try each filter on the start of the input, and if
+	// none of them help we write an ordinary canonical file
+	// This implements the -ef command line parameter
+	int filterType, filterParameter; // The filter we are running, and its stride for a delta filter
+	if (!parseFilter(filterName, filterType, filterParameter))
+	{
+		// We don't know this filter so display an error and exit
+		cout << "Unknown filter " << filterName << ", use none, delta, delta:stride (1 to " << maxDeltaStride << "), bcj or auto" << endl;
+		return;
+	}
+	if (inputFile == outputFile)
+	{
+		// Our input and output files can't be the same so display an error and exit
+		cout << "Input File can not be equal to Output File" << endl;
+		return;
+	}
+	if (outputFile == "")
+	{
+		// If our output file is empty, we want to decide it based on our input file
+		outputFile = defaultOutputFile(inputFile, ".huf");
+	}
+	if (!openFiles(inputFile, outputFile, "")) return; // Open up our files, we don't need a tree stream for this, return and exit if any fail
+	if (filterType == filterAuto)
+		chooseFilter(inputMap.Data(), inputMap.Size(), filterType, filterParameter); // Try them all on the start of our input
+	if (filterType != filterNone)
+	{
+		// Filter the whole input into memory, and encode that in place of the file
+		enterPhase(phaseFilter);
+		filteredInput.resize(inputMap.Size());
+		applyFilter(filterType, filterParameter, inputMap.Data(), filteredInput.data(), filteredInput.size());
+		inputPrefetch.Stop(); // We are done reading the file itself
+		inputMap.Wrap(filteredInput.data(), filteredInput.size());
+		unsigned char header[5] = { 'H', 'F', filteredFormat, (unsigned char)filterType, (unsigned char)filterParameter }; // Our header, then the canonical file of the filtered input
+		writeOutput(header, sizeof(header));
+	}
+	encodeCanonical(); // Encode our (maybe filtered) input
+	closeFiles(); // Close our files since we are done
+	filteredInput = vector<unsigned char>(); // And let go of the filtered copy, which is as big as the file
+	printActionDetail(); // Print info about what we did
+}
+
+void Huffman::EncodeFileAdaptive(string inputFile, string outputFile)
+{
+	// This method encodes inputFile into outputFile in a single pass, with no tree stored anywhere.
+	// The encoder and decoder both start out with every symbol equally likely, and update their codes
+	// the same way from the symbols they have already seen, so they always agree on the codes without
+	// ever writing them out. The input is written out in frames of up to inputChunkSize bytes
+	// This implements the -eo command line parameter
+	if (inputFile == outputFile)
+	{
+		// Our input and output files can't be the same so display an error and exit
+		cout << "Input File can not be equal to Output File" << endl;
+		return;
+	}
+	if (outputFile == "")
+	{
+		// If our output file is empty, we want to decide it based on our input file
+		outputFile = defaultOutputFile(inputFile, ".huf");
+	}
+	if (!openFiles(inputFile, outputFile, "")) return; // Open up our files, we don't need a tree stream for this, return and exit if any fail
+	unsigned char magic[3] = { 'H', 'F', adaptiveFormat }; // The magic bytes and format, which is our whole header
+	writeOutput(magic, 3);
+	resetAdaptiveModel(); // Start out with every symbol equally likely
+	const unsigned char* input = inputMap.Data(); // Our input, straight out of the mapping
+	size_t length = inputMap.Size(); // And its length
+	vector<unsigned char> encoded; // Buffer for each encoded frame, reused between frames
+	for (size_t i = 0; i < length; i += inputChunkSize)
+	{
+		writeAdaptiveFrame(input + i, min((size_t)inputChunkSize, length - i), encoded); // Encode and write out each frame
+		inputPrefetch.Advance(i + inputChunkSize); // Let the prefetch thread know how far we've gotten
+	}
+	bytesIn += length; // We read in the whole input
+	unsigned char endMarker = 0; // A frame with a length of 0 marks the end
+	writeOutput(&endMarker, 1);
+	closeFiles(); // Close our files since we are done
+	printActionDetail(); // Print info about what we did
+}
+
+void Huffman::EncodeStreamAdaptive()
+{
+	// This method encodes standard input onto standard output with adaptive codes. Unlike EncodeStream,
+	// which waits for a whole chunk so it can build a tree for it, we encode whatever input has arrived
+	// as a frame of its own and flush it right away, so each message goes down the pipeline as soon as it is
+	// written, with just a couple of bytes of lengths in front. The model carries on from one frame to the next
+	// This implements the -eso command line parameter
+	useStandardStreams(); // Read from standard input and write to standard output
+	unsigned char magic[3] = { 'H', 'F', adaptiveFormat }; // The magic bytes and format, which is our whole header
+	writeOutput(magic, 3);
+	resetAdaptiveModel(); // Start out with every symbol equally likely
+	vector<unsigned char> chunk(streamChunkSize); // Buffer for the input we have on hand
+	vector<unsigned char> encoded; // Buffer for each encoded frame
+	while (true)
+	{
+		enterPhase(phaseRead);
+		size_t length = readAvailable(chunk.data(), streamChunkSize); // Read in whatever has arrived, waiting only if nothing has
+		if (length == 0) break; // If there was nothing left we are done
+		bytesIn += length; // Increment bytesIn by the amount we read in
+		writeAdaptiveFrame(chunk.data(), length, encoded); // Encode and write it out
+		outputTarget->flush(); // And push it down the pipeline right away
+	}
+	unsigned char endMarker = 0; // A frame with a length of 0 marks the end
+	writeOutput(&endMarker, 1);
+	outputTarget->flush();
+	printActionDetail(); // Print info about what we did, which goes to standard error since standard output has our data
+}
+
+void Huffman::DisplayHelp()
+{
+	// This is a method to display help information about our project
+	cout << "Available command line options" << endl;
+	cout << "HUFF -h | -? | -help will display this message again" << endl;
+	cout << "HUFF -e file1 [file2] will encode file1, placing the output into file2, or file1 with extension changed to .huf" << endl;
+	cout << "HUFF -d file1 file2 Decodes Huffman-Encoded file1 into file2" << endl;
+	cout << "HUFF -t file1 [file2] will create 510 byte tree building information and output it into file2, or file1 with extension changed to .htree" << endl;
+	cout << "HUFF -et file1 file2 [file3] will encode file1, using tree building information in file2, and output into file3, or file1 with extension changed to .huf" << endl;
+	cout << "HUFF -ep file1 [file2] will encode file1 in independent blocks using every core, placing the output into file2, or file1 with extension changed to .huf" << endl;
+	cout << "HUFF -ec file1 [file2] will encode file1 using canonical codes with a compact header, placing the output into file2, or file1 with extension changed to .huf" << endl;
+	cout << "HUFF -tc file1 [file2] will create a compact canonical tree for use with -et, placing the output into file2, or file1 with extension changed to .htree" << endl;
+	cout << "HUFF -ei | -ei8 file1 [file2] will encode file1 with each block split into 4 (or 8) streams that decode side by side, placing the output into file2, or file1 with extension changed to .huf" << endl;
+	cout << "HUFF -tr input1 [input2 ...] will train a tree from every input file, every file under an input directory, and every path listed in an @file, saving it in the tree store (the HUFF_TREES directory, or trees) and printing its ID" << endl;
+	cout << "HUFF -er file1 id [file2] will encode file1 with trained tree id, storing only the ID, placing the output into file2, or file1 with extension changed to .huf" << endl;
+	cout << "HUFF -ek file1 [file2] will encode file1 like -ec, adding a checkpoint every 64 KB so -dr can decode ranges of it quickly, placing the output into file2, or file1 with extension changed to .huf" << endl;
+	cout << "HUFF -dr file1 offset length file2 will decode just length bytes starting at offset of the original file out of file1 (written by -ek or -ec) into file2" << endl;
+	cout << "HUFF -sample <any of the above> will build the tree for a large file from evenly spaced samples of it instead of all of it, so it is only read once, and estimate how much that costs" << endl;
+	cout << "HUFF -stats | -json <any of the above> will also time each phase of the work, printing the times with the summary or printing everything as one JSON object" << endl;
+	cout << "HUFF -es will encode standard input onto standard output one chunk at a time, for use in a pipeline" << endl;
+	cout << "HUFF -ds will decode a stream written by -es or -eso from standard input onto standard output" << endl;
+	cout << "HUFF -e1 file1 [file2] will encode file1 into file2 with order 1 codes, picking a code table for each symbol by the symbol before it" << endl;
+	cout << "HUFF -e16 file1 [file2] will encode file1 into file2 with codes for 16 bit little-endian symbols instead of bytes" << endl;
+	cout << "HUFF -ef filter file1 [file2] will run file1 through a filter (none, delta, delta:stride, bcj or auto) and encode it into file2 with canonical codes" << endl;
+	cout << "HUFF -eo file1 [file2] will encode file1 into file2 in one pass with adaptive codes, storing no tree" << endl;
+	cout << "HUFF -eso will encode standard input onto standard output with adaptive codes, writing out each piece of input as soon as it arrives" << endl;
+	cout << "HUFF -ea archive input1 [input2 ...] will pack every input file, every file under an input directory, and every path listed in an @file into archive, encoding them in parallel" << endl;
+	cout << "HUFF -da archive [directory] will unpack every file in archive into directory, or the current directory, in parallel" << endl;
+	cout << "HUFF -xa archive name [file] will unpack just the entry called name from archive into file, or its own file name in the current directory" << endl;
+	cout << "HUFF -la archive will list every entry in archive with its original and encoded sizes" << endl;
+	cout << "HUFF -gen file1 name [file2] will turn tree file file1 (from -t or -tc) into a header defining name, a StaticCodec with its tables built at compile time, placing it into file2, or file1 with extension changed to .h" << endl;
+	cout << "HUFF -serve socket [cacheSize] will answer -client requests on a Unix domain socket, keeping the tables for up to cacheSize (64) trees built between requests" << endl;
+	cout << "HUFF -client socket -et file1 file2 [file3] | -ec file1 [file2] | -d file1 file2 | -stop will have the server on socket do the work, writing the same output the command would, or stop the server" << endl;
+}
+
+void Huffman::buildFrequencyTable()
+{
+	// Helper method to build out our frequency table, counting our input straight out of the mapping
+	enterPhase(phaseHistogram);
+	if (sampledHistogram && inputMap.Size() >= sampleThreshold)
+	{
+		sampleFrequencyTable(); // Large inputs only get read once when we sample them
+		return;
+	}
+	if (inputMap.Size() < parallelCountThreshold)
+	{
+		countSymbols(inputMap.Data(), inputMap.Size(), frequencyTable); // Small inputs aren't worth starting up any threads for
+		return;
+	}
+	ThreadPool pool; // Large inputs get split across every core, so start up a pool just for as long as we are counting
+	for (size_t i = 0; i < inputMap.Size(); i += countSliceSize)
+	{
+		// Count in slices, so the prefetch thread can stay ahead of us reading in the next one
+		countSymbolsParallel(inputMap.Data() + i, min((size_t)countSliceSize, inputMap.Size() - i), frequencyTable, pool);
+		inputPrefetch.Advance(i + countSliceSize);
+	}
+}
+
+void Huffman::sampleFrequencyTable()
+{
+	// Helper method that estimates our frequency table from sampleCount evenly spaced samples of the input, scaled
+	// up to the size of the whole input. Counting all of a large input means reading it all in just to build the
+	// tree, then reading it all in again to encode it, and when it isn't already in memory that doubles how long
+	// we spend waiting on the disk. Symbols the samples miss still get codes: the original tree gives every symbol
+	// one, and the canonical encoders ask for codes for every symbol whenever sampledBytes is set.
+	// To estimate what sampling costs us, we also build codes from the even samples and from the odd samples and
+	// see how much worse each half's codes do on the other half than on itself. Half as much data misses more than
+	// all of it does, so this tends to overestimate the loss
+	const unsigned char* input = inputMap.Data(); // Our input, straight out of the mapping
+	size_t length = inputMap.Size(); // And its length
+	unsigned long long halves[2][numChars] = { { 0 } }; // The counts of the even and odd samples
+	size_t spacing = length / sampleCount; // How far apart our samples start, each one at the start of its share of the input
+	for (int sample = 0; sample < sampleCount; sample++)
+		countSymbols(input + sample * spacing, sampleSize, halves[sample % 2]);
+	unsigned char halfLengths[2][numChars]; // The code lengths each half would give us
+	for (int half = 0; half < 2; half++)
+	{
+		copy(halves[half], halves[half] + numChars, frequencyTable);
+		buildCanonicalLengths(true); // Every symbol gets a code, so each half's codes work on the other half
+		copy(codeLengths, codeLengths + numChars, halfLengths[half]);
+	}
+	unsigned long long ownBits = 0, crossBits = 0; // The bits each half takes with its own codes, and with the other half's
+	for (int i = 0; i < numChars; i++)
+	{
+		ownBits += halves[0][i] * halfLengths[0][i] + halves[1][i] * halfLengths[1][i];
+		crossBits += halves[0][i] * halfLengths[1][i] + halves[1][i] * halfLengths[0][i];
+	}
+	sampleLoss = crossBits > ownBits ? (double)(crossBits - ownBits) / ownBits : 0; // Limiting code lengths can leave a half's own codes a hair worse than the other half's, which we count as no loss
+	sampledBytes = (unsigned long long)sampleCount * sampleSize;
+	double scale = (double)length / sampledBytes; // How much bigger the input is than our samples
+	for (int i = 0; i < numChars; i++)
+	{
+		unsigned long long count = halves[0][i] + halves[1][i];
+		frequencyTable[i] = count > 0 ? max(1ULL, (unsigned long long)(count * scale + 0.5)) : 0; // Scaled up so the sizes we work out from it are for the whole input
+	}
+	enterPhase(phaseHistogram); // buildCanonicalLengths moved us on to building the tree
+}
+
+void Huffman::resetState()
+{
+	// Helper method that puts us back the way we started, other than our tree, so the same object can
+	// run one operation after another. Every operation builds or loads the tree it needs, except for
+	// the buffer methods using a shared tree, which is why we hang on to it
+	closeFiles(); // Let go of anything still open from last time
+	outputStream.clear(); // Forget about any errors from the streams we used last time
+	treeStream.clear();
+	fill(frequencyTable, frequencyTable + numChars, 0); // Start counting from scratch
+	inputPosition = 0;
+	outputTarget = &outputStream;
+	memoryOutput = nullptr;
+	outputFilter.Start(filterNone, 0); // A decode that failed partway could have left a filter going
+	inputIsStdin = false;
+	bytesIn = bytesOut = 0;
+	failed = false;
+	lastError = "";
+	fill(phaseSeconds, phaseSeconds + phaseCount, 0.0);
+	sampledBytes = 0;
+	sampleLoss = 0;
+	currentPhase = phaseRead; // Every operation starts out opening and reading its input
+	start = phaseStart = chrono::steady_clock::now(); // And start timing from now
+}
+
+bool Huffman::openFiles(string inputFile, string outputFile, string treeFile)
+{
+	// Helper method to open up the given files
+	resetState(); // Clear out anything left over from the last thing we did
+	bool inputOpened = inputMap.Open(inputFile); // We ALWAYS want to open up an inputFile, which we map into memory so we can read it in place
+	inputPosition = 0; // Start reading at the beginning of it
+	outputStream.open(outputFile, ios::binary); // We ALWAYS want to open up an outputFile, in binary mode
+	if (treeFile.length() > 0) // If our treeFile string has a length greater than 0, we must want it so try to open it
+	{
+		treeStream.open(treeFile, ios::binary); // Open up the treeFile, in binary mode
+		if (treeStream.fail()) // If we fail to open, display an error and return false
+		{
+			cout << "Tree stream failed to open" << endl;
+			return false;
+		}
+	}
+	if (!inputOpened) // If we failed to open the inputFile display an error and return false
+	{
+		cout << "Input stream failed to open" << endl;
+		return false;
+	}
+	if (outputStream.fail()) // If we failed to open the outputFile display an error and return false
+	{
+		cout << "Output stream failed to open" << endl;
+		return false;
+	}
+	if (overlappedIO && inputMap.Size() >= overlapThreshold)
+	{
+		// Large files get their reading and writing done on threads of their own, so the disk
+		// keeps busy while we work and we don't sit waiting on it
+		inputPrefetch.Start(inputMap.Data(), inputMap.Size());
+		asyncOutput.Start(&outputStream);
+	}
+	return true; // If we made it here, everything is open so we can return true
+}
+
+void Huffman::buildTree(unsigned char* treeBuilder)
+{
+	// Helper method to build our tree from the frequency table. Every merge we make is
+	// recorded as a pair of indexes in treeBuilder, so others can build the same tree.
+	// Each merge takes the two lightest slots of nodes[], breaking ties by the lowest slot,
+	// and puts their parent in the lower of the two slots. We used to find them by scanning
+	// every slot twice per merge, now we keep the slots in a heap ordered by (weight, slot),
+	// which picks exactly the same two slots in O(log n) so our tree files don't change
+	enterPhase(phaseTree);
+	deleteTree(); // Get rid of any tree we built before
+	pair<unsigned long long, int> heap[numChars]; // The weight and slot of every filled slot, as a min-heap
+	for (int i = 0; i < numChars; i++)
+	{
+		// Loop through all of the characters in the frequency table,
+		// building a node for each one with its given frequency
+		nodes[i] = addNode((unsigned char)i, frequencyTable[i], noNode, noNode);
+		heap[i] = { frequencyTable[i], i };
+	}
+	auto heavier = greater<pair<unsigned long long, int>>(); // Orders our heap so the lightest (then lowest) slot is on top
+	make_heap(heap, heap + numChars, heavier);
+	int heapSize = numChars; // The number of slots still in the heap
+	for (int i = 0; i < numChars - 1; i++)
+	{
+		// Loop through the number of characters we have - 1, this is the amount we always need to build a tree
+		pop_heap(heap, heap + heapSize--, heavier); // Take the smallest slot off the heap
+		int smallestNodeIndex = heap[heapSize].second;
+		pop_heap(heap, heap + heapSize--, heavier); // And then the next smallest
+		int nextSmallestNodeIndex = heap[heapSize].second;
+		int leftSlot = min(smallestNodeIndex, nextSmallestNodeIndex); // Whichever occurs earlier in the list becomes the left child, and the parent takes its slot
+		int rightSlot = max(smallestNodeIndex, nextSmallestNodeIndex);
+		unsigned long long weight = tree[nodes[leftSlot]].weight + tree[nodes[rightSlot]].weight; // The parent weighs as much as both of its children together
+		nodes[leftSlot] = addNode(0, weight, nodes[leftSlot], nodes[rightSlot]); // Make the parent, in the place of its left child
+		nodes[rightSlot] = noNode; // The right child's slot is empty now
+		heap[heapSize++] = { weight, leftSlot }; // Put the parent back into the heap
+		push_heap(heap, heap + heapSize, heavier);
+		treeBuilder[2 * i] = (unsigned char)leftSlot; // Record the merge, so others can build the tree as needed
+		treeBuilder[2 * i + 1] = (unsigned char)rightSlot;
+	}
+}
+
+void Huffman::buildCodeTable()
+{
+	// Helper method that turns the encoding strings we built from the tree into numbers,
+	// so encoding can write a whole code with a couple of shifts instead of appending strings
+	enterPhase(phaseCodeTable);
+	maxCodeLength = 0; // Reset our longest code before we look through them
+	for (int i = 0; i < numChars; i++)
+	{
+		unsigned int bits = 0; // The bits of our code
+		for (size_t j = 0; j < encodingStrings[i].length() && j < 32; j++)
+		{
+			// Shift each character of the path in as a bit, only bothering with the first 32 since longer codes don't use this
+			bits = (bits << 1) | (encodingStrings[i][j] == '1');
+		}
+		codeTable[i].bits = bits; // Save the code
+		codeTable[i].length = (unsigned int)encodingStrings[i].length(); // And its length
+		if (codeTable[i].length > maxCodeLength)
+			maxCodeLength = codeTable[i].length; // Keep track of the longest code we've seen
+	}
+	codeTableCurrent = true;
+}
+
+void Huffman::putLongCode(BitWriter& writer, const string& code)
+{
+	// Helper method that writes out a code longer than 32 bits, these only show up for
+	// very rare symbols so we just go through the string 32 characters at a time
+	for (size_t i = 0; i < code.length(); i += 32)
+	{
+		unsigned int bits = 0; // The bits of this piece of the code
+		int count = 0; // The number of bits in this piece
+		for (size_t j = i; j < code.length() && j < i + 32; j++, count++)
+		{
+			bits = (bits << 1) | (code[j] == '1'); // Shift each character of the path in as a bit
+		}
+		writer.putBits(bits, count); // And write the piece out
+	}
+}
+
+void Huffman::encode(unsigned int checkpointEvery)
+{
+	// Helper method that encodes our input file into our output file.
+	// We go through the mapped input in large chunks, have encodeSymbols pack the codes for each
+	// chunk using a BitWriter, then write out all of the bytes from a chunk at once.
+	// With checkpoints, chunks also end at every checkpoint so we can note which bit it starts at
+	enterPhase(phaseCode);
+	const unsigned char* input = inputMap.Data(); // Our input, straight out of the mapping
+	size_t length = inputMap.Size(); // And its length
+	vector<unsigned char> outputBuffer(encodedSizeBound(min((size_t)inputChunkSize, length))); // Buffer for our output, big enough for every symbol in a chunk to use the longest code
+	vector<unsigned char> checkpoints; // Where each checkpoint starts in the encoded data, in bits, 8 bytes each
+	unsigned long long bytesWritten = 0; // How many encoded bytes we have written out so far
+	BitWriter writer; // The writer that packs our codes into bytes
+	writer.position = outputBuffer.data(); // Start writing at the beginning of our output buffer
+	for (size_t i = 0; i < length;)
+	{
+		size_t chunkLength = min((size_t)inputChunkSize, length - i); // The length of this chunk
+		if (checkpointEvery > 0)
+		{
+			if (i > 0 && i % checkpointEvery == 0)
+			{
+				// This symbol is a checkpoint, so record where its code starts: every byte we have written, plus the bits waiting in the writer
+				checkpoints.resize(checkpoints.size() + 8);
+				storeLittleEndian64(&checkpoints[checkpoints.size() - 8], bytesWritten * 8 + writer.bitCount);
+			}
+			chunkLength = min(chunkLength, (size_t)(checkpointEvery - i % checkpointEvery)); // Stop at the next checkpoint
+		}
+		encodeSymbols(input + i, chunkLength, writer); // Encode every character in it
+		size_t written = writer.position - outputBuffer.data(); // The amount of whole words we packed from this chunk
+		writeOutput(outputBuffer.data(), written); // Write them out to the file
+		bytesWritten += written;
+		writer.position = outputBuffer.data(); // And start filling our output buffer from the beginning again
+		i += chunkLength;
+		inputPrefetch.Advance(i); // Let the prefetch thread know how far we've gotten
+	}
+	bytesIn += length; // We read in the whole input
+	finishEncoding(writer); // Write out whatever is left in the writer, with padding
+	size_t written = writer.position - outputBuffer.data(); // The amount of bytes we flushed at the end
+	writeOutput(outputBuffer.data(), written); // Write them out to the file
+	writeOutput(checkpoints.data(), checkpoints.size()); // Followed by our checkpoint index, if we have one
+}
+
+void Huffman::encodeCanonical()
+{
+	// Helper method that encodes our input in the canonical format: our header with the original
+	// length and the compact tree, then the encoded data. If we don't have a shared tree we build
+	// one just for this input, leaving out the symbols it doesn't use
+	if (!hasSharedTree)
+	{
+		buildFrequencyTable(); // Build the frequency table from our input
+		buildCanonicalLengths(sampledBytes > 0); // Figure out the length of each symbol's code, leaving out the ones that never appear unless we only sampled the input
+		buildCanonicalTree(); // Build the tree those lengths describe
+		buildEncodingStrings(nodes[0], ""); // Build our list of encoding strings based on the tree
+		buildCodeTable(); // Turn those strings into numeric codes we can write out quickly
+		unsigned char treeData[maxCanonicalTreeSize]; // Our compact tree, just so we know its size
+		unsigned long long headerSize = (checkpointInterval > 0 ? 15 : 11) + writeCanonicalTree(treeData); // The header we are about to write
+		unsigned long long indexSize = checkpointInterval > 0 && inputMap.Size() > 0 ? (inputMap.Size() - 1) / checkpointInterval * 8 : 0; // And the checkpoint index at the end
+		if (storeIfSmaller(headerSize + codedBytes() + indexSize)) return; // Data that won't get any smaller is just stored
+	}
+	if (hasSharedTree && sharedTreeTrained)
+	{
+		// A trained tree lives in the tree store, so our header only needs its ID and the original length
+		unsigned char header[referenceHeaderSize] = { 'H', 'F', referenceFormat };
+		storeLittleEndian64(header + 3, sharedTreeId);
+		storeLittleEndian64(header + 11, inputMap.Size());
+		writeOutput(header, referenceHeaderSize);
+	}
+	else if (checkpointInterval > 0)
+	{
+		// With checkpoints our header also holds how far apart they are, and the index of them goes at the end of the file
+		unsigned char header[15 + maxCanonicalTreeSize] = { 'H', 'F', checkpointFormat };
+		storeLittleEndian64(header + 3, inputMap.Size());
+		storeLittleEndian32(header + 11, checkpointInterval);
+		writeOutput(header, 15 + writeCanonicalTree(header + 15));
+		encode(checkpointInterval); // Encode the input, recording the checkpoints as we go
+		return;
+	}
+	else
+		writeCanonicalHeader(inputMap.Size()); // Write out our header with the code lengths
+	encode(); // Actually encode the input
+}
+
+void Huffman::encodeSymbols(const unsigned char* data, size_t length, BitWriter& writer)
+{
+	// Helper method that writes out the code for every symbol in data. This only reads codeTable
+	// and encodingStrings, so several threads can encode different blocks at the same time
+	for (size_t i = 0; i < length; i++)
+	{
+		// Loop through every character, writing out its code
+		unsigned char realChar = data[i];
+		if (codeTable[realChar].length <= 32)
+			writer.putBits(codeTable[realChar].bits, codeTable[realChar].length); // Almost every code fits in one write
+		else
+			putLongCode(writer, encodingStrings[realChar]); // The ones that don't have to be written out in pieces
+	}
+}
+
+void Huffman::finishEncoding(BitWriter& writer)
+{
+	// Helper method that writes out the last bits in the writer, padding out the final byte
+	writer.flushBytes(); // Write out any whole bytes that are still waiting in the writer
+	if (writer.bitCount > 0)
+	{
+		// If we still have part of a byte left over we need to handle padding. Since paddingBits is longer
+		// than 7 bits, the part of it we use can never be decoded as a symbol. Canonical trees might not
+		// have a path that long, but their files store the original length, so we just pad those with 0s
+		int paddingCount = 8 - writer.bitCount; // The number of bits we need to fill out the byte
+		unsigned int padding = 0; // The first paddingCount bits of our padding path
+		for (int i = 0; i < paddingCount; i++)
+			padding = (padding << 1) | ((size_t)i < paddingBits.length() && paddingBits[i] == '1');
+		writer.putBits(padding, paddingCount); // Add them to the writer
+		writer.flushBytes(); // And write out the now complete byte
+	}
+}
+
+size_t Huffman::encodedSizeBound(size_t length)
+{
+	// Helper method that returns the most bytes length symbols could take to encode,
+	// if every one of them used our longest code, plus room for the padding
+	return length * maxCodeLength / 8 + 8;
+}
+
+bool Huffman::buildTreeFromBuilder(const unsigned char* treeBuilder, bool writeTree)
+{
+	// This method builds a tree based on tree builder information, the 255 merge pairs
+	// written out by buildTree, which comes from either the input file or a separate tree file.
+	// Returns false if a pair merges a slot that is already empty, since that can't be one of our trees
+	enterPhase(phaseTree);
+	if (treeSource.size() == treeBuilderSize && equal(treeSource.begin(), treeSource.end(), treeBuilder))
+	{
+		// This is the tree we already have, along with whatever tables we built for it, which happens
+		// every time when one object encodes or decodes a stream of inputs that share a tree file
+		if (writeTree)
+			writeOutput(treeBuilder, treeBuilderSize);
+		return true;
+	}
+	deleteTree(); // Get rid of any tree we built before
+	for (int i = 0; i < numChars; i++)
+	{
+		// Loop through the number of characters we have, creating a leaf for
+		// each one, in our nodes array. We don't care about their weight since we know the combination order
+		nodes[i] = addNode((unsigned char)i, 0, noNode, noNode);
+	}
+	for (int i = 0; i < numChars - 1; i++)
+	{
+		// Loop through the number of characters we have - 1, since we can always combine
+		// All of our nodes into one tree in this many passes
+		unsigned char char1 = treeBuilder[2 * i]; // The first index of this merge pair
+		unsigned char char2 = treeBuilder[2 * i + 1]; // The second index of this merge pair
+		if (char1 == char2 || nodes[char1] == noNode || nodes[char2] == noNode)
+		{
+			deleteTree(); // Don't leave half of a tree lying around
+			return false;
+		}
+		// The left child will always be whatever was our first of the 2 chars read in, and the right child
+		// our second. The parent takes the place of the first, and the place of the second is empty now
+		nodes[char1] = addNode(0, 0, nodes[char1], nodes[char2]);
+		nodes[char2] = noNode;
+	}
+	if (nodes[0] == noNode)
+	{
+		deleteTree(); // The root always ends up in the first slot, so if it isn't there this isn't one of our trees
+		return false;
+	}
+	if (writeTree)
+	{
+		writeOutput(treeBuilder, treeBuilderSize); // Copy the tree builder information into our output in one go
+	}
+	treeSource.assign(treeBuilder, treeBuilder + treeBuilderSize); // Remember where this tree came from
+	return true;
+}
+
+unsigned long long Huffman::decode(unsigned long long outputLimit)
+{
+	// This function decodes our huffman encoded file.
+	// Originally this followed the tree one bit at a time, with 8 unrolled followTree() calls
+	// per byte (which benchmarked faster on MRT.exe than either loop version), but walking
+	// the tree bit by bit is still slow. Now we hand large chunks of the mapped input to
+	// decodeBuffer, which uses our lookup tables to decode several bits at once.
+	// Long inputs on a machine with more than one core are split up between threads by decodeSpeculative
+	enterPhase(phaseCode);
+	const unsigned char* input = inputMap.Data() + inputPosition; // The encoded data, right after the tree builder information
+	size_t length = inputMap.Size() - inputPosition; // And its length
+	if (length >= 2 * speculativeSegmentSize && thread::hardware_concurrency() > 1)
+	{
+		unsigned long long totalWritten = decodeSpeculative(input, length, outputLimit);
+		bytesIn += length; // We read in all of the encoded data
+		inputPosition += length;
+		return totalWritten;
+	}
+	vector<unsigned char> outputBuffer(min((size_t)inputChunkSize, length) * 8 + maxSymbolsPerEntry); // Buffer for our output, every symbol takes at least one bit so this can never overflow
+	size_t bytePosition = 0; // The byte of the input the current chunk starts at
+	size_t bitPosition = 0; // The bit we are at inside of the current chunk, always at the start of a symbol
+	unsigned long long totalWritten = 0; // The number of bytes we have written out so far
+	while (true)
+	{
+		size_t chunkLength = min((size_t)inputChunkSize, length - bytePosition); // The length of this chunk
+		bool lastChunk = bytePosition + chunkLength == length; // Whether this chunk goes to the end of the file
+		size_t written = decodeBuffer(input + bytePosition, chunkLength, bitPosition, lastChunk, outputBuffer.data()); // Decode as much as we can
+		written = (size_t)min((unsigned long long)written, outputLimit); // If the file stores its length, leave off anything the padding decoded into
+		outputLimit -= written; // Keep track of how much more we are allowed to write
+		totalWritten += written;
+		writeOutput(outputBuffer.data(), written); // Write out everything we decoded in one go
+		if (lastChunk) break; // If that was the end of the file we are done
+		bytePosition += bitPosition >> 3; // Otherwise start the next chunk at the byte we stopped in, decodeBuffer stops a little early so nothing is lost
+		bitPosition &= 7; // Keeping our position inside of it
+		inputPrefetch.Advance(inputPosition + bytePosition); // Let the prefetch thread know how far we've gotten
+	}
+	bytesIn += length; // We read in all of the encoded data
+	inputPosition += length;
+	return totalWritten;
+}
+
+void Huffman::buildDecodeTable()
+{
+	// Helper method that builds our decode lookup tables from the tree.
+	// The root table has an entry for every possible value of the next rootTableBits bits,
+	// telling us which symbols those bits decode to and how many bits they used. Codes that are
+	// longer than that point to a secondary table that looks at the next subTableBits bits
+	enterPhase(phaseCodeTable);
+	if (decodeTableCurrent) return; // Our tables already match this tree (a shared tree, say), so there's nothing to do
+	decodeTable.assign(1 << rootTableBits, decodeEntry()); // Start out with just the (empty) root table
+	fillDecodeTable(nodes[0], 0, rootTableBits); // Fill in the root table starting from the root of our tree
+	decodeTableCurrent = true;
+}
+
+void Huffman::fillDecodeTable(unsigned short startingPoint, int tableOffset, int tableBits)
+{
+	// Helper method that fills in the table starting at tableOffset, decoding from startingPoint.
+	// For every possible value of the next tableBits bits we walk the tree just like the old
+	// decoder did, storing up to maxSymbolsPerEntry symbols that are completely contained in those bits
+	int tableSize = 1 << tableBits; // The number of entries in this table
+	for (int i = 0; i < tableSize; i++)
+	{
+		decodeEntry entry = decodeEntry(); // The entry we are building up, zeroed out
+		unsigned short currentNode = startingPoint; // Start walking at the node this table belongs to
+		for (int bit = tableBits - 1; bit >= 0; bit--)
+		{
+			// Loop through the bits of i from left to right, going right for a 1 and left for a 0
+			currentNode = (i >> bit) & 1 ? tree[currentNode].right : tree[currentNode].left;
+			if (isLeaf(currentNode))
+			{
+				// We reached a leaf, so these bits decode to its symbol
+				entry.symbols[entry.symbolCount++] = tree[currentNode].symbol; // Add it to our entry
+				entry.bitsUsed = (unsigned char)(tableBits - bit); // Every bit up to and including this one has been used
+				currentNode = nodes[0]; // The next symbol starts back at the root of the tree
+				if (entry.symbolCount == maxSymbolsPerEntry) break; // If the entry is full, stop here
+			}
+		}
+		if (entry.symbolCount == 0)
+		{
+			// We didn't reach a single leaf, so this code is longer than the table. Point the entry at a new
+			// secondary table that continues from currentNode, which is where we ended up after all tableBits bits
+			int subTableOffset = (int)decodeTable.size(); // The new table goes at the end of everything we have so far
+			entry.bitsUsed = (unsigned char)tableBits; // Following the link uses up every bit this table looked at
+			entry.subTable = (unsigned short)((subTableOffset - (1 << rootTableBits)) >> subTableBits); // Secondary tables are all the same size, so we can just number them
+			decodeTable[tableOffset + i] = entry; // Store the link before resizing the table
+			decodeTable.resize(subTableOffset + (1 << subTableBits)); // Make room for the new secondary table
+			fillDecodeTable(currentNode, subTableOffset, subTableBits); // And recursively fill it in
+		}
+		else
+		{
+			decodeTable[tableOffset + i] = entry; // Store our finished entry
+		}
+	}
+}
+
+unsigned long long Huffman::decodeSpeculative(const unsigned char* data, size_t length, unsigned long long outputLimit)
+{
+	// Helper method that decodes a single bitstream with no block index (every file written before -ep, and
+	// canonical files) on all of our cores. We cut the encoded data into segments at whole bytes and have a
+	// thread decode each one from the first bit of the segment, even though that is almost never where a symbol
+	// starts. Huffman codes resynchronize on their own: a decode that starts in the middle of a code goes wrong
+	// for a few symbols, then lands on a real symbol boundary and is right from there on. So each thread notes
+	// the bit every symbol starts at near the start of its segment. Then, in order, we start from the bit the
+	// segment before stopped at (which is a true boundary, since that segment was right by the time it got there)
+	// and decode a symbol at a time until we land on one of those notes, usually within a few dozen bits. From
+	// that symbol on the segment's output is exactly what a serial decode gives. In the rare case the two never
+	// meet inside of the window, we just decode the segment again from the true boundary
+	ThreadPool pool; // Our pool of worker threads, one per core
+	size_t segmentCount = length / speculativeSegmentSize; // The last segment also takes whatever is left over, so every other segment has plenty of data after it for decodeBuffer to peek into
+	size_t batchSegments = (size_t)pool.Size() * 4; // The number of segments we decode at a time, so our memory use doesn't depend on the size of the file
+	vector<speculativeSegment> segments(batchSegments); // Each segment in the batch, reused between batches
+	unsigned char stitchPrefix[syncWindowBits]; // The symbols we decode while meeting up with a segment's decode, every symbol takes at least one bit so the window can't hold more
+	size_t trueBit = 0; // Where the next symbol really starts, as a serial decode would see it
+	unsigned long long totalWritten = 0; // The number of bytes we have written out so far
+	for (size_t firstSegment = 0; firstSegment < segmentCount; firstSegment += batchSegments)
+	{
+		size_t segmentsInBatch = min(batchSegments, segmentCount - firstSegment); // The number of segments in this batch
+		pool.ParallelFor(segmentsInBatch, [&](size_t segment)
+		{
+			size_t segmentNumber = firstSegment + segment; // The number of this segment in the file
+			bool lastSegment = segmentNumber == segmentCount - 1;
+			decodeSegment(data, length, segmentNumber * speculativeSegmentSize * 8, lastSegment ? length * 8 : (segmentNumber + 1) * speculativeSegmentSize * 8, lastSegment, segments[segment]);
+		});
+		for (size_t segment = 0; segment < segmentsInBatch; segment++)
+		{
+			// Stitch each segment onto the one before it, starting from the symbol that begins at trueBit
+			speculativeSegment& current = segments[segment];
+			size_t segmentNumber = firstSegment + segment;
+			size_t bitPosition = trueBit; // Where we are in our serial decode
+			size_t prefixLength = 0; // The symbols we decode on our own before we meet up with the segment's decode
+			auto found = lower_bound(current.boundaries.begin(), current.boundaries.end(), bitPosition); // The first boundary the segment's decode noted at or past where we are
+			while (found != current.boundaries.end() && *found != bitPosition)
+			{
+				// We haven't met up yet, so decode one more symbol on our own
+				if (!decodeTreeSymbol(data, length * 8, bitPosition, stitchPrefix[prefixLength]))
+				{
+					found = current.boundaries.end(); // We ran out of data, only the padding at the end of the file does that
+					break;
+				}
+				prefixLength++;
+				found = lower_bound(found, current.boundaries.end(), bitPosition);
+			}
+			size_t skip = found - current.boundaries.begin(); // The segment's symbols before we met up, which came from decoding in the middle of a code
+			if (found == current.boundaries.end())
+			{
+				// It didn't line up in time, so decode the segment again from where we know a symbol starts
+				bool lastSegment = segmentNumber == segmentCount - 1;
+				decodeSegment(data, length, trueBit, lastSegment ? length * 8 : (segmentNumber + 1) * speculativeSegmentSize * 8, lastSegment, current);
+				prefixLength = skip = 0;
+			}
+			for (const unsigned char* part : { stitchPrefix, current.output.data() + skip })
+			{
+				// Write out our own symbols, then the segment's from where we met up
+				size_t partLength = part == stitchPrefix ? prefixLength : current.outputSize - skip;
+				size_t written = (size_t)min((unsigned long long)partLength, outputLimit); // If the file stores its length, leave off anything the padding decoded into
+				outputLimit -= written; // Keep track of how much more we are allowed to write
+				totalWritten += written;
+				writeOutput(part, written);
+			}
+			trueBit = current.stopBit; // The next segment picks up where this one really stopped
+		}
+		inputPrefetch.Advance(inputPosition + (trueBit >> 3)); // Let the prefetch thread know how far we've gotten
+	}
+	return totalWritten;
+}
+
+void Huffman::decodeSegment(const unsigned char* data, size_t length, size_t startBit, size_t endBit, bool lastSegment, speculativeSegment& segment)
+{
+	// Helper method that decodes one segment for decodeSpeculative. For the first syncWindowBits bits we follow the
+	// tree one bit at a time, so we can note where every symbol starts (a decode table entry can hold several
+	// symbols and would hide the boundaries between them). After that we hand the rest of the segment to
+	// decodeBuffer a piece at a time, just like decodeBlock, stopping at the first boundary at or past endBit
+	const size_t pieceSize = 1 << 16; // The amount of encoded data we hand to decodeBuffer at a time
+	size_t totalBits = length * 8; // Symbols can run past the end of the segment, but never past the end of the data
+	size_t bitPosition = startBit; // Where the next symbol starts
+	size_t written = 0; // The number of bytes we've decoded so far
+	segment.boundaries.clear();
+	if (segment.output.size() < (size_t)syncWindowBits)
+		segment.output.resize(syncWindowBits); // Every symbol takes at least one bit, so this is room for every symbol in the window
+	size_t windowEnd = min(startBit + syncWindowBits, endBit); // Where we stop noting boundaries
+	while (bitPosition < windowEnd)
+	{
+		segment.boundaries.push_back(bitPosition);
+		if (!decodeTreeSymbol(data, totalBits, bitPosition, segment.output[written]))
+		{
+			segment.boundaries.pop_back(); // We ran out of data in the middle of a code, which is the padding at the end of the file
+			break;
+		}
+		written++;
+	}
+	while (bitPosition < endBit)
+	{
+		size_t bytePosition = bitPosition >> 3; // The byte this piece starts in
+		size_t pieceLength; // How much data decodeBuffer gets
+		bool lastPiece = false; // Whether this piece goes to the end of the data
+		if (lastSegment)
+		{
+			pieceLength = min(pieceSize, length - bytePosition);
+			lastPiece = bytePosition + pieceLength == length;
+		}
+		else
+			pieceLength = min(pieceSize, (endBit >> 3) - bytePosition) + decodeSlackBytes; // Segments end on a whole byte, and decodeBuffer stops decodeSlackBytes before the end of what it gets
+		if (segment.output.size() < written + pieceLength * 8 + maxSymbolsPerEntry)
+			segment.output.resize(written + pieceLength * 8 + maxSymbolsPerEntry); // Make sure there is room for the most this piece could decode to
+		size_t pieceBit = bitPosition & 7; // Our position inside of the piece
+		written += decodeBuffer(data + bytePosition, pieceLength, pieceBit, lastPiece, segment.output.data() + written);
+		bitPosition = bytePosition * 8 + pieceBit;
+		if (lastPiece) break; // decodeBuffer went all the way to the end of the data
+	}
+	segment.outputSize = written;
+	segment.stopBit = bitPosition;
+}
+
+bool Huffman::decodeTreeSymbol(const unsigned char* data, size_t totalBits, size_t& bitPosition, unsigned char& symbol)
+{
+	// Helper method that decodes the symbol starting at bitPosition by following the tree one bit at a time, leaving
+	// bitPosition at the start of the next one. Slow, but unlike a decode table entry it never decodes more than one symbol
+	unsigned short currentNode = nodes[0]; // Start at the root of the tree
+	while (!isLeaf(currentNode))
+	{
+		if (bitPosition >= totalBits) return false; // The data ended in the middle of a code
+		// If the bit is a 1 go right, otherwise go left
+		currentNode = data[bitPosition >> 3] & (0x80 >> (bitPosition & 7)) ? tree[currentNode].right : tree[currentNode].left;
+		bitPosition++;
+	}
+	symbol = tree[currentNode].symbol;
+	return true;
+}
+
+size_t Huffman::decodeBlock(const unsigned char* data, size_t length, vector<unsigned char>& output)
+{
+	// Helper method that decodes one complete encoded block into output, growing output if needed
+	// (but never shrinking it, so it can be reused), and returns the number of bytes we decoded.
+	// We feed decodeBuffer pieces of the block at a time so output only needs room for one extra piece
+	const size_t pieceSize = 1 << 16; // The amount of encoded data we hand to decodeBuffer at a time
+	size_t written = 0; // The number of bytes we've decoded so far
+	size_t bytePosition = 0; // The byte of data the current piece starts at
+	size_t bitPosition = 0; // The bit inside of the current piece we are at
+	while (true)
+	{
+		size_t pieceLength = min(pieceSize, length - bytePosition); // The length of this piece
+		bool lastPiece = bytePosition + pieceLength == length; // Whether this piece goes to the end of the block
+		if (output.size() < written + pieceLength * 8 + maxSymbolsPerEntry)
+			output.resize(written + pieceLength * 8 + maxSymbolsPerEntry); // Make sure there is room for the most this piece could decode to
+		written += decodeBuffer(data + bytePosition, pieceLength, bitPosition, lastPiece, output.data() + written); // Decode the piece
+		if (lastPiece) break; // If that was the end of the block we are done
+		bytePosition += bitPosition >> 3; // Otherwise start the next piece at the byte we stopped in
+		bitPosition &= 7; // Keeping our position inside of it
+	}
+	return written;
+}
+
+size_t Huffman::encodeBlock(const unsigned char* data, size_t length, vector<unsigned char>& output)
+{
+	// Helper method that encodes one block of symbols into output, padding out the last byte, and returns
+	// the number of bytes it wrote. Like decodeBlock, output grows as needed but never shrinks
+	const size_t pieceSize = 1 << 16; // The number of symbols we encode between checking that output has room
+	BitWriter writer; // The writer that packs our codes into bytes
+	size_t written = 0; // The number of bytes written so far
+	for (size_t i = 0; i < length; i += pieceSize)
+	{
+		size_t pieceLength = min(pieceSize, length - i); // The number of symbols in this piece
+		if (output.size() < written + encodedSizeBound(pieceLength))
+			output.resize(written + encodedSizeBound(pieceLength)); // Make sure there is room for the most this piece could take
+		writer.position = output.data() + written; // Point the writer at the end of what we've written
+		encodeSymbols(data + i, pieceLength, writer); // Encode the piece
+		written = writer.position - output.data(); // And keep track of how much we've written
+	}
+	if (output.size() < written + 8)
+		output.resize(written + 8); // Make sure there is room for whatever is left in the writer
+	writer.position = output.data() + written;
+	finishEncoding(writer); // Write out the last bits with padding
+	return writer.position - output.data();
+}
+
+size_t Huffman::decodeBuffer(const unsigned char* data, size_t length, size_t& bitPosition, bool lastBuffer, unsigned char* output)
+{
+	// Helper method that decodes the encoded bytes in data, starting at bitPosition, into output.
+	// When this isn't the last buffer we stop a little before the end so that no code can run off of it,
+	// leaving bitPosition at the start of the next symbol so the caller can carry the rest over.
+	// Output must have room for length * 8 + maxSymbolsPerEntry bytes, since every symbol is at least one bit
+	unsigned char* outputPosition = output; // Where we are writing our next symbol
+	if (length > (size_t)decodeSlackBytes)
+	{
+		const decodeEntry* rootTable = decodeTable.data(); // The root table is at the start of decodeTable
+		const decodeEntry* subTables = rootTable + (1 << rootTableBits); // And the secondary tables follow it
+		size_t fastLimit = (length - decodeSlackBytes) * 8; // Past this bit we might peek off of the end of the buffer
+		while (bitPosition < fastLimit)
+		{
+			const decodeEntry* entry = &rootTable[peekBits(data, bitPosition, rootTableBits)]; // Look up the next rootTableBits bits
+			while (entry->symbolCount == 0)
+			{
+				// The code is too long for the table we looked in, so use up its bits and follow the link
+				bitPosition += entry->bitsUsed;
+				entry = &subTables[((size_t)entry->subTable << subTableBits) + peekBits(data, bitPosition, subTableBits)];
+			}
+			memcpy(outputPosition, entry->symbols, maxSymbolsPerEntry); // Always copy every symbol slot, it is faster than copying just the ones we need
+			outputPosition += entry->symbolCount; // But only move forward past the valid ones
+			bitPosition += entry->bitsUsed; // And move past the bits they used
+		}
+	}
+	if (lastBuffer)
+	{
+		// For the last few bytes of the file we go back to following the tree one bit at a time.
+		// This way the padding at the end, which is the start of a code longer than 7 bits, never turns into a symbol
+		unsigned short currentNode = nodes[0]; // Start at the root of the tree
+		size_t totalBits = length * 8; // The number of bits we have to go through
+		for (; bitPosition < totalBits; bitPosition++)
+		{
+			// If the bit is a 1 go right, otherwise go left
+			currentNode = data[bitPosition >> 3] & (0x80 >> (bitPosition & 7)) ? tree[currentNode].right : tree[currentNode].left;
+			if (isLeaf(currentNode))
+			{
+				// When we reach a leaf output its symbol and start back at the top of the tree
+				*outputPosition++ = tree[currentNode].symbol;
+				currentNode = nodes[0];
+			}
+		}
+	}
+	return outputPosition - output; // The amount of bytes we wrote
+}
+
+void Huffman::decodeRange(int format, unsigned long long offset, unsigned long long count)
+{
+	// Helper method that decodes count bytes starting at offset of the original, right after the magic
+	// bytes of a canonical or checkpointed file. Checkpointed files end with an index holding the bit
+	// each checkpoint starts at (checkpoint k is byte k * interval of the original, and the first one,
+	// at the very start, isn't stored). We start decoding at the last checkpoint at or before offset,
+	// throw away the symbols before offset, and stop as soon as we have count of them, decoding the
+	// encoded data in small chunks so we never get far past the end of the range
+	unsigned char header[12]; // The original length, then for checkpointed files, the interval between checkpoints
+	size_t headerSize = format == checkpointFormat ? 12 : 8;
+	if (!readInput(header, headerSize) || !readCanonicalTree())
+	{
+		reportError("Input file does not contain a valid canonical tree");
+		return;
+	}
+	unsigned long long originalLength = loadLittleEndian64(header);
+	if (!plausibleLength(originalLength))
+	{
+		reportError("Input file ended before all of its data was decoded"); // Too short to hold that many symbols, so our range can't be in it
+		return;
+	}
+	unsigned long long interval = format == checkpointFormat ? loadLittleEndian32(header + 8) : 0; // Canonical files have no checkpoints
+	unsigned long long checkpointCount = interval > 0 && originalLength > 0 ? (originalLength - 1) / interval : 0; // Checkpoints after the first
+	size_t available = inputMap.Size() - inputPosition; // The encoded data and the index
+	if ((format == checkpointFormat && interval == 0) || checkpointCount > available / 8)
+	{
+		reportError("Input file has a damaged checkpoint index");
+		return;
+	}
+	const unsigned char* encoded = inputMap.Data() + inputPosition; // The encoded data
+	size_t encodedLength = available - (size_t)checkpointCount * 8; // Which ends where the index starts
+	const unsigned char* index = encoded + encodedLength;
+	offset = min(offset, originalLength); // Keep our range inside of the file
+	count = min(count, originalLength - offset);
+	if (count == 0) return; // Nothing to decode (which includes every empty file)
+	if (!hasCodes())
+	{
+		reportError("Input file does not contain a valid canonical tree"); // Anything that isn't empty needs codes to decode
+		return;
+	}
+	unsigned long long checkpoint = interval > 0 ? offset / interval : 0; // The last checkpoint at or before offset
+	unsigned long long startBit = checkpoint > 0 ? loadLittleEndian64(index + (checkpoint - 1) * 8) : 0; // The bit it starts at
+	if (startBit >= (unsigned long long)encodedLength * 8)
+	{
+		reportError("Input file has a damaged checkpoint index");
+		return;
+	}
+	unsigned long long skip = offset - checkpoint * interval; // Symbols between the checkpoint and the start of our range
+	buildDecodeTable(); // Build our decode lookup tables from the tree
+	if (!reserveOutput(count)) return;
+	vector<unsigned char> outputBuffer((size_t)min((unsigned long long)rangeChunkSize, (unsigned long long)encodedLength) * 8 + maxSymbolsPerEntry); // Buffer for a decoded chunk, every symbol takes at least one bit so this can never overflow
+	enterPhase(phaseCode);
+	size_t bytePosition = (size_t)(startBit >> 3); // The byte of the encoded data the current chunk starts at
+	size_t bitPosition = (size_t)(startBit & 7); // The bit we are at inside of the current chunk, always at the start of a symbol
+	while (count > 0)
+	{
+		size_t chunkLength = min((size_t)rangeChunkSize, encodedLength - bytePosition); // The length of this chunk
+		bool lastChunk = bytePosition + chunkLength == encodedLength; // Whether this chunk goes to the end of the encoded data
+		size_t written = decodeBuffer(encoded + bytePosition, chunkLength, bitPosition, lastChunk, outputBuffer.data()); // Decode as much as we can
+		size_t skipped = (size_t)min(skip, (unsigned long long)written); // Throw away anything before our range
+		size_t wanted = (size_t)min(count, (unsigned long long)(written - skipped)); // And anything after it
+		writeOutput(outputBuffer.data() + skipped, wanted);
+		skip -= skipped;
+		count -= wanted;
+		bytesIn += (lastChunk ? chunkLength : bitPosition >> 3); // Count the encoded bytes we went through
+		if (lastChunk) break; // If that was the end of the data we are done
+		bytePosition += bitPosition >> 3; // Otherwise start the next chunk at the byte we stopped in
+		bitPosition &= 7; // Keeping our position inside of it
+	}
+	if (count > 0)
+		reportError("Input file ended before all of its data was decoded");
+}
+
+void Huffman::decodeBlocks()
+{
+	// Helper method that decodes a block container written by EncodeFileParallel. The tree and the
+	// block index come first, and since each block was encoded on its own we can hand a batch of
+	// them out to our threads and then write out their results in order
+	unsigned char header[blockHeaderSize - 3]; // The rest of our header, readFormat already read the magic bytes and format
+	unsigned char treeBuilder[treeBuilderSize]; // The tree builder information all of the blocks share
+	if (!readInput(header, sizeof(header)) || !readInput(treeBuilder, treeBuilderSize))
+	{
+		reportError("Input file is not a valid block container");
+		return;
+	}
+	unsigned int storedBlockSize = loadLittleEndian32(header); // The size of each block before encoding
+	unsigned long long originalSize = loadLittleEndian64(header + 4); // The size of the whole file before encoding
+	unsigned int blockCount = loadLittleEndian32(header + 12); // The number of blocks in the file
+	// Check the block count before we trust it with an allocation: it has to be exactly enough blocks for the
+	// original size, and the index it implies has to fit in what is left of the input
+	if (storedBlockSize == 0 || blockCount != (originalSize + storedBlockSize - 1) / storedBlockSize || (unsigned long long)blockCount * 8 > inputMap.Size() - inputPosition
+		|| !plausibleLength(originalSize))
+	{
+		reportError("Input file is not a valid block container");
+		return;
+	}
+	vector<unsigned char> blockIndex((size_t)blockCount * 8); // Where each block ends, relative to the end of the index
+	if (!readInput(blockIndex.data(), blockIndex.size()))
+	{
+		reportError("Input file is not a valid block container");
+		return;
+	}
+	if (!buildTreeFromBuilder(treeBuilder, false)) // Build the tree all of the blocks share
+	{
+		reportError("Input file is not a valid block container");
+		return;
+	}
+	buildDecodeTable(); // And our decode lookup tables from it
+
+	ThreadPool pool; // Our pool of worker threads, one per core
+	const unsigned char* blockData = inputMap.Data() + inputPosition; // The encoded blocks, straight out of the mapping
+	size_t blockDataLength = inputMap.Size() - inputPosition; // And the length of all of them together
+	size_t batchBlocks = (size_t)pool.Size() * 4; // The number of blocks we decode at a time, so our memory use doesn't depend on the size of the file
+	vector<vector<unsigned char>> blockOutputs(batchBlocks); // The decoded output of each block in the batch, reused between batches
+	vector<size_t> blockOutputSizes(batchBlocks); // How many bytes of each block's output are valid
+	for (unsigned int firstBlock = 0; firstBlock < blockCount; firstBlock += (unsigned int)batchBlocks)
+	{
+		size_t blocksInBatch = min(batchBlocks, (size_t)(blockCount - firstBlock)); // The number of blocks in this batch
+		pool.ParallelFor(blocksInBatch, [&](size_t block)
+		{
+			size_t blockNumber = firstBlock + block; // The number of this block in the file
+			unsigned long long start = blockNumber == 0 ? 0 : loadLittleEndian64(&blockIndex[(blockNumber - 1) * 8]) & ~storedBlockFlag; // Where the block starts
+			unsigned long long end = loadLittleEndian64(&blockIndex[blockNumber * 8]); // And where it ends
+			bool stored = (end & storedBlockFlag) != 0; // Whether the block was kept as it is
+			end &= ~storedBlockFlag;
+			if (end < start || end > blockDataLength)
+			{
+				blockOutputSizes[block] = (size_t)-1; // The index doesn't make sense, so mark the block as bad
+				return;
+			}
+			if (stored)
+				blockOutputSizes[block] = (size_t)(end - start); // A stored block doesn't need decoding, we write it straight out of the mapping
+			else
+				blockOutputSizes[block] = decodeBlock(blockData + start, (size_t)(end - start), blockOutputs[block]); // Decode it on its own
+		});
+		for (size_t block = 0; block < blocksInBatch; block++)
+		{
+			// Write out each block in order, making sure each one decoded to the size it should have
+			unsigned long long blockStart = (unsigned long long)(firstBlock + block) * storedBlockSize; // Where the block starts in the original file
+			size_t expectedSize = (size_t)min((unsigned long long)storedBlockSize, originalSize - min(originalSize, blockStart));
+			if (blockOutputSizes[block] != expectedSize)
+			{
+				reportError("Block " + to_string(firstBlock + block) + " is corrupt");
+				return;
+			}
+			unsigned long long end = loadLittleEndian64(&blockIndex[(firstBlock + block) * 8]); // Where the block ends, and whether it was stored
+			if (end & storedBlockFlag)
+				writeOutput(blockData + (end & ~storedBlockFlag) - expectedSize, expectedSize); // A stored block is already its original bytes
+			else
+				writeOutput(blockOutputs[block].data(), blockOutputSizes[block]);
+		}
+		unsigned int lastBlock = firstBlock + (unsigned int)blocksInBatch - 1; // The last block of this batch
+		inputPrefetch.Advance(inputPosition + (size_t)loadLittleEndian64(&blockIndex[(size_t)lastBlock * 8])); // Let the prefetch thread move ahead of it
+	}
+	bytesIn += blockDataLength; // We read in all of the encoded blocks
+	inputPosition += blockDataLength;
+}
+
+void Huffman::decodeInterleaved()
+{
+	// Helper method that decodes a file written by EncodeFileInterleaved, right after its magic bytes.
+	// The header tells us how the blocks were split up, then each block has the length of every
+	// stream followed by the streams, which we decode straight out of the mapping
+	unsigned char header[interleavedHeaderSize - 3]; // The rest of our header, readFormat already read the magic bytes and format
+	if (!readInput(header, sizeof(header)) || !readCanonicalTree())
+	{
+		reportError("Input file is not a valid interleaved file");
+		return;
+	}
+	size_t storedBlockSize = loadLittleEndian32(header); // The size of each block before encoding
+	unsigned long long originalSize = loadLittleEndian64(header + 4); // The size of the whole file before encoding
+	int streamCount = header[12]; // The number of streams in each block
+	if (storedBlockSize == 0 || streamCount == 0 || streamCount > maxStreams || !plausibleLength(originalSize))
+	{
+		reportError("Input file is not a valid interleaved file");
+		return;
+	}
+	if (originalSize == 0) return; // An empty file has no blocks, and we don't even have a tree to decode with
+	if (!hasCodes())
+	{
+		reportError("Input file is not a valid interleaved file"); // Anything that isn't empty needs codes to decode
+		return;
+	}
+	buildDecodeTable(); // Build our decode lookup tables from the tree every block shares
+	vector<unsigned char> output(min((unsigned long long)storedBlockSize, originalSize)); // Buffer for a decoded block
+	vector<unsigned char> tailBuffer; // Buffer decodeInterleavedBlock uses for the end of each stream
+	enterPhase(phaseCode);
+	for (unsigned long long blockStart = 0; blockStart < originalSize; blockStart += storedBlockSize)
+	{
+		size_t length = (size_t)min((unsigned long long)storedBlockSize, originalSize - blockStart); // The length of this block once it's decoded
+		unsigned char streamLengths[4 * maxStreams]; // The encoded length of each stream
+		if (!readInput(streamLengths, 4 * streamCount))
+		{
+			reportError("Input file ended in the middle of a block");
+			return;
+		}
+		if (loadLittleEndian32(streamLengths) == storedStreams)
+		{
+			// The block was stored as it is, so copy it straight out of the mapping
+			if (inputMap.Size() - inputPosition < length)
+			{
+				reportError("Input file ended in the middle of a block");
+				return;
+			}
+			writeOutput(inputMap.Data() + inputPosition, length);
+			inputPosition += length;
+			bytesIn += length;
+			continue;
+		}
+		const unsigned char* streams[maxStreams]; // Where each stream starts, straight out of the mapping
+		size_t lengths[maxStreams];
+		for (int stream = 0; stream < streamCount; stream++)
+		{
+			lengths[stream] = loadLittleEndian32(streamLengths + 4 * stream);
+			if (inputMap.Size() - inputPosition < lengths[stream])
+			{
+				reportError("Input file ended in the middle of a block");
+				return;
+			}
+			streams[stream] = inputMap.Data() + inputPosition;
+			inputPosition += lengths[stream]; // Move past the stream
+			bytesIn += lengths[stream];
+		}
+		if (!decodeInterleavedBlock(streams, lengths, streamCount, output.data(), length, tailBuffer))
+		{
+			reportError("Block starting at byte " + to_string(blockStart) + " is corrupt");
+			return;
+		}
+		writeOutput(output.data(), length); // Write out the block
+	}
+}
+
+bool Huffman::decodeInterleavedBlock(const unsigned char* const* streams, const size_t* streamLengths, int streamCount, unsigned char* output, size_t length, vector<unsigned char>& tailBuffer)
+{
+	// Helper method that decodes the streams of one block into output, which has room for length bytes.
+	// Each stream decodes into its own piece of output. We step through every stream one lookup at a time,
+	// so the lookups of different streams don't depend on each other and the CPU can work on all of them at
+	// once. As long as every stream is far enough from the end of its data and its piece of output, we know
+	// how many rounds we can do without checking anything, and the last few symbols of each stream are
+	// decoded on their own with decodeBuffer
+	struct streamState // Where one stream is in its data and its piece of output
+	{
+		const unsigned char* data; // The stream's encoded data
+		size_t bitPosition; // The bit we are at in data
+		size_t fastLimit; // Past this bit a lookup might peek off the end of data
+		unsigned char* outputPosition; // Where the stream's next symbol goes
+		unsigned char* outputEnd; // The end of the stream's piece of output
+	};
+	streamState states[maxStreams];
+	size_t pieceLength = (length + streamCount - 1) / streamCount; // The number of symbols in each stream, the last may have fewer
+	for (int stream = 0; stream < streamCount; stream++)
+	{
+		size_t start = min(stream * pieceLength, length); // Where this stream's piece starts in the block
+		states[stream].data = streams[stream];
+		states[stream].bitPosition = 0;
+		states[stream].fastLimit = streamLengths[stream] > (size_t)decodeSlackBytes ? (streamLengths[stream] - decodeSlackBytes) * 8 : 0;
+		states[stream].outputPosition = output + start;
+		states[stream].outputEnd = output + min(start + pieceLength, length);
+	}
+	const decodeEntry* rootTable = decodeTable.data(); // The root table is at the start of decodeTable
+	const decodeEntry* subTables = rootTable + (1 << rootTableBits); // And the secondary tables follow it
+	while (true)
+	{
+		// Every round each stream does one lookup, which uses at most maxLookupBits bits and writes at most
+		// maxSymbolsPerEntry symbols (always copying all of the slots), so figure out how many rounds every stream can do safely
+		size_t rounds = SIZE_MAX;
+		for (int stream = 0; stream < streamCount; stream++)
+		{
+			const streamState& state = states[stream];
+			size_t bitRounds = state.bitPosition < state.fastLimit ? (state.fastLimit - state.bitPosition) / maxLookupBits : 0;
+			size_t outputRounds = (size_t)(state.outputEnd - state.outputPosition) / maxSymbolsPerEntry;
+			rounds = min(rounds, min(bitRounds, outputRounds));
+		}
+		if (rounds == 0) break; // One of the streams is close to an end, so finish them each on their own
+		for (size_t round = 0; round < rounds; round++)
+		{
+			for (int stream = 0; stream < streamCount; stream++)
+			{
+				streamState& state = states[stream];
+				const decodeEntry* entry = &rootTable[peekBits(state.data, state.bitPosition, rootTableBits)]; // Look up the next rootTableBits bits
+				if (entry->symbolCount == 0)
+				{
+					// Our codes are never longer than maxCanonicalLength, so one secondary table is always enough
+					state.bitPosition += entry->bitsUsed;
+					entry = &subTables[((size_t)entry->subTable << subTableBits) + peekBits(state.data, state.bitPosition, subTableBits)];
+				}
+				memcpy(state.outputPosition, entry->symbols, maxSymbolsPerEntry); // Always copy every symbol slot, it is faster than copying just the ones we need
+				state.outputPosition += entry->symbolCount; // But only move forward past the valid ones
+				state.bitPosition += entry->bitsUsed; // And move past the bits they used
+			}
+		}
+	}
+	for (int stream = 0; stream < streamCount; stream++)
+	{
+		// Finish off each stream, decoding what is left of it into tailBuffer so anything the padding
+		// turns into can't spill into the next stream's piece, then copying over just the symbols we need
+		streamState& state = states[stream];
+		size_t needed = state.outputEnd - state.outputPosition; // The symbols this stream still owes us
+		if (needed == 0) continue;
+		size_t byteStart = min(state.bitPosition >> 3, streamLengths[stream]); // The byte we stopped in
+		size_t bitPosition = state.bitPosition & 7; // And where in it
+		size_t remaining = streamLengths[stream] - byteStart; // The bytes of the stream we haven't finished
+		if (tailBuffer.size() < remaining * 8 + maxSymbolsPerEntry)
+			tailBuffer.resize(remaining * 8 + maxSymbolsPerEntry); // Make sure there is room for the most these bytes could decode to
+		size_t decoded = decodeBuffer(state.data + byteStart, remaining, bitPosition, true, tailBuffer.data());
+		if (decoded < needed) return false; // The stream ran out before it gave us all of its symbols
+		memcpy(state.outputPosition, tailBuffer.data(), needed);
+	}
+	return true;
+}
+
+void Huffman::buildCanonicalLengths(bool allSymbols)
+{
+	// Helper method that figures out how long each symbol's code should be from our frequency table,
+	// storing them in codeLengths. Symbols that never appear get a length of 0 (no code), unless
+	// allSymbols is set, in which case we pretend they appeared once. No length is ever longer than
+	// maxCanonicalLength, if the real Huffman lengths are we shorten them while keeping the code complete.
+	// The work is done by the same code that builds lengths for 16 bit symbols
+	static_assert(symbolTraits<unsigned char>::maxCodeLength == maxCanonicalLength, "Byte codes have to keep the length limit our formats store");
+	enterPhase(phaseTree);
+	buildLimitedLengths<unsigned char>(frequencyTable, allSymbols, codeLengths);
+}
+
+void Huffman::buildCanonicalTree()
+{
+	// Helper method that builds our tree out of the code lengths in codeLengths. Canonical codes
+	// are handed out in order of length and then symbol, so the lengths are all we need to know
+	// every code. Each code is then added into the tree as a path from the root to its leaf
+	deleteTree(); // Get rid of any tree we built before
+	nodes[0] = addNode(0, 0, noNode, noNode); // Our root
+	int lengthCounts[maxCanonicalLength + 1] = { 0 }; // How many codes there are of each length
+	for (int i = 0; i < numChars; i++)
+		lengthCounts[codeLengths[i]]++;
+	lengthCounts[0] = 0; // Symbols without a code don't take up any room
+	unsigned int nextCode[maxCanonicalLength + 1]; // The next code to hand out for each length
+	unsigned int code = 0;
+	for (int length = 1; length <= maxCanonicalLength; length++)
+	{
+		// The first code of each length comes right after the last code of the length before it, with a 0 added on
+		code = (code + lengthCounts[length - 1]) << 1;
+		nextCode[length] = code;
+	}
+	for (int i = 0; i < numChars; i++)
+	{
+		int length = codeLengths[i]; // The length of this symbol's code
+		if (length == 0) continue; // Symbols without a code don't go in the tree
+		unsigned int symbolCode = nextCode[length]++; // Hand out the next code of this length
+		unsigned short currentNode = nodes[0]; // Start at the root
+		for (int bit = length - 1; bit >= 0; bit--)
+		{
+			// Follow the code from its first bit to its last, making any nodes we need along the way
+			bool goRight = (symbolCode >> bit) & 1;
+			unsigned short child = goRight ? tree[currentNode].right : tree[currentNode].left;
+			if (child == noNode)
+			{
+				child = addNode(0, 0, noNode, noNode);
+				(goRight ? tree[currentNode].right : tree[currentNode].left) = child;
+			}
+			currentNode = child;
+		}
+		tree[currentNode].symbol = (unsigned char)i; // The node at the end of the path is this symbol's leaf
+	}
+}
+
+size_t Huffman::canonicalTreeSize(const unsigned char* countBytes)
+{
+	// Helper method that returns how many bytes a compact canonical tree takes up, given its first two
+	// bytes (the number of symbols with a code), or 0 if the count can't be right. Up to 64 symbols are
+	// stored as symbol / length pairs, any more than that and it is smaller to store every length in 4 bits
+	unsigned int count = countBytes[0] | (countBytes[1] << 8);
+	if (count > numChars) return 0;
+	return count <= 64 ? 2 + 2 * count : 2 + numChars / 2;
+}
+
+size_t Huffman::writeCanonicalTree(unsigned char* output)
+{
+	// Helper method that writes codeLengths into output in their compact form, returning its size
+	unsigned int count = 0; // The number of symbols with a code
+	for (int i = 0; i < numChars; i++)
+		count += codeLengths[i] != 0;
+	output[0] = (unsigned char)count; // Store the count, lowest byte first
+	output[1] = (unsigned char)(count >> 8);
+	size_t size = 2;
+	if (count <= 64)
+	{
+		for (int i = 0; i < numChars; i++)
+		{
+			if (codeLengths[i] == 0) continue;
+			output[size++] = (unsigned char)i; // The symbol
+			output[size++] = codeLengths[i]; // And its code length
+		}
+	}
+	else
+	{
+		for (int i = 0; i < numChars; i += 2)
+			output[size++] = (unsigned char)((codeLengths[i] << 4) | codeLengths[i + 1]); // Two lengths to a byte
+	}
+	return size;
+}
+
+bool Huffman::loadCanonicalTree(const unsigned char* data)
+{
+	// Helper method that reads a compact canonical tree from data into codeLengths and builds the tree.
+	// Returns false if the lengths don't make a complete code, which means the data is corrupt
+	enterPhase(phaseTree);
+	unsigned int count = data[0] | (data[1] << 8); // The number of symbols with a code
+	fill(codeLengths, codeLengths + numChars, 0);
+	if (count <= 64)
+	{
+		for (unsigned int i = 0; i < count; i++)
+			codeLengths[data[2 + 2 * i]] = data[3 + 2 * i];
+	}
+	else
+	{
+		for (int i = 0; i < numChars; i += 2)
+		{
+			codeLengths[i] = data[2 + i / 2] >> 4;
+			codeLengths[i + 1] = data[2 + i / 2] & 15;
+		}
+	}
+	unsigned int total = 0; // How much of the code space the lengths use, in units of the longest code
+	for (int i = 0; i < numChars; i++)
+	{
+		if (codeLengths[i] > maxCanonicalLength) return false;
+		if (codeLengths[i] != 0)
+			total += 1u << (maxCanonicalLength - codeLengths[i]);
+	}
+	// Only an empty file can have no codes, anything else has to fill the code space exactly
+	if (total != (1u << maxCanonicalLength) && !(count == 0 && total == 0)) return false;
+	if (hasSharedTree && equal(sharedTreeData.begin(), sharedTreeData.end(), data) && canonicalTreeSize(data) == sharedTreeData.size())
+		return true; // This is our shared tree, which we already have built along with its tables
+	size_t size = canonicalTreeSize(data);
+	if (treeSource.size() == size && equal(treeSource.begin(), treeSource.end(), data))
+		return true; // We already have this tree built, along with its tables
+	buildCanonicalTree(); // Build the tree the lengths describe
+	treeSource.assign(data, data + size); // Remember where this tree came from
+	return true;
+}
+
+bool Huffman::loadTrainedTree(unsigned long long id)
+{
+	// Helper method that makes trained tree id our tree. The first time we see an ID we read its file
+	// from the tree store, check it really is that tree, and build its decode tables, then we keep both
+	// so every later file or buffer using the tree just copies the tables back (or does nothing at
+	// all if it is still the tree we have)
+	if (trainedTreeLoaded && loadedTreeId == id) return true; // It is still our tree, tables and all
+	auto found = trainedTrees.find(id);
+	if (found == trainedTrees.end())
+	{
+		string treeFile = (filesystem::path(treeStore) / (formatTreeId(id) + ".htree")).string();
+		ifstream file(treeFile, ios::binary);
+		vector<unsigned char> treeData((istreambuf_iterator<char>(file)), istreambuf_iterator<char>()); // Read in the whole tree file, they are never very big
+		if (file.fail() && treeData.empty())
+		{
+			reportError("Tree " + formatTreeId(id) + " is not in the tree store " + treeStore);
+			return false;
+		}
+		if (treeData.size() < 5 || treeData[0] != 'H' || treeData[1] != 'F' || treeData[2] != treeFileFormat
+			|| treeData.size() - 3 != canonicalTreeSize(&treeData[3]) || treeDataId(&treeData[3], treeData.size() - 3) != id
+			|| !loadCanonicalTree(&treeData[3]) || !hasCodes())
+		{
+			reportError("Tree file " + treeFile + " is not a valid trained tree");
+			return false;
+		}
+		buildDecodeTable(); // Build the decode tables once
+		found = trainedTrees.emplace(id, trainedTree()).first;
+		found->second.treeData.assign(treeData.begin() + 3, treeData.end());
+		found->second.decodeTable = decodeTable;
+	}
+	else
+	{
+		loadCanonicalTree(found->second.treeData.data()); // We already checked it the first time
+		if (!decodeTableCurrent)
+		{
+			decodeTable = found->second.decodeTable; // Copying the tables back is much cheaper than building them
+			decodeTableCurrent = true;
+		}
+	}
+	trainedTreeLoaded = true;
+	loadedTreeId = id;
+	return true;
+}
+
+unsigned long long Huffman::treeDataId(const unsigned char* treeData, size_t length)
+{
+	// Helper method that works out a tree's ID as the 64 bit FNV-1a hash of its compact form, so the
+	// same tree always has the same ID and two different trees practically never share one
+	unsigned long long hash = 0xCBF29CE484222325ULL;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= treeData[i];
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+string Huffman::formatTreeId(unsigned long long id)
+{
+	// Helper method that turns a tree ID into 16 hex digits, highest first
+	const char* digits = "0123456789abcdef";
+	string text(16, '0');
+	for (int i = 15; i >= 0; i--, id >>= 4)
+		text[i] = digits[id & 15];
+	return text;
+}
+
+bool Huffman::reserveOutput(unsigned long long length)
+{
+	// Helper method that makes room for length more bytes when we are writing into memory, since we know exactly
+	// how much we are going to write. Lengths come from headers, so they have passed plausibleLength first
+	if (bytesOut + length > outputLimit)
+	{
+		reportError("Output would be larger than the limit of " + formatNumber(outputLimit) + " bytes");
+		return false;
+	}
+	if (memoryOutput != nullptr)
+		memoryOutput->reserve(memoryOutput->size() + (size_t)length);
+	return true;
+}
+
+bool Huffman::plausibleLength(unsigned long long originalLength)
+{
+	// Helper method that returns whether what is left of our input could hold originalLength symbols. Every
+	// code is at least one bit long, so anything more than 8 symbols per byte means the header is corrupt,
+	// and we check this before trusting the length with any memory
+	return originalLength / 8 + (originalLength % 8 != 0) <= inputMap.Size() - inputPosition;
+}
+
+bool Huffman::hasCodes()
+{
+	// Helper method that returns whether the canonical tree we loaded gives any symbol a code. A tree with
+	// no codes at all is only valid for an empty file, and has no root to build decode tables from
+	return *max_element(codeLengths, codeLengths + numChars) > 0;
+}
+
+bool Huffman::readCanonicalTree()
+{
+	// Helper method that reads a compact canonical tree from our input and builds the tree from it
+	unsigned char data[maxCanonicalTreeSize]; // The compact tree
+	if (!readStreamBytes(data, 2)) return false; // Read in the count first so we know how big the rest is
+	size_t size = canonicalTreeSize(data);
+	if (size == 0 || !readStreamBytes(data + 2, size - 2)) return false;
+	return loadCanonicalTree(data);
+}
+
+void Huffman::writeCanonicalHeader(unsigned long long originalLength)
+{
+	// Helper method that writes the header of a canonical file: our magic bytes and format,
+	// the length of the original file, and the compact tree from codeLengths
+	unsigned char header[11 + maxCanonicalTreeSize];
+	header[0] = 'H';
+	header[1] = 'F';
+	header[2] = canonicalFormat;
+	storeLittleEndian64(header + 3, originalLength);
+	writeOutput(header, 11 + writeCanonicalTree(header + 11));
+}
+
+void Huffman::decodeStreamChunks()
+{
+	// Helper method that decodes the chunks of a stream, right after its magic bytes, until we reach
+	// the end marker. Each chunk carries its own tree, so we rebuild our tree and decode tables each time
+	vector<unsigned char> encoded; // Buffer for the encoded chunk
+	vector<unsigned char> decoded; // Buffer for the decoded chunk, grows as needed
+	while (true)
+	{
+		unsigned char header[streamChunkHeaderSize]; // The header of the next chunk
+		if (!readStreamBytes(header, streamChunkHeaderSize))
+		{
+			reportError("Stream ended before its end marker");
+			return;
+		}
+		size_t originalLength = loadLittleEndian32(header); // The length of the chunk before it was encoded
+		size_t encodedLength = loadLittleEndian32(header + 4); // The length of the encoded chunk
+		if (originalLength == 0) return; // A length of 0 is our end marker
+		if (originalLength > (size_t)streamChunkSize)
+		{
+			reportError("Stream chunk is corrupt"); // EncodeStream never writes a chunk this big
+			return;
+		}
+		if (header[8] == storedChunk)
+		{
+			// The chunk was kept as it is, so it just needs copying
+			decoded.resize(originalLength);
+			if (encodedLength != originalLength || !readStreamBytes(decoded.data(), originalLength))
+			{
+				reportError("Stream chunk is corrupt");
+				return;
+			}
+			writeOutput(decoded.data(), originalLength);
+			outputTarget->flush(); // And push it along right away
+			continue;
+		}
+		bool validTree = false; // Whether we managed to read in a tree for this chunk
+		// No code is longer than 255 bits, so a chunk can never encode to more than 32 bytes per symbol
+		if (encodedLength <= originalLength * 32 + 8)
+		{
+			if (header[8] == mergeListTree)
+			{
+				// The chunk has our original 510 byte tree builder information
+				unsigned char treeBuilder[treeBuilderSize];
+				validTree = readStreamBytes(treeBuilder, treeBuilderSize) && buildTreeFromBuilder(treeBuilder, false); // Build this chunk's tree
+			}
+			else if (header[8] == canonicalTree)
+			{
+				validTree = readCanonicalTree() && hasCodes(); // The chunk has compact code lengths, so read them in and build the tree from them
+			}
+		}
+		if (!validTree)
+		{
+			reportError("Stream chunk is corrupt");
+			return;
+		}
+		encoded.resize(encodedLength); // Make room for the encoded chunk
+		if (!readStreamBytes(encoded.data(), encodedLength))
+		{
+			reportError("Stream ended in the middle of a chunk");
+			return;
+		}
+		buildDecodeTable(); // Build our decode lookup tables from this chunk's tree
+		enterPhase(phaseCode);
+		size_t decodedLength = decodeBlock(encoded.data(), encodedLength, decoded); // Decode the chunk
+		if (decodedLength < originalLength)
+		{
+			reportError("Stream chunk is corrupt");
+			return;
+		}
+		writeOutput(decoded.data(), originalLength); // Write it out, leaving off anything the padding decoded into
+		outputTarget->flush(); // And push it along right away
+	}
+}
+
+bool Huffman::readStreamBytes(void* destination, size_t length)
+{
+	// Helper method that reads the next length bytes of a stream, from standard input if we are
+	// streaming or from our mapped input file otherwise. Returns false if the input ran out
+	if (!inputIsStdin) return readInput(destination, length);
+	int previousPhase = enterPhase(phaseRead); // Waiting on the pipe counts as reading
+	cin.read((char*)destination, length); // Read in as much as we want
+	enterPhase(previousPhase);
+	bytesIn += cin.gcount(); // Increment bytesIn by the amount we actually got
+	return (size_t)cin.gcount() == length;
+}
+
+unsigned long long Huffman::codedBytes()
+{
+	// Helper method that works out exactly how big encoding will make the input we counted: every symbol
+	// takes as many bits as its code. This is the entropy of our histogram as our codes actually achieve it,
+	// so it never misses the few bits per symbol a length limit or a whole number of bits per code costs
+	unsigned long long bits = 0;
+	for (int i = 0; i < numChars; i++)
+		bits += frequencyTable[i] * codeTable[i].length;
+	return (bits + 7) / 8; // Padded out to a whole byte
+}
+
+bool Huffman::storeIfSmaller(unsigned long long encodedSize)
+{
+	// Helper method that writes our input out as a stored file (just our header and the input as it is) when
+	// that is no bigger than encodedSize, the size coding would give us. Already compressed or encrypted data
+	// only grows when we code it, and a stored file decodes with nothing more than a copy
+	unsigned long long length = inputMap.Size(); // The size of our input
+	if (encodedSize < storedHeaderSize + length) return false; // Coding saves space, so the caller should go ahead with it
+	unsigned char header[storedHeaderSize] = { 'H', 'F', storedFormat };
+	storeLittleEndian64(header + 3, length);
+	writeOutput(header, storedHeaderSize);
+	writeOutput(inputMap.Data(), (size_t)length); // Then the input, straight out of the mapping
+	bytesIn += length;
+	return true;
+}
+
+void Huffman::decodeStored(unsigned long long offset, unsigned long long count)
+{
+	// Helper method that copies count bytes starting at offset out of a stored file, right after its magic bytes.
+	// There is nothing to decode, so we write straight out of the mapping
+	unsigned char header[storedHeaderSize - 3]; // The original length, readFormat already read the magic bytes and format
+	if (!readInput(header, sizeof(header)))
+	{
+		reportError("Input file is too short to contain its length");
+		return;
+	}
+	unsigned long long originalLength = loadLittleEndian64(header);
+	if (inputMap.Size() - inputPosition < originalLength)
+	{
+		reportError("Input file ended before all of its data");
+		return;
+	}
+	offset = min(offset, originalLength); // Keep our range inside of the file
+	count = min(count, originalLength - offset);
+	enterPhase(phaseCode);
+	writeOutput(inputMap.Data() + inputPosition + offset, (size_t)count);
+	bytesIn += count;
+	inputPosition += (size_t)originalLength;
+}
+
+size_t Huffman::readAvailable(void* destination, size_t length)
+{
+	// Helper method that reads from standard input without waiting for all length bytes, so a short
+	// message gets encoded as soon as it arrives. cin.read always waits to fill the whole request, so we go
+	// straight to the file descriptor. Returns 0 once the input has ended
+	while (true)
+	{
+#ifdef _WIN32
+		int count = _read(0, destination, (unsigned int)min(length, (size_t)INT_MAX)); // Read whatever is ready
+#else
+		ssize_t count = read(0, destination, length); // Read whatever is ready
+		if (count < 0 && errno == EINTR) continue; // A signal interrupted us before anything arrived, so try again
+#endif
+		return count > 0 ? (size_t)count : 0;
+	}
+}
+
+bool Huffman::buildContextModel(vector<unsigned char>& header)
+{
+	// Helper method that builds our order 1 model. We count how often each symbol follows each previous byte,
+	// then group the previous bytes (contexts) into at most maxContextTables tables. The busiest contexts
+	// start out with a table each, then every context moves to whichever table would code its symbols in the
+	// fewest bits, and the tables are rebuilt from the contexts they ended up with. Finally we merge tables
+	// while the bits a merge costs are fewer than the header bytes it saves. Estimates use the entropy of each
+	// table's counts, and the actual tables come from buildCanonicalLengths like every other tree
+	const unsigned char* input = inputMap.Data(); // Our input, straight out of the mapping
+	size_t length = inputMap.Size(); // And its length
+	if (length == 0) return false; // An empty file has nothing for a context to predict
+	enterPhase(phaseHistogram);
+	vector<unsigned long long> counts((size_t)numChars * numChars); // counts[previous * numChars + symbol], how often symbol follows previous
+	{
+		ThreadPool pool; // Large inputs get split across every core
+		countPairsParallel(input, length, counts.data(), pool);
+	}
+	enterPhase(phaseTree);
+	vector<int> contexts; // Every previous byte that is followed by something, busiest first
+	unsigned long long contextTotals[numChars] = { 0 }; // How many symbols follow each previous byte
+	for (int previous = 0; previous < numChars; previous++)
+	{
+		for (int symbol = 0; symbol < numChars; symbol++)
+			contextTotals[previous] += counts[previous * numChars + symbol];
+		if (contextTotals[previous] > 0)
+			contexts.push_back(previous);
+	}
+	sort(contexts.begin(), contexts.end(), [&](int a, int b) { return contextTotals[a] > contextTotals[b] || (contextTotals[a] == contextTotals[b] && a < b); });
+	int tableCount = (int)min(contexts.size(), (size_t)maxContextTables); // The tables we start out with
+	int assignment[numChars] = { 0 }; // The table each context uses
+	vector<unsigned long long> tableCounts((size_t)tableCount * numChars); // The combined counts of every context using each table
+	vector<double> bitCosts((size_t)tableCount * numChars); // About how many bits each symbol costs with each table
+	for (int round = 0; round < contextClusterRounds; round++)
+	{
+		// Rebuild each table from its contexts, the first round each of the busiest contexts is a table on its own
+		fill(tableCounts.begin(), tableCounts.end(), 0);
+		for (size_t i = 0; i < contexts.size(); i++)
+		{
+			if (round == 0 && i >= (size_t)tableCount) break;
+			int table = round == 0 ? (int)i : assignment[contexts[i]];
+			for (int symbol = 0; symbol < numChars; symbol++)
+				tableCounts[table * numChars + symbol] += counts[contexts[i] * numChars + symbol];
+		}
+		for (int table = 0; table < tableCount; table++)
+		{
+			// A symbol costs about log2(total / count) bits, and one the table hasn't seen costs a couple of bits more than its rarest symbol
+			unsigned long long total = 0;
+			for (int symbol = 0; symbol < numChars; symbol++)
+				total += tableCounts[table * numChars + symbol];
+			for (int symbol = 0; symbol < numChars; symbol++)
+				bitCosts[table * numChars + symbol] = log2((total + 1.0) / (tableCounts[table * numChars + symbol] + 0.25));
+		}
+		for (int context : contexts)
+		{
+			// Move each context to the table that codes its symbols in the fewest bits
+			double bestBits = 0;
+			for (int table = 0; table < tableCount; table++)
+			{
+				double bits = 0;
+				for (int symbol = 0; symbol < numChars; symbol++)
+				{
+					if (counts[context * numChars + symbol] != 0)
+						bits += counts[context * numChars + symbol] * bitCosts[table * numChars + symbol];
+				}
+				if (table == 0 || bits < bestBits)
+				{
+					bestBits = bits;
+					assignment[context] = table;
+				}
+			}
+		}
+	}
+	fill(tableCounts.begin(), tableCounts.end(), 0); // Rebuild the tables one last time from where the contexts ended up
+	for (int context : contexts)
+	{
+		for (int symbol = 0; symbol < numChars; symbol++)
+			tableCounts[assignment[context] * numChars + symbol] += counts[context * numChars + symbol];
+	}
+	auto tableBits = [&](const unsigned long long* tableCount) // About how many bits a table costs, its entropy plus the size of its compact tree
+	{
+		unsigned long long total = 0;
+		double bits = 0;
+		int used = 0;
+		for (int symbol = 0; symbol < numChars; symbol++)
+		{
+			if (tableCount[symbol] == 0) continue;
+			total += tableCount[symbol];
+			bits -= tableCount[symbol] * log2((double)tableCount[symbol]);
+			used++;
+		}
+		if (total > 0) bits += total * log2((double)total);
+		return bits + 8.0 * (used <= 64 ? 2 + 2 * used : 2 + numChars / 2);
+	};
+	vector<double> costs(tableCount); // What each table costs on its own
+	vector<double> savings((size_t)tableCount * tableCount); // savings[a * tableCount + b] for a < b, how many bits merging tables a and b saves
+	vector<char> alive(tableCount, 1); // Whether each table is still around, or was merged into another one
+	vector<unsigned long long> merged(numChars); // Scratch space for the counts of two tables together
+	auto mergeSaving = [&](int a, int b)
+	{
+		for (int symbol = 0; symbol < numChars; symbol++)
+			merged[symbol] = tableCounts[a * numChars + symbol] + tableCounts[b * numChars + symbol];
+		return costs[a] + costs[b] - tableBits(merged.data());
+	};
+	for (int table = 0; table < tableCount; table++)
+	{
+		costs[table] = tableBits(&tableCounts[table * numChars]);
+		alive[table] = costs[table] > 8.0 * 2; // A table no context ended up using just has its empty tree, and it goes away
+	}
+	for (int a = 0; a < tableCount; a++)
+		for (int b = a + 1; b < tableCount; b++)
+			if (alive[a] && alive[b]) savings[a * tableCount + b] = mergeSaving(a, b);
+	while (true)
+	{
+		// Merge the two tables that save the most bits together, until no merge saves anything
+		int bestA = -1, bestB = -1;
+		for (int a = 0; a < tableCount; a++)
+			for (int b = a + 1; b < tableCount; b++)
+				if (alive[a] && alive[b] && savings[a * tableCount + b] > 0 && (bestA < 0 || savings[a * tableCount + b] > savings[bestA * tableCount + bestB]))
+					bestA = a, bestB = b;
+		if (bestA < 0) break;
+		for (int symbol = 0; symbol < numChars; symbol++)
+			tableCounts[bestA * numChars + symbol] += tableCounts[bestB * numChars + symbol]; // Table b's counts join table a
+		for (int context : contexts)
+			if (assignment[context] == bestB) assignment[context] = bestA; // And so do its contexts
+		alive[bestB] = 0;
+		costs[bestA] = tableBits(&tableCounts[bestA * numChars]);
+		for (int other = 0; other < tableCount; other++)
+			if (alive[other] && other != bestA)
+				savings[min(bestA, other) * tableCount + max(bestA, other)] = mergeSaving(min(bestA, other), max(bestA, other)); // Only merges with the new table changed
+	}
+
+	// Build the real tables, numbering the ones that are left from 0, and write out our header as we go
+	header.assign(contextHeaderSize, 0);
+	header[0] = 'H';
+	header[1] = 'F';
+	header[2] = contextFormat;
+	storeLittleEndian64(&header[3], length);
+	int tableNumbers[maxContextTables]; // The number each table that is left ends up with
+	int finalCount = 0;
+	vector<unsigned char> tableLengths; // The code lengths of each final table, one after the other
+	contextCodes.clear();
+	for (int table = 0; table < tableCount; table++)
+	{
+		if (!alive[table]) continue;
+		tableNumbers[table] = finalCount++;
+		copy(&tableCounts[table * numChars], &tableCounts[table * numChars] + numChars, frequencyTable);
+		buildCanonicalLengths(false); // The table gets codes for the symbols its contexts use, just like a canonical file
+		tableLengths.insert(tableLengths.end(), codeLengths, codeLengths + numChars);
+		contextCodes.emplace_back();
+		buildFastCodes(codeLengths, contextCodes.back());
+		unsigned char treeData[maxCanonicalTreeSize]; // The table's compact tree
+		header.insert(header.end(), treeData, treeData + writeCanonicalTree(treeData));
+	}
+	header[11] = (unsigned char)finalCount;
+	for (int previous = 0; previous < numChars; previous++)
+	{
+		contextTables[previous] = contextTotals[previous] > 0 ? (unsigned char)tableNumbers[assignment[previous]] : 0; // Bytes that are never followed by anything can use any table
+		header[12 + previous] = contextTables[previous];
+	}
+
+	// Now see how big we actually come out, and how big one canonical table would
+	unsigned long long contextBits = 0; // The size of our encoded data
+	fill(frequencyTable, frequencyTable + numChars, 0);
+	for (int previous = 0; previous < numChars; previous++)
+	{
+		for (int symbol = 0; symbol < numChars; symbol++)
+		{
+			contextBits += counts[previous * numChars + symbol] * tableLengths[contextTables[previous] * numChars + symbol];
+			frequencyTable[symbol] += counts[previous * numChars + symbol]; // Every context added together is our plain histogram
+		}
+	}
+	buildCanonicalLengths(false); // The lengths a canonical file would use
+	unsigned long long canonicalBits = 0;
+	for (int symbol = 0; symbol < numChars; symbol++)
+		canonicalBits += frequencyTable[symbol] * codeLengths[symbol];
+	unsigned char treeData[maxCanonicalTreeSize];
+	unsigned long long canonicalSize = 11 + writeCanonicalTree(treeData) + (canonicalBits + 7) / 8;
+	unsigned long long contextSize = header.size() + (contextBits + 7) / 8; // And how big we come out
+	return contextSize < canonicalSize && contextSize < storedHeaderSize + length; // A canonical file falls back to storing the input as it is, so we have to beat that too
+}
+
+void Huffman::encodeContext()
+{
+	// Helper method that encodes our input with our order 1 tables, switching tables on every symbol by
+	// the symbol before it. The first symbol is coded as if a 0 came before it
+	enterPhase(phaseCode);
+	const unsigned char* input = inputMap.Data(); // Our input, straight out of the mapping
+	size_t length = inputMap.Size(); // And its length
+	const fastCodes* tables[numChars]; // The table each previous byte uses, looked up once here instead of for every symbol
+	for (int previous = 0; previous < numChars; previous++)
+		tables[previous] = &contextCodes[contextTables[previous]];
+	vector<unsigned char> outputBuffer(min((size_t)inputChunkSize, length) * 2 + 8); // No code is longer than 15 bits, so every symbol takes less than 2 bytes, plus a word the writer might write
+	BitWriter writer; // The writer that packs our codes into bytes
+	writer.position = outputBuffer.data();
+	unsigned char previous = 0; // The symbol before the one we are coding
+	for (size_t i = 0; i < length; i += inputChunkSize)
+	{
+		size_t end = min(i + inputChunkSize, length); // Where this chunk ends
+		for (size_t j = i; j < end; j++)
+		{
+			const codeEntry& code = tables[previous]->codes[input[j]];
+			writer.putBits(code.bits, code.length);
+			previous = input[j];
+		}
+		writeOutput(outputBuffer.data(), writer.position - outputBuffer.data()); // Write out the whole words we packed from this chunk
+		writer.position = outputBuffer.data(); // And start filling our output buffer from the beginning again
+		inputPrefetch.Advance(end); // Let the prefetch thread know how far we've gotten
+	}
+	bytesIn += length; // We read in the whole input
+	writer.flushBytes(); // Write out any whole bytes still waiting in the writer
+	if (writer.bitCount > 0)
+		writer.putBits(0, 8 - writer.bitCount); // Then pad out the last byte, the file stores its length so the padding is never decoded
+	writer.flushBytes();
+	writeOutput(outputBuffer.data(), writer.position - outputBuffer.data());
+}
+
+void Huffman::decodeContext()
+{
+	// Helper method that decodes an order 1 file, right after its magic bytes. Our tables are small enough
+	// that all of them stay in the L1 cache, so switching tables for every symbol only costs looking up which
+	// table the previous symbol uses. Until we are close to the end of the input we decode as many symbols as
+	// can't possibly reach the end without checking anything, then finish from a copy with zeros after it
+	unsigned char header[contextHeaderSize - 3]; // The rest of our header, readFormat already read the magic bytes and format
+	if (!readInput(header, sizeof(header)))
+	{
+		reportError("Input file is not a valid order 1 file");
+		return;
+	}
+	unsigned long long originalLength = loadLittleEndian64(header); // The length of the original file
+	int tableCount = header[8]; // The number of tables
+	bool valid = tableCount > 0 && tableCount <= maxContextTables;
+	for (int previous = 0; previous < numChars && valid; previous++)
+	{
+		contextTables[previous] = header[9 + previous];
+		valid = contextTables[previous] < tableCount; // Every byte has to use a table we actually have
+	}
+	deleteTree(); // We don't use a tree, and whatever tree we had is about to lose its code lengths
+	contextCodes.resize(valid ? tableCount : 0);
+	for (int table = 0; table < (int)contextCodes.size() && valid; table++)
+	{
+		// Read in each table, every one of them has to have at least one code
+		valid = readCanonicalTree() && *max_element(codeLengths, codeLengths + numChars) > 0;
+		if (valid) buildFastCodes(codeLengths, contextCodes[table]);
+	}
+	if (!valid)
+	{
+		reportError("Input file is not a valid order 1 file");
+		return;
+	}
+	enterPhase(phaseCode);
+	const unsigned char* input = inputMap.Data() + inputPosition; // The encoded data
+	size_t length = inputMap.Size() - inputPosition; // And its length
+	const fastCodes* tables[numChars]; // The table each previous byte uses
+	for (int previous = 0; previous < numChars; previous++)
+		tables[previous] = &contextCodes[contextTables[previous]];
+	vector<unsigned char> outputBuffer((size_t)min((unsigned long long)inputChunkSize, originalLength)); // Buffer for our output
+	unsigned char tail[32] = { 0 }; // The last few bytes of the input, with zeros after them so peekBits can't read past the end
+	const unsigned char* data = input; // What we are decoding from, input until we switch over to tail
+	size_t bitPosition = 0; // The bit we are at in data
+	size_t dataBits = length * 8; // The number of bits in data
+	size_t fastLimit = length > 8 ? (length - 8) * 8 : 0; // Past this bit peekBits could read off the end of input
+	unsigned char previous = 0; // The symbol before the one we are decoding
+	for (unsigned long long written = 0; written < originalLength;)
+	{
+		size_t count = (size_t)min((unsigned long long)inputChunkSize, originalLength - written); // The symbols in this chunk
+		unsigned char* output = outputBuffer.data();
+		for (size_t j = 0; j < count;)
+		{
+			size_t safe = bitPosition < fastLimit ? min((fastLimit - bitPosition) / maxCanonicalLength, count - j) : 0; // Symbols that can't reach fastLimit
+			if (safe > 0)
+			{
+				for (size_t end = j + safe; j < end; j++)
+					output[j] = previous = decodeFastSymbol(*tables[previous], data, bitPosition);
+				continue;
+			}
+			if (data == input)
+			{
+				// We are close to the end of the input, so carry on from a copy of what is left of it
+				size_t tailStart = min(bitPosition >> 3, length);
+				memcpy(tail, input + tailStart, length - tailStart); // Less than 11 bytes, since fastLimit is 8 bytes from the end
+				data = tail;
+				bitPosition -= tailStart * 8;
+				dataBits = (length - tailStart) * 8;
+				fastLimit = 0;
+			}
+			output[j++] = previous = decodeFastSymbol(*tables[previous], data, bitPosition);
+			if (bitPosition > dataBits)
+			{
+				reportError("Input file ended before all of its data was decoded");
+				return;
+			}
+		}
+		writeOutput(output, count); // Write out the chunk
+		written += count;
+		if (data == input) inputPrefetch.Advance(inputPosition + (bitPosition >> 3)); // Let the prefetch thread know how far we've gotten
+	}
+	bytesIn += length; // We read in all of the encoded data
+	inputPosition += length;
+}
+
+bool Huffman::buildWideModel(vector<unsigned char>& header)
+{
+	// Helper method that counts the 16 bit symbols of our input, builds their codes and writes out our header.
+	// Our counts are 32 bits, so the whole table is 256 KB and stays in the L2 cache while we count, and we
+	// add them into 64 bit totals every wideCountChunk symbols so even huge inputs can't overflow them.
+	// Returns false if a canonical file with byte codes would be at least as small
+	enterPhase(phaseHistogram);
+	const unsigned char* input = inputMap.Data(); // Our input, straight out of the mapping
+	size_t length = inputMap.Size(); // And its length
+	size_t symbolCount = length / 2; // An odd last byte goes in the header as it is
+	const size_t alphabetSize = symbolTraits<unsigned short>::alphabetSize;
+	vector<unsigned long long> counts(alphabetSize, 0); // How often each symbol appears
+	vector<unsigned int> chunkCounts(alphabetSize); // How often each symbol appears in this chunk
+	for (size_t i = 0; i < symbolCount; i += wideCountChunk)
+	{
+		fill(chunkCounts.begin(), chunkCounts.end(), 0);
+		size_t end = min(i + wideCountChunk, symbolCount);
+		for (size_t j = i; j < end; j++)
+			chunkCounts[input[2 * j] | (input[2 * j + 1] << 8)]++;
+		for (size_t symbol = 0; symbol < alphabetSize; symbol++)
+			counts[symbol] += chunkCounts[symbol];
+	}
+	enterPhase(phaseTree);
+	wideLengths.resize(alphabetSize);
+	buildLimitedLengths<unsigned short>(counts.data(), false, wideLengths.data()); // Only the symbols that appear get codes
+	wideCodes.Build(wideLengths.data());
+
+	// Our header: magic bytes, format, original length, the odd last byte (or 0) and how many symbols have a
+	// code, then for each of those symbols in order, how far it is past the one before as a varint and its length
+	header.assign(wideHeaderSize, 0);
+	header[0] = 'H';
+	header[1] = 'F';
+	header[2] = wideFormat;
+	storeLittleEndian64(&header[3], length);
+	header[11] = length % 2 == 1 ? input[length - 1] : 0;
+	unsigned int usedCount = 0; // The number of symbols with a code
+	unsigned long long wideBits = 0; // The size of our encoded data
+	long long previous = -1; // The symbol before this one, starting from one before symbol 0 so every gap is at least 1
+	for (size_t symbol = 0; symbol < alphabetSize; symbol++)
+	{
+		if (wideLengths[symbol] == 0) continue;
+		unsigned char entry[maxVarintSize + 1];
+		size_t entrySize = storeVarint(entry, (long long)symbol - previous);
+		entry[entrySize++] = wideLengths[symbol];
+		header.insert(header.end(), entry, entry + entrySize);
+		previous = (long long)symbol;
+		usedCount++;
+		wideBits += counts[symbol] * wideLengths[symbol];
+	}
+	storeLittleEndian32(&header[12], usedCount);
+
+	// Now see how big a canonical file with byte codes would be. Its histogram is just both halves of our symbols
+	fill(frequencyTable, frequencyTable + numChars, 0);
+	for (size_t symbol = 0; symbol < alphabetSize; symbol++)
+	{
+		frequencyTable[symbol & 0xFF] += counts[symbol];
+		frequencyTable[symbol >> 8] += counts[symbol];
+	}
+	if (length % 2 == 1) frequencyTable[input[length - 1]]++;
+	buildCanonicalLengths(false); // The lengths a canonical file would use
+	unsigned long long canonicalBits = 0;
+	for (int symbol = 0; symbol < numChars; symbol++)
+		canonicalBits += frequencyTable[symbol] * codeLengths[symbol];
+	unsigned char treeData[maxCanonicalTreeSize];
+	unsigned long long canonicalSize = 11 + writeCanonicalTree(treeData) + (canonicalBits + 7) / 8;
+	unsigned long long wideSize = header.size() + (wideBits + 7) / 8; // And how big we come out
+	return wideSize < canonicalSize && wideSize < storedHeaderSize + length; // A canonical file falls back to storing the input as it is, so we have to beat that too
+}
+
+void Huffman::encodeWide()
+{
+	// Helper method that encodes our input as 16 bit symbols. Each symbol's code and length share one word,
+	// so a skewed input only keeps the few cache lines of its common symbols busy
+	enterPhase(phaseCode);
+	const unsigned char* input = inputMap.Data(); // Our input, straight out of the mapping
+	size_t length = inputMap.Size() / 2 * 2; // And the part of it that makes whole symbols
+	const unsigned int* codes = wideCodes.codes.data();
+	vector<unsigned char> outputBuffer(min((size_t)inputChunkSize, length) / 2 * 3 + 8); // No code is longer than 20 bits, so every symbol takes less than 3 bytes, plus a word the writer might write
+	BitWriter writer; // The writer that packs our codes into bytes
+	writer.position = outputBuffer.data();
+	for (size_t i = 0; i < length; i += inputChunkSize)
+	{
+		size_t end = min(i + inputChunkSize, length); // Where this chunk ends, inputChunkSize is even so chunks never split a symbol
+		for (size_t j = i; j < end; j += 2)
+		{
+			unsigned int code = codes[input[j] | (input[j + 1] << 8)];
+			writer.putBits(code >> 5, code & 31);
+		}
+		writeOutput(outputBuffer.data(), writer.position - outputBuffer.data()); // Write out the whole words we packed from this chunk
+		writer.position = outputBuffer.data(); // And start filling our output buffer from the beginning again
+		inputPrefetch.Advance(end); // Let the prefetch thread know how far we've gotten
+	}
+	bytesIn += inputMap.Size(); // We read in the whole input, the odd last byte went in the header
+	writer.flushBytes(); // Write out any whole bytes still waiting in the writer
+	if (writer.bitCount > 0)
+		writer.putBits(0, 8 - writer.bitCount); // Then pad out the last byte, the file stores its length so the padding is never decoded
+	writer.flushBytes();
+	writeOutput(outputBuffer.data(), writer.position - outputBuffer.data());
+}
+
+void Huffman::decodeWide()
+{
+	// Helper method that decodes a 16 bit file, right after its magic bytes. Like decodeContext, until we are
+	// close to the end of the input we decode as many symbols as can't possibly reach the end without checking
+	// anything, then finish from a copy with zeros after it
+	unsigned char header[wideHeaderSize - 3]; // The rest of our header, readFormat already read the magic bytes and format
+	if (!readInput(header, sizeof(header)))
+	{
+		reportError("Input file is not a valid 16 bit file");
+		return;
+	}
+	unsigned long long originalLength = loadLittleEndian64(header); // The length of the original file
+	unsigned char oddByte = header[8]; // Its last byte, if it has an odd length
+	unsigned int usedCount = loadLittleEndian32(header + 9); // How many symbols have a code
+	const size_t alphabetSize = symbolTraits<unsigned short>::alphabetSize;
+	bool valid = usedCount <= alphabetSize && (usedCount == 0) == (originalLength < 2); // Only a file without any whole symbols has no codes
+	wideLengths.assign(alphabetSize, 0);
+	const unsigned char* tree = inputMap.Data() + inputPosition; // Read the tree straight out of the input
+	size_t treeLength = inputMap.Size() - inputPosition;
+	size_t treePosition = 0;
+	long long symbol = -1; // The symbol before the one we are reading
+	for (unsigned int i = 0; i < usedCount && valid; i++)
+	{
+		// Each symbol is a varint gap from the one before it, then its code length
+		unsigned long long gap = 0;
+		int shift = 0;
+		while (treePosition < treeLength && shift < 21 && (tree[treePosition] & 0x80))
+		{
+			gap |= (unsigned long long)(tree[treePosition++] & 0x7F) << shift;
+			shift += 7;
+		}
+		valid = treePosition + 1 < treeLength && shift < 21;
+		if (!valid) break;
+		gap |= (unsigned long long)tree[treePosition++] << shift;
+		symbol += (long long)gap;
+		valid = gap > 0 && symbol < (long long)alphabetSize && tree[treePosition] > 0;
+		if (valid) wideLengths[(size_t)symbol] = tree[treePosition++];
+	}
+	if (!valid || !wideCodes.Build(wideLengths.data())) // The lengths have to make a complete code
+	{
+		reportError("Input file is not a valid 16 bit file");
+		return;
+	}
+	inputPosition += treePosition;
+	bytesIn += treePosition;
+	enterPhase(phaseCode);
+	const unsigned char* input = inputMap.Data() + inputPosition; // The encoded data
+	size_t length = inputMap.Size() - inputPosition; // And its length
+	const int maxLength = symbolTraits<unsigned short>::maxCodeLength;
+	unsigned long long symbolCount = originalLength / 2;
+	vector<unsigned char> outputBuffer((size_t)min((unsigned long long)inputChunkSize, symbolCount * 2)); // Buffer for our output
+	unsigned char tail[32] = { 0 }; // The last few bytes of the input, with zeros after them so peekBits can't read past the end
+	const unsigned char* data = input; // What we are decoding from, input until we switch over to tail
+	size_t bitPosition = 0; // The bit we are at in data
+	size_t dataBits = length * 8; // The number of bits in data
+	size_t fastLimit = length > 8 ? (length - 8) * 8 : 0; // Past this bit peekBits could read off the end of input
+	for (unsigned long long written = 0; written < symbolCount;)
+	{
+		size_t count = (size_t)min((unsigned long long)inputChunkSize / 2, symbolCount - written); // The symbols in this chunk
+		unsigned char* output = outputBuffer.data();
+		for (size_t j = 0; j < count;)
+		{
+			size_t safe = bitPosition < fastLimit ? min((fastLimit - bitPosition) / maxLength, count - j) : 0; // Symbols that can't reach fastLimit
+			if (safe > 0)
+			{
+				for (size_t end = j + safe; j < end; j++)
+				{
+					unsigned short value = wideCodes.Decode(data, bitPosition);
+					output[2 * j] = (unsigned char)value; // Little-endian, just like we read it
+					output[2 * j + 1] = (unsigned char)(value >> 8);
+				}
+				continue;
+			}
+			if (data == input)
+			{
+				// We are close to the end of the input, so carry on from a copy of what is left of it
+				size_t tailStart = min(bitPosition >> 3, length);
+				memcpy(tail, input + tailStart, length - tailStart); // Less than 11 bytes, since fastLimit is 8 bytes from the end
+				data = tail;
+				bitPosition -= tailStart * 8;
+				dataBits = (length - tailStart) * 8;
+				fastLimit = 0;
+			}
+			unsigned short value = wideCodes.Decode(data, bitPosition);
+			output[2 * j] = (unsigned char)value;
+			output[2 * j + 1] = (unsigned char)(value >> 8);
+			j++;
+			if (bitPosition > dataBits)
+			{
+				reportError("Input file ended before all of its data was decoded");
+				return;
+			}
+		}
+		writeOutput(output, count * 2); // Write out the chunk
+		written += count;
+		if (data == input) inputPrefetch.Advance(inputPosition + (bitPosition >> 3)); // Let the prefetch thread know how far we've gotten
+	}
+	if (originalLength % 2 == 1)
+		writeOutput(&oddByte, 1); // The odd last byte came along in the header
+	bytesIn += length; // We read in all of the encoded data
+	inputPosition += length;
+}
+
+void Huffman::decodeFiltered()
+{
+	// Helper method that decodes a filtered file, right after its magic bytes. What follows the filter is a whole
+	// encoded file, so we decode it like any other, and writeOutput undoes the filter on everything it writes
+	unsigned char header[2]; // The filter and its parameter
+	if (!readInput(header, sizeof(header)) || !validFilter(header[0], header[1]) || outputFilter.IsActive()) // A filtered file inside a filtered file isn't something we write
+	{
+		reportError("Input file is not a valid filtered file");
+		return;
+	}
+	outputFilter.Start(header[0], header[1]);
+	decodeInput(); // Decode the file inside, which writes through our filter
+	outputFilter.Finish(filteredOutput); // Then write out whatever the filter was still holding on to
+	writeOutput(filteredOutput.data(), filteredOutput.size());
+}
+
+void Huffman::resetAdaptiveModel()
+{
+	// Helper method that starts our adaptive model over. Every symbol gets a count of 1, which gives
+	// every symbol an 8 bit code, so the start of the input costs what it would without encoding it
+	deleteTree(); // Adaptive codes don't use a tree, and whatever tree we had is about to lose its codes
+	int previousPhase = enterPhase(phaseTree);
+	fill(frequencyTable, frequencyTable + numChars, 1);
+	adaptiveTotal = numChars;
+	buildCanonicalLengths(true); // Every symbol needs a code, since any of them could come next
+	buildFastCodes(codeLengths, adaptiveCodes);
+	adaptiveUpdateGap = adaptiveUntilUpdate = adaptiveFirstUpdate; // Update early at first, while we know the least
+	enterPhase(previousPhase);
+}
+
+void Huffman::updateAdaptiveModel(const unsigned char* symbols, size_t length)
+{
+	// Helper method that counts symbols, which we just coded, into our model. Once adaptiveUntilUpdate
+	// symbols have been counted we build new codes from the counts. Rebuilding codes for every symbol (like
+	// FGK or Vitter do by reshaping the tree) would cost more than coding the symbol, so we rebuild in
+	// batches instead, every adaptiveFirstUpdate symbols at first and doubling up to adaptiveMaxUpdate.
+	// The encoder and decoder call this with the same symbols at the same points, so they stay in lockstep
+	countSymbols(symbols, length, frequencyTable);
+	adaptiveTotal += length;
+	adaptiveUntilUpdate -= (unsigned int)length; // Callers never give us more than adaptiveUntilUpdate symbols
+	if (adaptiveUntilUpdate > 0) return;
+	int previousPhase = enterPhase(phaseTree);
+	if (adaptiveTotal > adaptiveCountLimit)
+	{
+		// Halve every count so what we have seen lately outweighs what we saw long ago. Rounding up keeps every count at least 1
+		adaptiveTotal = 0;
+		for (int i = 0; i < numChars; i++)
+		{
+			frequencyTable[i] = (frequencyTable[i] + 1) / 2;
+			adaptiveTotal += frequencyTable[i];
+		}
+	}
+	buildCanonicalLengths(true); // Figure out the new code lengths, every symbol keeps a code
+	buildFastCodes(codeLengths, adaptiveCodes); // And the codes and decode tables that go with them
+	adaptiveUpdateGap = min(adaptiveUpdateGap * 2, adaptiveMaxUpdate);
+	adaptiveUntilUpdate = adaptiveUpdateGap;
+	enterPhase(previousPhase);
+}
+
+void Huffman::buildFastCodes(const unsigned char* lengths, fastCodes& table)
+{
+	// Helper method that hands out canonical codes for lengths, the same way buildCanonicalTree does, but without
+	// building a tree, encoding strings or full decode tables, since adaptive models do this thousands of times per file.
+	// Decoding looks up codes of up to fastLookupBits bits in lookup, and finds the length of longer ones with limits:
+	// canonical codes of each length come after every shorter code, so left aligned they only get bigger with their length
+	int lengthCounts[maxCanonicalLength + 1] = { 0 }; // How many codes there are of each length
+	for (int i = 0; i < numChars; i++)
+		lengthCounts[lengths[i]]++;
+	lengthCounts[0] = 0; // Symbols without a code don't take up any room
+	unsigned int nextCode[maxCanonicalLength + 1]; // The next code to hand out for each length
+	unsigned int code = 0;
+	int offset = 0; // Where the codes of the current length start in symbols
+	for (int length = 1; length <= maxCanonicalLength; length++)
+	{
+		// The first code of each length comes right after the last code of the length before it, with a 0 added on
+		code = (code + lengthCounts[length - 1]) << 1;
+		nextCode[length] = table.firstCodes[length] = code;
+		table.offsets[length] = offset;
+		table.limits[length] = (code + lengthCounts[length]) << (maxCanonicalLength - length);
+		offset += lengthCounts[length];
+	}
+	fill(table.lookup, table.lookup + (1 << fastLookupBits), 0); // Longer codes leave their entries empty
+	for (int i = 0; i < numChars; i++)
+	{
+		unsigned int length = lengths[i]; // The length of this symbol's code
+		unsigned int symbolCode = length > 0 ? nextCode[length]++ : 0; // Hand out the next code of this length
+		table.codes[i].bits = symbolCode;
+		table.codes[i].length = length;
+		if (length == 0) continue;
+		table.symbols[table.offsets[length] + symbolCode - table.firstCodes[length]] = (unsigned char)i;
+		if (length <= (unsigned int)fastLookupBits)
+		{
+			// Every value of the lookup bits that starts with this code decodes to this symbol
+			unsigned int first = symbolCode << (fastLookupBits - length);
+			fill(table.lookup + first, table.lookup + first + (1 << (fastLookupBits - length)), (unsigned short)(i | (length << 8)));
+		}
+	}
+}
+
+inline unsigned char Huffman::decodeFastSymbol(const fastCodes& table, const unsigned char* data, size_t& bitPosition)
+{
+	// Helper method that decodes one symbol. Every value of the next 15 bits decodes to some symbol since
+	// our codes are complete, so this never fails, the caller checks that we didn't run off of the end
+	unsigned int bits = peekBits(data, bitPosition, maxCanonicalLength); // The next 15 bits, enough for any code
+	unsigned int entry = table.lookup[bits >> (maxCanonicalLength - fastLookupBits)];
+	if (entry != 0)
+	{
+		// Most codes are short enough to look up directly
+		bitPosition += entry >> 8;
+		return (unsigned char)entry;
+	}
+	// Longer codes have to find their length first, then their place among the codes of that length
+	unsigned int codeLength = fastLookupBits + 1;
+	while (codeLength < (unsigned int)maxCanonicalLength && bits >= table.limits[codeLength])
+		codeLength++;
+	bitPosition += codeLength;
+	return table.symbols[table.offsets[codeLength] + (bits >> (maxCanonicalLength - codeLength)) - table.firstCodes[codeLength]];
+}
+
+size_t Huffman::encodeAdaptiveFrame(const unsigned char* data, size_t length, vector<unsigned char>& output)
+{
+	// Helper method that encodes data into output with our adaptive model. We code symbols up to the next
+	// update with the codes we have, let the model count them (and maybe update), and carry on from there.
+	// The last byte is padded with 0s, the frame stores its length so the padding never gets decoded
+	if (output.size() < length * 2 + 8)
+		output.resize(length * 2 + 8); // No code is longer than 15 bits, so every symbol takes less than 2 bytes, plus a word the writer might write
+	BitWriter writer; // The writer that packs our codes into bytes
+	writer.position = output.data();
+	for (size_t i = 0; i < length;)
+	{
+		size_t segment = min((size_t)adaptiveUntilUpdate, length - i); // The symbols we can code before the codes change
+		for (size_t j = i; j < i + segment; j++)
+			writer.putBits(adaptiveCodes.codes[data[j]].bits, adaptiveCodes.codes[data[j]].length); // Adaptive codes always fit in one write
+		updateAdaptiveModel(data + i, segment); // Let the model see what we coded
+		i += segment;
+	}
+	writer.flushBytes(); // Write out any whole bytes still waiting in the writer
+	if (writer.bitCount > 0)
+	{
+		writer.putBits(0, 8 - writer.bitCount); // Then pad out the last byte
+		writer.flushBytes();
+	}
+	return writer.position - output.data();
+}
+
+bool Huffman::decodeAdaptiveFrame(const unsigned char* data, size_t length, unsigned char* output, size_t outputLength)
+{
+	// Helper method that decodes outputLength symbols out of data with our adaptive model, which has to
+	// be in the same state the encoder's was in when it started this frame. Like the encoder we decode up to
+	// the next update, let the model count what we decoded, and carry on with the new codes. Our codes are
+	// complete, so the only way a corrupt frame shows up is by running out of bits
+	size_t totalBits = length * 8; // The number of bits in the frame
+	size_t bitPosition = 0; // The bit we are at, always at the start of a code
+	for (size_t i = 0; i < outputLength;)
+	{
+		size_t segment = min((size_t)adaptiveUntilUpdate, outputLength - i); // The symbols we can decode before the codes change
+		for (size_t j = i; j < i + segment; j++)
+		{
+			output[j] = decodeFastSymbol(adaptiveCodes, data, bitPosition);
+			if (bitPosition > totalBits) return false; // That code ran off of the end of the frame
+		}
+		updateAdaptiveModel(output + i, segment); // Let the model see what we decoded, just like the encoder did
+		i += segment;
+	}
+	return true;
+}
+
+void Huffman::writeAdaptiveFrame(const unsigned char* data, size_t length, vector<unsigned char>& encoded)
+{
+	// Helper method that encodes data as one frame and writes it out. Each frame starts with its original
+	// and encoded lengths as varints, which for short messages takes 2 bytes instead of a fixed size header
+	enterPhase(phaseCode);
+	size_t encodedLength = encodeAdaptiveFrame(data, length, encoded); // Encode the frame
+	unsigned char header[2 * maxVarintSize]; // The frame's lengths
+	size_t headerLength = storeVarint(header, length);
+	headerLength += storeVarint(header + headerLength, encodedLength);
+	writeOutput(header, headerLength); // Write out the lengths
+	writeOutput(encoded.data(), encodedLength); // Then the encoded frame
+}
+
+void Huffman::decodeAdaptive()
+{
+	// Helper method that decodes the frames of an adaptive file or stream, right after its magic bytes,
+	// until we reach the end marker. Our model starts out the same way the encoder's did and sees the same
+	// symbols in the same order, so it always has the codes the encoder used
+	resetAdaptiveModel(); // Start out the same way the encoder did
+	vector<unsigned char> encoded; // Buffer for each encoded frame
+	vector<unsigned char> decoded; // Buffer for each decoded frame
+	while (true)
+	{
+		unsigned long long originalLength = 0; // The length of the frame before it was encoded
+		unsigned long long encodedLength = 0; // The length of the encoded frame
+		if (!readVarint(originalLength))
+		{
+			reportError("Adaptive input ended before its end marker");
+			return;
+		}
+		if (originalLength == 0) return; // A length of 0 is our end marker
+		// No frame holds more than streamChunkSize symbols, and no code is longer than 15 bits, so every symbol takes less than 2 bytes
+		if (originalLength > (unsigned long long)streamChunkSize || !readVarint(encodedLength) || encodedLength > originalLength * 2)
+		{
+			reportError("Adaptive frame is corrupt");
+			return;
+		}
+		if (encoded.size() < encodedLength + 8)
+			encoded.resize((size_t)encodedLength + 8); // Make room for the frame, and 8 more bytes that peekBits can read past the end of it
+		if (!readStreamBytes(encoded.data(), (size_t)encodedLength))
+		{
+			reportError("Input ended in the middle of an adaptive frame");
+			return;
+		}
+		memset(encoded.data() + encodedLength, 0, 8); // Whatever we peek at past the end should be the same every time
+		decoded.resize((size_t)originalLength);
+		enterPhase(phaseCode);
+		if (!decodeAdaptiveFrame(encoded.data(), (size_t)encodedLength, decoded.data(), (size_t)originalLength))
+		{
+			reportError("Adaptive frame is corrupt");
+			return;
+		}
+		writeOutput(decoded.data(), (size_t)originalLength); // Write it out
+		if (inputIsStdin)
+			outputTarget->flush(); // And push it along right away when we are streaming
+		else
+			inputPrefetch.Advance(inputPosition); // Or let the prefetch thread know how far we've gotten
+	}
+}
+
+bool Huffman::readVarint(unsigned long long& value)
+{
+	// Helper method that reads one varint a byte at a time, the low 7 bits of each byte holding the next 7 bits
+	// of the number (lowest first) and the high bit saying whether another byte follows
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		unsigned char byte;
+		if (!readStreamBytes(&byte, 1)) return false;
+		value |= (unsigned long long)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) return true; // That was the last byte
+	}
+	return false; // Too many bytes for a 64 bit number, so it can't be one of ours
+}
+
+size_t Huffman::storeVarint(unsigned char* bytes, unsigned long long value)
+{
+	// Helper method that stores value as a varint, the mirror image of readVarint
+	size_t count = 0;
+	while (value >= 0x80)
+	{
+		bytes[count++] = (unsigned char)(value | 0x80); // The low 7 bits, and a flag saying more follow
+		value >>= 7;
+	}
+	bytes[count++] = (unsigned char)value; // The last byte has the flag clear
+	return count;
+}
+
+void Huffman::useStandardStreams()
+{
+	// Helper method that switches us over to reading standard input and writing standard output
+	resetState(); // Clear out anything left over from the last thing we did
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY); // Windows opens these in text mode, which would mangle our binary data
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	ios::sync_with_stdio(false); // We don't mix in any C style I/O, and without syncing cin and cout can read and write in large blocks
+	cin.tie(nullptr); // Don't flush our output every time we read, we flush after each chunk ourselves
+	inputIsStdin = true;
+	outputTarget = &cout;
+}
+
+void Huffman::writeOutput(const void* data, size_t length)
+{
+	// Helper method that writes data to wherever our output is going, and counts it in bytesOut
+	int previousPhase = currentPhase; // Whatever we were doing before, to go back to once we have written
+	if (outputFilter.IsActive())
+	{
+		// We are decoding a filtered file, so put the original bytes back before they go anywhere
+		enterPhase(phaseFilter);
+		outputFilter.Decode((const unsigned char*)data, length, filteredOutput);
+		data = filteredOutput.data();
+		length = filteredOutput.size();
+	}
+	enterPhase(phaseWrite); // Time spent writing is its own phase
+	if (bytesOut + length > outputLimit)
+	{
+		// This would take us over our limit, so fail instead and throw away the rest of our output
+		if (!failed)
+			reportError("Output would be larger than the limit of " + formatNumber(outputLimit) + " bytes");
+		enterPhase(previousPhase);
+		return;
+	}
+	if (memoryOutput != nullptr)
+		memoryOutput->insert(memoryOutput->end(), (const unsigned char*)data, (const unsigned char*)data + length); // Encoding or decoding into memory
+	else if (asyncOutput.IsRunning())
+		asyncOutput.Write(data, length); // Hand it off to the writer thread
+	else
+		outputTarget->write((const char*)data, length);
+	bytesOut += length;
+	enterPhase(previousPhase); // And go back to what we were doing
+}
+
+void Huffman::reportError(string message)
+{
+	// Helper method that records that something went wrong, so the buffer methods can hand back false
+	// and LastError can tell the caller why. Files and streams print the message like always, but when we
+	// are working on memory buffers we leave it up to the caller what to do about it
+	failed = true;
+	lastError = message;
+	if (memoryOutput == nullptr)
+		messageStream() << message << endl;
+}
+
+ostream& Huffman::messageStream()
+{
+	// Helper method that returns where our messages go. Normally that is cout, but when our
+	// output is going to standard output the messages would get mixed into the data, so we use cerr
+	if (outputTarget == &cout) return cerr;
+	return cout;
+}
+
+int Huffman::readFormat()
+{
+	// Helper method that checks which format our input file is in. Our newer formats start with
+	// the magic bytes 'H' 'F' followed by a byte saying which format it is. An original file can
+	// never start that way, since its first two bytes are a merge pair and the first index of a
+	// pair is always smaller than the second. If the magic isn't there we leave our position alone
+	const unsigned char* input = inputMap.Data() + inputPosition; // Where we are in the input
+	if (inputMap.Size() - inputPosition >= 3 && input[0] == 'H' && input[1] == 'F')
+	{
+		inputPosition += 3; // Move past the magic bytes and format
+		bytesIn += 3;
+		return input[2]; // And hand back which format it is
+	}
+	return originalFormat; // Otherwise this is an original file
+}
+
+bool Huffman::readInput(void* destination, size_t length)
+{
+	// Helper method that copies the next length bytes of our input into destination, for the
+	// headers at the start of our files. Returns false if the input doesn't have that many bytes left
+	if (inputMap.Size() - inputPosition < length) return false;
+	memcpy(destination, inputMap.Data() + inputPosition, length); // Copy the bytes out of the mapping
+	inputPosition += length; // And move past them
+	bytesIn += length;
+	return true;
+}
+
+string Huffman::defaultOutputFile(string inputFile, string extension)
+{
+	// Helper method that figures out an output file name from the input file name,
+	// by replacing its extension with the one we are given
+	auto dotLoc = inputFile.find("."); // Check if a . exists in the inputFile name
+	if (dotLoc == string::npos)
+	{
+		// If there isn't a . in the inputFile name, simply append the extension
+		return inputFile + extension;
+	}
+	// Otherwise, grab the substring before that dot and add the extension onto that
+	return inputFile.substr(0, dotLoc) + extension;
+}
+
+void Huffman::closeFiles()
+{
+	// Helper method to close out any files we have open, which flushes whatever is left of our output
+	enterPhase(phaseWrite);
+	inputPrefetch.Stop(); // Stop reading ahead, before we unmap what it is reading
+	if (asyncOutput.IsRunning() && !asyncOutput.Finish())
+		reportError("Failed writing to the output file"); // Wait for the writer thread to write out everything we gave it
+	if (inputMap.IsOpen())
+		inputMap.Close(); // If the input is open, unmap it
+	if (outputStream.is_open())
+		outputStream.close(); // If the outputStream is open, close it
+	if (treeStream.is_open())
+		treeStream.close(); // If the treeSteam is open, close it
+}
+
+void Huffman::printActionDetail()
+{
+	// Helper method to print out information for what work we did. We used to divide clock() by 1000,
+	// which only gave seconds where CLOCKS_PER_SEC is 1000 (not on Linux, where it is a million) and
+	// measured CPU time instead of how long the user actually waited, so now we use wall time
+	ostream& messages = messageStream(); // Where we print to, standard error instead of cout if our output is going to standard output
+	if (statsFormat == statsJson)
+	{
+		messages << StatsJson() << endl; // One JSON object on its own line, for whatever is collecting them
+		return;
+	}
+	double secondsElapsed = elapsedSeconds(); // Determine the amount of seconds elapsed from when we started our work on the file
+	messages << "Time: " << secondsElapsed << " seconds.   "; // Output the elapsed time followed by a few spaces
+	messages << "Bytes in / Bytes Out: " << formatNumber(bytesIn) << " / " << formatNumber(bytesOut) << endl; // Output our nicely formatted bytesIn and bytesOut numbers using a helper method below
+	if (sampledBytes > 0)
+		messages << "Sampled " << formatNumber(sampledBytes) << " bytes for the tree, estimated ratio loss: " << sampleLoss * 100 << "%" << endl; // What sampling cost us, if we sampled
+	if (statsFormat == statsText)
+	{
+		// Then how long each phase took, along with our throughput and ratio
+		const char* names[phaseCount] = { "Read", "Histogram", "Tree", "Code table", "Encode/decode", "Write", "Filter" };
+		for (int phase = 0; phase < phaseCount; phase++)
+			messages << "  " << names[phase] << ": " << phaseSeconds[phase] * 1000 << " ms" << endl;
+		messages << "  Throughput: " << (secondsElapsed > 0 ? bytesIn / secondsElapsed / 1e6 : 0) << " MB/s in, " << (secondsElapsed > 0 ? bytesOut / secondsElapsed / 1e6 : 0) << " MB/s out   Ratio (out / in): " << (bytesIn > 0 ? (double)bytesOut / bytesIn : 0) << endl;
+	}
+}
+
+string Huffman::StatsJson()
+{
+	// This method returns the stats for the last operation as one JSON object: the byte counts,
+	// the wall time, throughput of the input and output, the ratio of output to input, and, when per-phase timing is turned on,
+	// the seconds spent in each phase
+	double secondsElapsed = elapsedSeconds();
+	ostringstream json; // Only numbers and fixed names go in here, so nothing needs escaping
+	json << "{\"bytes_in\":" << bytesIn << ",\"bytes_out\":" << bytesOut << ",\"seconds\":" << secondsElapsed;
+	json << ",\"in_mb_per_second\":" << (secondsElapsed > 0 ? bytesIn / secondsElapsed / 1e6 : 0);
+	json << ",\"out_mb_per_second\":" << (secondsElapsed > 0 ? bytesOut / secondsElapsed / 1e6 : 0);
+	json << ",\"ratio\":" << (bytesIn > 0 ? (double)bytesOut / bytesIn : 0) << ",\"failed\":" << (failed ? "true" : "false");
+	if (sampledBytes > 0)
+		json << ",\"sampled_bytes\":" << sampledBytes << ",\"sample_ratio_loss\":" << sampleLoss;
+	if (statsFormat != statsSummary)
+	{
+		const char* names[phaseCount] = { "read", "histogram", "tree", "code_table", "code", "write", "filter" };
+		json << ",\"phases\":{";
+		for (int phase = 0; phase < phaseCount; phase++)
+			json << (phase > 0 ? "," : "") << "\"" << names[phase] << "\":" << phaseSeconds[phase];
+		json << "}";
+	}
+	json << "}";
+	return json.str();
+}
+
+void Huffman::SetStatsFormat(int format)
+{
+	// This method sets how much we report after each operation. Timing each phase only happens
+	// for statsText and statsJson, the rest of the time our phase hooks just check a flag
+	statsFormat = format;
+	timingPhases = format != statsSummary;
+}
+
+int Huffman::enterPhase(int phase)
+{
+	// Helper method that switches which phase we are timing, returning the one we were in so the
+	// caller can switch back. When timing is off all we do is remember the phase
+	int previousPhase = currentPhase;
+	currentPhase = phase;
+	if (timingPhases && phase != previousPhase)
+	{
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		phaseSeconds[previousPhase] += chrono::duration<double>(now - phaseStart).count(); // The time since the last switch belongs to the phase we were in
+		phaseStart = now;
+	}
+	return previousPhase;
+}
+
+double Huffman::elapsedSeconds()
+{
+	// Helper method that returns the wall time since the current operation started, first giving
+	// the phase we are in its time so far so the phases add up to the total
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	if (timingPhases)
+	{
+		phaseSeconds[currentPhase] += chrono::duration<double>(now - phaseStart).count();
+		phaseStart = now;
+	}
+	return chrono::duration<double>(now - start).count();
 }
 
-string Huffman::formatNumber(unsigned int num)
+string Huffman::formatNumber(unsigned long long num)
 {
-	// Helper method that formats an unsigned int we take as a parameter
+	// Helper method that formats an unsigned long long we take as a parameter
 	// to contain commas in the appropriate places (American format, not using period like some European countries)
 	string number = to_string(num); // Turn the number into a string
 	for (int i = number.length() - 3; i > 0; i -= 3) // Starting 3 in from the end of the string, and looping through decrementing by 3 each time, until we reach the beginning of the string
@@ -494,9 +3651,9 @@ string Huffman::formatNumber(unsigned int num)
 	return number; // Return our nicely formatted number!
 }
 
-bool Huffman::isLeaf(node* node)
+bool Huffman::isLeaf(unsigned short index)
 {
 	// Helper method to check if a node is a leaf
-	// If both children are null, the node is a leaf
-	return node->left == nullptr && node->right == nullptr;
+	// If it has no children, the node is a leaf
+	return tree[index].left == noNode && tree[index].right == noNode;
 }
\ No newline at end of file
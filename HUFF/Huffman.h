@@ -11,7 +11,14 @@
 #pragma once
 #include <string>
 #include <fstream>
-#include <time.h>
+#include <chrono>
+#include <vector>
+#include <map>
+#include "BitIO.h"
+#include "MappedFile.h"
+#include "Pipeline.h"
+#include "SymbolCodes.h"
+#include "Filter.h"
 using namespace std;
 
 class Huffman
@@ -22,44 +29,292 @@ public:
 	void MakeTreeBuilder(string inputFile, string outputFile); // Makes a tree builder file from inputFile in the specified outputFile
 	void EncodeFile(string inputFile, string outputFile); // Encodes inputFile into outputFile (will also contain tree builder information in the first 510 bytes)
 	void DecodeFile(string inputFile, string outputFile); // Decodes inputFile into outputFile
+	void DecodeFileRange(string inputFile, unsigned long long offset, unsigned long long length, string outputFile); // Decodes just length bytes starting at offset of the original file out of inputFile into outputFile
 	void EncodeFileWithTree(string inputFile, string treeFile, string outputFile); // Encodes inputFile, using the tree builder information in treeFile, into outputFile
+	void EncodeFileCanonical(string inputFile, string outputFile); // Encodes inputFile into outputFile using length limited canonical codes, with a compact header
+	void MakeCanonicalTreeBuilder(string inputFile, string outputFile); // Makes a compact canonical tree file from inputFile in the specified outputFile
+	void GenerateCodec(string treeFile, string codecName, string outputFile); // Writes a header into outputFile defining codecName, a StaticCodec that encodes and decodes with the tree in treeFile using tables built by the compiler
+	void EncodeFileParallel(string inputFile, string outputFile); // Encodes inputFile into outputFile as independently decodable blocks, using every core
+	void EncodeFileInterleaved(string inputFile, string outputFile, int streamCount); // Encodes inputFile into outputFile with each block split into streamCount (4 or 8) bitstreams that decode side by side
+	void TrainTree(const vector<string>& corpusFiles); // Builds a canonical tree from the combined symbols of every file in corpusFiles and saves it in the tree store under its ID
+	void EncodeFileWithTrainedTree(string inputFile, string treeId, string outputFile); // Encodes inputFile into outputFile with the trained tree treeId, storing just the ID instead of the tree
+	void SetTreeStore(string directory); // Sets the directory trained trees are saved in and loaded from
+	void SetOverlappedIO(bool enabled); // Turns overlapping our reading, encoding or decoding, and writing of large files on threads of their own on or off (on by default)
+	void SetSampledHistogram(bool enabled); // Makes encoding large files build its tree from evenly spaced samples of the input instead of all of it, so the input is only read once (off by default)
+	void SetOutputLimit(unsigned long long limit); // Makes any operation that would write more than limit bytes fail instead, so a corrupt header can't make a buffer method grow the caller's buffer without end (no limit by default)
+	void SetCheckpointInterval(unsigned int interval); // Makes canonical files and buffers record a checkpoint every interval bytes (at least minCheckpointInterval), so ranges can be decoded without the rest, 0 turns them off
+	void EncodeStream(); // Encodes standard input onto standard output in chunks, each with its own tree, so it works in a pipeline
+	void DecodeStream(); // Decodes a stream written by EncodeStream or EncodeStreamAdaptive from standard input onto standard output
+	void EncodeFileContext(string inputFile, string outputFile); // Encodes inputFile into outputFile with order 1 codes, coding each symbol with a code table picked by the symbol before it
+	void EncodeFileWide(string inputFile, string outputFile); // Encodes inputFile into outputFile with 16 bit symbols, coding each little-endian pair of bytes as one symbol
+	void EncodeFileFiltered(string inputFile, string outputFile, string filterName); // Runs inputFile through a reversible filter (or the one that suits it best) and encodes the result into outputFile with canonical codes
+	void EncodeFileAdaptive(string inputFile, string outputFile); // Encodes inputFile into outputFile in one pass with adaptive codes, without storing any tree
+	void EncodeStreamAdaptive(); // Encodes standard input onto standard output with adaptive codes, writing out each piece of input as soon as it arrives
+	void BuildSharedTree(const unsigned char* sample, size_t length); // Builds a canonical tree from sample that every following EncodeBuffer uses, instead of building one per buffer
+	void ClearSharedTree(); // Goes back to building a new tree for each buffer
+	bool UseTrainedTree(string treeId); // Loads trained tree treeId from the tree store as our shared tree, so every following EncodeBuffer references it by ID, returning false if it isn't there
+	bool EncodeBuffer(const unsigned char* data, size_t length, vector<unsigned char>& output); // Encodes data onto the end of output, returning false if something went wrong
+	bool EncodeBuffer(const unsigned char* data, size_t length, unsigned char* output, size_t capacity, size_t& outputLength); // Encodes data into a buffer of capacity bytes, setting outputLength, returning false if it didn't fit
+	bool EncodeBufferWithTree(const unsigned char* data, size_t length, const unsigned char* treeData, size_t treeLength, vector<unsigned char>& output); // Encodes data onto the end of output with the tree in treeData (the contents of a -t or -tc tree file), giving exactly what -et writes
+	bool DecodeBuffer(const unsigned char* data, size_t length, vector<unsigned char>& output); // Decodes data (in any of our formats) onto the end of output, returning false if it was corrupt
+	bool DecodeBuffer(const unsigned char* data, size_t length, unsigned char* output, size_t capacity, size_t& outputLength); // Decodes data into a buffer of capacity bytes, setting outputLength, returning false if it was corrupt or didn't fit
+	bool DecodeBufferRange(const unsigned char* data, size_t length, unsigned long long offset, unsigned long long count, vector<unsigned char>& output); // Decodes just count bytes starting at offset of the original data onto the end of output, returning false if it was corrupt
+	static string TreeKey(const unsigned char* data, size_t length); // Returns the bytes that pick out the tree encoded data was written with, so inputs sharing a tree can go to an object that already has it built, or an empty string if its tree can't be reused
+	static size_t EncodedBufferBound(size_t length); // Returns the most bytes EncodeBuffer can take for length bytes of data
+	string LastError(); // Returns the message for the last thing that went wrong, or an empty string
+	void SetStatsFormat(int format); // Sets what we report after each operation: statsSummary (the default), statsText or statsJson, the last two also time each phase
+	string StatsJson(); // Returns the byte counts, timings, throughput and ratio of the last operation as one JSON object
+	const static int statsSummary = 0; // Report just the total time and bytes in and out
+	const static int statsText = 1; // Report the summary and how long each phase took
+	const static int statsJson = 2; // Report everything as one JSON object instead
+	const static int maxTreeFileSize = 510; // The largest a -t or -tc tree file can be, a full set of tree builder information (a compact canonical tree is much smaller)
 	void DisplayHelp(); // Displays Help information
 
 private:
+	const static int numChars = 256; // Constant to keep track of the number of distinct characters we have, in this case 256, to represent 0-255 in ASCII
+	constexpr static unsigned short noNode = 0xFFFF; // The index we use for a child (or a slot in nodes[]) that doesn't have a node
 	struct node // Basic node struct used as the baseline for our huffman trees 
 	{
-		unsigned char symbol; // The ASCII symbol this node represents, only matters in the leaves
-		unsigned int weight; // The weight of the node, either the frequency that the symbol occurs, or the added weights of the children
-		node* left = nullptr; // Left child node
-		node* right = nullptr; // Right child node
+		unsigned long long weight = 0; // The weight of the node, either the frequency that the symbol occurs, or the added weights of the children
+		unsigned short left = noNode; // Index of the left child node in tree[]
+		unsigned short right = noNode; // Index of the right child node in tree[]
+		unsigned char symbol = 0; // The ASCII symbol this node represents, only matters in the leaves
 	};
-	const static int numChars = 256; // Constant to keep track of the number of distinct characters we have, in this case 256, to represent 0-255 in ASCII
-	unsigned int frequencyTable[numChars]; // A frequency table array, keeps track of the count of each character
-	node* nodes[numChars]; // An array of nodes to be used to build the huffman tree
+	unsigned long long frequencyTable[numChars]; // A frequency table array, keeps track of the count of each character (64 bits, so inputs over 4 GB can't overflow it)
+	node tree[2 * numChars - 1]; // Every node of our huffman tree, leaves and parents, in one block so building a tree never allocates anything
+	int nodeCount = 0; // The number of nodes in tree[] that are in use
+	unsigned short nodes[numChars]; // The index in tree[] of the node in each of the slots we merge in while building a tree, once it is built nodes[0] is the root
 	string encodingStrings[numChars]; // An array of encoding strings used to keep track of the path in the tree to each character
 	string paddingBits = ""; // An initially empty string that we will eventually fill with a path > 7 to ensure we have sufficient padding when encoding
-	ifstream inputStream; // A stream used for our input files
+	struct codeEntry // The code for a single symbol, stored as a number so we can write it out all at once
+	{
+		unsigned int bits; // The bits of the code, right aligned, with the first bit of the path as the highest one (only valid for codes up to 32 bits)
+		unsigned int length; // The number of bits in the code
+	};
+	codeEntry codeTable[numChars]; // The codes for every symbol, built from encodingStrings
+	bool codeTableCurrent = false; // Whether encodingStrings and codeTable were built from the tree we have now
+	const static int maxCanonicalLength = 15; // The longest code we allow in a canonical tree, which also lets each length fit in 4 bits
+	const static int maxCanonicalTreeSize = 2 + numChars / 2; // The most bytes a compact canonical tree can take
+	unsigned char codeLengths[numChars]; // The length of each symbol's code in a canonical tree, 0 for symbols without a code
+	unsigned int maxCodeLength = 0; // The length of the longest code in codeTable, so we know how much room encoding can take
+	MappedFile inputMap; // Our input file, memory mapped so we can read it in place
+	size_t inputPosition = 0; // How far into inputMap we've read, used while reading file headers
 	ifstream treeStream; // A stream used optionally for a secondary input for a separate tree file
 	ofstream outputStream; // A stream used for our output files
-	unsigned int bytesIn = 0; // Unsigned int to keep track of the amount of bytes we read in, so we can output this number eventually
-	unsigned int bytesOut = 0; // Unsigned int to keep track of the amount of bytes we print out, so we can output this number eventually
-	clock_t start = clock(); // The time we started running the program in clock ticks, so we can keep track of how long our program runs
-	//int powersOf2[8] = { 128, 64, 32, 16, 8, 4, 2, 1 }; // This array would have been used when decoding but it turns out the code benchmarks faster without it, see decode() for more info
+	ostream* outputTarget = &outputStream; // Where writeOutput sends our output, either outputStream or standard output when streaming
+	bool inputIsStdin = false; // Whether we are reading standard input instead of inputMap
+	bool overlappedIO = true; // Whether we overlap reading, working and writing for large files
+	const static size_t overlapThreshold = (size_t)4 << 20; // The smallest input worth starting up the prefetch and writer threads for
+	const static size_t countSliceSize = (size_t)16 << 20; // How much of a large input we count at a time, so prefetching can stay ahead of counting
+	unsigned long long outputLimit = ~0ULL; // The most bytes one operation may write, see SetOutputLimit
+	bool sampledHistogram = false; // Whether we build our tree from samples of large inputs instead of counting all of them
+	const static int sampleCount = 256; // How many evenly spaced samples of the input we count
+	const static size_t sampleSize = (size_t)64 << 10; // The size of each sample, 16 MB all together
+	const static size_t sampleThreshold = (size_t)sampleCount * sampleSize * 4; // The smallest input we sample, below this counting all of it costs little more
+	unsigned long long sampledBytes = 0; // How much of the input the frequency table was counted from when we sampled it, 0 when we counted all of it
+	double sampleLoss = 0; // About how much bigger our output is than a tree from the whole input would have made it, as a fraction, when we sampled
+	AsyncWriter asyncOutput; // Writes our output to outputStream on its own thread, when it is running
+	InputPrefetcher inputPrefetch; // Reads our mapped input into memory ahead of us on its own thread, when it is running
+	InverseFilter outputFilter; // Undoes the filter of a filtered file on everything writeOutput writes, while we decode one
+	vector<unsigned char> filteredOutput; // The bytes outputFilter hands back for each write
+	vector<unsigned char> filteredInput; // Our input after running it through a filter, which we encode in place of the file
+	vector<unsigned char>* memoryOutput = nullptr; // When we are encoding or decoding into memory, the buffer writeOutput appends onto instead of outputTarget
+	vector<unsigned char> scratchBuffer; // Output buffer we reuse for the calls that write into a caller's fixed size buffer
+	bool hasSharedTree = false; // Whether our tree came from BuildSharedTree, so EncodeBuffer should use it as is
+	vector<unsigned char> sharedTreeData; // The compact form of our shared tree, so decoding can spot buffers that use it
+	bool decodeTableCurrent = false; // Whether decodeTable was built from the tree we have now
+	vector<unsigned char> treeSource; // The tree builder information or compact canonical tree our tree was built from, so we can skip building it again when the next input uses the same one
+	bool sharedTreeTrained = false; // Whether our shared tree is a trained tree, so EncodeBuffer writes its ID instead of the tree
+	unsigned long long sharedTreeId = 0; // The ID of our shared tree when it is a trained tree
+	string treeStore = "trees"; // The directory trained trees are saved in and loaded from
+	bool trainedTreeLoaded = false; // Whether the tree we have now is the trained tree loadedTreeId, with its decode tables
+	unsigned long long loadedTreeId = 0; // Which trained tree we have now, when trainedTreeLoaded is set
+	bool failed = false; // Whether something went wrong during the current operation
+	string lastError = ""; // The message for the last thing that went wrong
+	struct decodeEntry // One slot of our decode lookup table, found by peeking at the next few bits of the input
+	{
+		unsigned char symbols[4]; // The symbols that the peeked bits decode to, in order
+		unsigned char symbolCount; // How many of the symbols are valid, 0 means the code is too long for this table and we need to follow subTable
+		unsigned char bitsUsed; // The number of bits the symbols take up, or when symbolCount is 0, the number of bits this table looked at
+		unsigned short subTable; // When symbolCount is 0, the number of the secondary table to continue decoding in
+	};
+	const static int rootTableBits = 11; // Number of bits we look at with each lookup in the main decode table, 2^11 entries keeps it inside the L1 cache
+	const static int subTableBits = 8; // Number of bits we look at with each lookup in a secondary table, used for codes longer than rootTableBits
+	const static int maxSymbolsPerEntry = 4; // The most symbols a single decode table entry can hold
+	const static int decodeSlackBytes = 48; // Bytes we keep back from the end of a buffer so the fast decoder can peek past any code (up to 255 bits) safely
+	const static int inputChunkSize = 1 << 20; // How many bytes we read from the input at a time when decoding
+	vector<decodeEntry> decodeTable; // Our decode lookup table, the root table first followed by all of the secondary tables
+	const static size_t speculativeSegmentSize = (size_t)1 << 20; // How much encoded data each thread decodes when we split up a file with no block index
+	const static int syncWindowBits = 1 << 15; // How many bits at the start of a segment we note every symbol boundary in, a segment's decode has to line up with the true boundaries in here
+	struct speculativeSegment // One piece of a single bitstream, decoded by a thread from where the piece starts rather than from a known symbol boundary
+	{
+		vector<unsigned char> output; // What the segment decoded to, only valid from the first true symbol boundary on
+		size_t outputSize = 0; // How many bytes of output are valid
+		vector<size_t> boundaries; // The bit each of the first symbols of output starts at, boundaries[i] for output[i]
+		size_t stopBit = 0; // The symbol boundary we stopped at, at or just past the end of the segment
+	};
+	struct trainedTree // A trained tree we have already loaded from the tree store
+	{
+		vector<unsigned char> treeData; // Its compact form
+		vector<decodeEntry> decodeTable; // And the decode tables built from it, so we never have to build them again
+	};
+	map<unsigned long long, trainedTree> trainedTrees; // Every trained tree we have loaded, by ID, kept for as long as this object lives
+	const static int treeBuilderSize = 510; // Size of our tree builder information, 255 merge pairs of 2 bytes each
+	const static int originalFormat = 0; // readFormat's answer for a file in the original format, a 510 byte tree followed by the encoded data
+	const static int blockFormat = 'B'; // Format byte for a block container written by EncodeFileParallel
+	const static int blockHeaderSize = 19; // Size of a block container's header: magic bytes, format, block size, input size and block count
+	const static int blockSize = 1 << 20; // The number of input bytes in each block of a block container
+	const static int streamFormat = 'S'; // Format byte for a stream written by EncodeStream
+	const static int streamChunkSize = 1 << 20; // The most input bytes EncodeStream puts in one chunk, which bounds how much memory streaming takes
+	const static int streamChunkHeaderSize = 9; // Size of a stream chunk's header: original length, encoded length and tree type
+	const static int interleavedFormat = 'I'; // Format byte for a file written by EncodeFileInterleaved
+	const static int interleavedHeaderSize = 16; // Size of an interleaved file's header: magic bytes, format, block size, input size and stream count
+	const static int maxStreams = 8; // The most bitstreams an interleaved block can be split into
+	const static int maxLookupBits = 15; // The most bits a single decode table lookup can use, either several short codes in the root table or one code of up to maxCanonicalLength bits
+	const static int mergeListTree = 0; // Tree type byte for a tree stored as our 510 byte tree builder information
+	const static int canonicalTree = 1; // Tree type byte for a tree stored as compact canonical code lengths
+	const static int canonicalFormat = 'C'; // Format byte for a file encoded with canonical codes, which also stores the original length
+	const static int treeFileFormat = 'T'; // Format byte for a canonical tree file made by MakeCanonicalTreeBuilder
+	const static int referenceFormat = 'R'; // Format byte for a file encoded with a trained tree, which stores the tree's ID instead of the tree
+	const static int checkpointFormat = 'K'; // Format byte for a canonical file with a checkpoint index at the end, so ranges can be decoded on their own
+	const static unsigned int defaultCheckpointInterval = 1 << 16; // How many bytes of the original file -ek puts between checkpoints
+	constexpr static unsigned int minCheckpointInterval = 1 << 12; // The closest together we allow checkpoints, so the index stays small
+	const static int rangeChunkSize = 1 << 16; // How many encoded bytes we decode at a time when decoding a range, so we never go far past the end of it
+	unsigned int checkpointInterval = 0; // How many bytes of the original go between checkpoints in the canonical files and buffers we write, 0 for none
+	const static int storedFormat = 'N'; // Format byte for a file kept as it is, because coding it wouldn't have made it any smaller
+	const static int storedHeaderSize = 11; // Size of a stored file's header: magic bytes, format and original length
+	const static int storedChunk = 2; // Tree type byte for a stream chunk kept as it is, with no tree
+	const static unsigned long long storedBlockFlag = 1ULL << 63; // Set on a block container's index entry when that block is kept as it is
+	const static unsigned int storedStreams = 0xFFFFFFFF; // Stream length that marks an interleaved block kept as it is, in place of its streams
+	const static int fastLookupBits = 9; // Number of bits a fastCodes lookup table looks at, codes longer than this are found by comparing against its limits
+	struct fastCodes // Canonical codes for one set of code lengths, with small tables to encode and decode them one symbol at a time. They take
+	{                // microseconds to build, so adaptive models can rebuild them thousands of times per file, and few enough bytes that an order 1 model keeps dozens in the L1 cache
+		codeEntry codes[numChars]; // The code of every symbol
+		unsigned short lookup[1 << fastLookupBits]; // For every value of the next fastLookupBits bits, the symbol of a code that fits in them in the low byte and its length in the high byte, or 0 for a longer code
+		unsigned int limits[maxCanonicalLength + 1]; // For each code length, one past the last code of that length, left aligned to maxCanonicalLength bits
+		unsigned int firstCodes[maxCanonicalLength + 1]; // The first code of each length
+		int offsets[maxCanonicalLength + 1]; // Where the codes of each length start in symbols
+		unsigned char symbols[numChars]; // Every symbol with a code, in order of code length and then symbol, which is the order canonical codes are handed out in
+	};
+	const static int contextFormat = 'O'; // Format byte for a file encoded with order 1 codes, a set of code tables picked between by the previous byte
+	const static int contextHeaderSize = 268; // Size of an order 1 file's header before its tables: magic bytes, format, original length, table count and the table each previous byte uses
+	const static int maxContextTables = 32; // The most code tables an order 1 file can have, previous bytes that are followed by similar symbols share a table
+	const static int contextClusterRounds = 4; // How many times we move each previous byte to the table that suits it best before merging tables
+	vector<fastCodes> contextCodes; // The code tables of our order 1 model
+	unsigned char contextTables[numChars]; // Which of contextCodes each previous byte uses
+	const static int filteredFormat = 'P'; // Format byte for a file that was run through a filter before encoding, followed by the filter, its parameter and then the encoded file
+	const static int wideFormat = 'W'; // Format byte for a file encoded with 16 bit symbols
+	const static int wideHeaderSize = 16; // Size of a 16 bit file's header before its tree: magic bytes, format, original length, the odd last byte and how many symbols have a code
+	const static size_t wideCountChunk = (size_t)1 << 31; // How many 16 bit symbols we count before adding the counts into 64 bit totals, so they can't overflow
+	vector<unsigned char> wideLengths; // The code length of every 16 bit symbol, 0 for the ones that never appear
+	canonicalCodes<unsigned short> wideCodes; // The codes and decode tables of our 16 bit symbols
+	const static int adaptiveFormat = 'D'; // Format byte for a file or stream encoded with adaptive codes, which has no tree at all
+	const static unsigned int adaptiveFirstUpdate = 32; // How many symbols we code before the first update of an adaptive model
+	constexpr static unsigned int adaptiveMaxUpdate = 1 << 13; // The most symbols we code between updates, the gap doubles after each update until it gets here
+	const static unsigned long long adaptiveCountLimit = 1 << 16; // Once an adaptive model has counted this many symbols we halve every count, so old symbols fade out
+	const static int maxVarintSize = 10; // The most bytes a 64 bit number takes as a varint
+	unsigned long long adaptiveTotal = 0; // The total of every count in an adaptive model
+	unsigned int adaptiveUntilUpdate = 0; // How many more symbols we code before the next update of an adaptive model
+	unsigned int adaptiveUpdateGap = 0; // How many symbols go between updates right now
+	fastCodes adaptiveCodes; // The codes of our adaptive model
+	const static int referenceHeaderSize = 19; // Size of a reference file's header: magic bytes, format, tree ID and original length
+	unsigned long long bytesIn = 0; // Keeps track of the amount of bytes we read in, so we can output this number eventually (64 bits, so files over 4 GB don't wrap it)
+	unsigned long long bytesOut = 0; // Keeps track of the amount of bytes we print out, so we can output this number eventually
+	chrono::steady_clock::time_point start = chrono::steady_clock::now(); // The time we started the current operation, so we can keep track of how long it takes
+	const static int phaseRead = 0; // Opening and reading our input, and headers
+	const static int phaseHistogram = 1; // Counting symbols
+	const static int phaseTree = 2; // Building or loading a tree
+	const static int phaseCodeTable = 3; // Building encoding strings and code tables, or decode tables
+	const static int phaseCode = 4; // Actually encoding or decoding
+	const static int phaseWrite = 5; // Writing out and flushing our output
+	const static int phaseFilter = 6; // Running our input through a filter, or undoing one
+	const static int phaseCount = 7; // How many phases we time
+	int statsFormat = statsSummary; // What we report after each operation
+	bool timingPhases = false; // Whether we are timing each phase, only when statsFormat asks for it
+	int currentPhase = phaseRead; // The phase we are in right now
+	chrono::steady_clock::time_point phaseStart; // When we switched into the current phase
+	double phaseSeconds[phaseCount] = { 0 }; // How long we have spent in each phase of the current operation
 
+	void resetState(); // Helper method that clears everything left over from the last operation, so one object can be used over and over
 	bool openFiles(string inputFile, string outputFile, string treeFile); // Helper method to open up our files into the appropriate streams
+	void encodeCanonical(); // Helper method that writes our input out in the canonical format, using our shared tree if we have one
+	void decodeInput(); // Helper method that checks which format our input is in and decodes it
+	void reportError(string message); // Helper method that records something going wrong, and prints it unless we are working on memory buffers
 	void buildFrequencyTable(); // Helper method that builds the frequency table for the input file
-	int getSmallestNodeIndex(int indexToSkip); // Helper method that gets the smallest node index from our nodes array, skipping the input parameter so we don't output the same index twice
-	void buildTree(); // Helper method that combines items in the nodes[] array to build our tree
-	void buildTreeFromFile(ifstream& file, bool writeTree); // Helper method that builds a tree from the parameter file (either inputStream, or treeStream)
-	void buildEncodingStrings(node* startingPoint, string currentPath); // Helper method to build all encoding strings starting at a given node with a given path
-	void encode(); // Helper method that encodes a file
-	void decode(); // Helper method that decodes a file
-	void followTree(unsigned char byte, int checkBit, node*& currentNode); // Helper method that navigates through the tree checking the bit of the byte and deciding whether to go left or right based on it
+	void sampleFrequencyTable(); // Helper method that estimates the frequency table for the input file from evenly spaced samples of it
+	void buildTree(unsigned char* treeBuilder); // Helper method that combines items in the nodes[] array to build our tree, recording the merges into treeBuilder
+	bool encodeWithTree(const unsigned char* treeData, size_t treeLength); // Helper method that encodes our input with the tree in treeData, the contents of a tree file, returning false if it isn't a tree we can use
+	bool buildTreeFromBuilder(const unsigned char* treeBuilder, bool writeTree); // Helper method that builds a tree from 510 bytes of tree builder information (from either our input, or treeStream), optionally copying it to our output, returning false if the information doesn't make a tree
+	unsigned short addNode(unsigned char symbol, unsigned long long weight, unsigned short left, unsigned short right); // Helper method that adds a node onto tree[] and returns its index
+	void buildEncodingStrings(unsigned short startingPoint, string currentPath); // Helper method to build all encoding strings starting at a given node with a given path
+	void buildCodeTable(); // Helper method that turns our encoding strings into numeric codes in codeTable
+	void putLongCode(BitWriter& writer, const string& code); // Helper method that writes out a code that is too long to go through codeTable
+	void encode(unsigned int checkpointEvery = 0); // Helper method that encodes a file, recording a checkpoint every checkpointEvery symbols and writing them out at the end if it isn't 0
+	void encodeSymbols(const unsigned char* data, size_t length, BitWriter& writer); // Helper method that writes the codes for a buffer of symbols into writer
+	void finishEncoding(BitWriter& writer); // Helper method that flushes the writer, padding out the last byte with paddingBits
+	size_t encodedSizeBound(size_t length); // Helper method that returns the most bytes encoding length symbols could take
+	unsigned long long decode(unsigned long long outputLimit = ~0ULL); // Helper method that decodes a file, writing out at most outputLimit bytes, and returns how many it wrote
+	void buildDecodeTable(); // Helper method that builds our decode lookup tables from the tree in nodes[0]
+	void fillDecodeTable(unsigned short startingPoint, int tableOffset, int tableBits); // Helper method that fills in one decode table starting from a given node, creating secondary tables as needed
+	size_t decodeBuffer(const unsigned char* data, size_t length, size_t& bitPosition, bool lastBuffer, unsigned char* output); // Helper method that decodes a buffer of encoded bytes starting at bitPosition, returning the number of bytes it wrote to output
+	size_t encodeBlock(const unsigned char* data, size_t length, vector<unsigned char>& output); // Helper method that encodes a complete block into output, returning its encoded size
+	unsigned long long decodeSpeculative(const unsigned char* data, size_t length, unsigned long long outputLimit); // Helper method that decodes one long bitstream on every core by splitting it at arbitrary bits and stitching the pieces together where they line up, returning the number of bytes we wrote
+	bool decodeTreeSymbol(const unsigned char* data, size_t totalBits, size_t& bitPosition, unsigned char& symbol); // Helper method that follows the tree one bit at a time from bitPosition to decode a single symbol, returning false if the data runs out first
+	void decodeSegment(const unsigned char* data, size_t length, size_t startBit, size_t endBit, bool lastSegment, speculativeSegment& segment); // Helper method that decodes the bits from startBit to endBit (to the end of data for the last segment) into segment, noting the symbol boundaries near startBit
+	size_t decodeBlock(const unsigned char* data, size_t length, vector<unsigned char>& output); // Helper method that decodes a complete encoded block into output, returning its decoded size
+	void decodeRange(int format, unsigned long long offset, unsigned long long count); // Helper method that decodes count bytes starting at offset of a canonical or checkpointed file, starting from the last checkpoint before offset
+	void decodeBlocks(); // Helper method that decodes a block container in parallel
+	void decodeInterleaved(); // Helper method that decodes a file written by EncodeFileInterleaved
+	bool decodeInterleavedBlock(const unsigned char* const* streams, const size_t* streamLengths, int streamCount, unsigned char* output, size_t length, vector<unsigned char>& tailBuffer); // Helper method that decodes the streams of one interleaved block side by side into output, returning false if they are corrupt
+	bool readInput(void* destination, size_t length); // Helper method that copies the next length bytes of the input into destination, returning false if there aren't enough
+	int readFormat(); // Helper method that checks the start of the input for our magic bytes and returns which format the file is in
+	string defaultOutputFile(string inputFile, string extension); // Helper method that builds an output file name by replacing the extension of inputFile
+	void buildCanonicalLengths(bool allSymbols); // Helper method that fills in codeLengths from our frequency table, limited to maxCanonicalLength
+	void buildCanonicalTree(); // Helper method that builds our tree from the canonical codes described by codeLengths
+	static size_t canonicalTreeSize(const unsigned char* countBytes); // Helper method that returns the size of a compact canonical tree from its first two bytes
+	size_t writeCanonicalTree(unsigned char* output); // Helper method that writes codeLengths into output in compact form, returning how many bytes it took
+	bool loadCanonicalTree(const unsigned char* data); // Helper method that reads codeLengths from a compact canonical tree and builds the tree, returning false if it isn't valid
+	bool readCanonicalTree(); // Helper method that reads a compact canonical tree from our input and builds the tree from it
+	bool reserveOutput(unsigned long long length); // Helper method that makes room in memoryOutput for length more bytes, returning false (and reporting it) if that would go over outputLimit
+	bool plausibleLength(unsigned long long originalLength); // Helper method that returns whether the rest of our input is long enough to hold originalLength symbols, at least one bit each
+	bool hasCodes(); // Helper method that returns whether the canonical tree we loaded has a code for any symbol, which only an empty file can do without
+	void writeCanonicalHeader(unsigned long long originalLength); // Helper method that writes the magic bytes, original length and compact tree at the start of a canonical file
+	bool loadTrainedTree(unsigned long long id); // Helper method that makes trained tree id our tree, along with its decode tables, loading it from the tree store the first time, returning false if it isn't there
+	static unsigned long long treeDataId(const unsigned char* treeData, size_t length); // Helper method that works out the ID of a compact canonical tree, a hash of its bytes
+	static string formatTreeId(unsigned long long id); // Helper method that turns a tree ID into the 16 hex digits we show and name its file by
+	void decodeStreamChunks(); // Helper method that decodes the chunks of a stream until its end marker
+	bool readStreamBytes(void* destination, size_t length); // Helper method that reads the next length bytes of a stream from standard input or inputMap
+	void useStandardStreams(); // Helper method that switches our input and output over to standard input and output, in binary mode
+	unsigned long long codedBytes(); // Helper method that returns how many bytes our codes turn the symbols counted in frequencyTable into
+	bool storeIfSmaller(unsigned long long encodedSize); // Helper method that writes our input out as a stored file if that beats encodedSize bytes, returning whether it did
+	void decodeStored(unsigned long long offset, unsigned long long count); // Helper method that copies count bytes starting at offset out of a stored file, right after its magic bytes
+	bool buildContextModel(vector<unsigned char>& header); // Helper method that builds our order 1 tables for our input and its header, returning false if order 0 codes would be at least as small
+	void encodeContext(); // Helper method that encodes our input with our order 1 tables
+	void decodeContext(); // Helper method that decodes an order 1 file, right after its magic bytes
+	bool buildWideModel(vector<unsigned char>& header); // Helper method that builds codes for the 16 bit symbols of our input and its header, returning false if byte codes would be at least as small
+	void encodeWide(); // Helper method that encodes our input as 16 bit symbols with wideCodes
+	void decodeWide(); // Helper method that decodes a 16 bit file, right after its magic bytes
+	void decodeFiltered(); // Helper method that decodes a filtered file, right after its magic bytes, undoing the filter as we write
+	void resetAdaptiveModel(); // Helper method that starts an adaptive model over, with every symbol equally likely
+	void updateAdaptiveModel(const unsigned char* symbols, size_t length); // Helper method that counts symbols into our adaptive model, and updates its codes when it is time
+	static void buildFastCodes(const unsigned char* lengths, fastCodes& table); // Helper method that builds table from the code lengths of every symbol, which have to make a complete code
+	static unsigned char decodeFastSymbol(const fastCodes& table, const unsigned char* data, size_t& bitPosition); // Helper method that decodes the symbol at bitPosition in data with table and moves past it
+	size_t encodeAdaptiveFrame(const unsigned char* data, size_t length, vector<unsigned char>& output); // Helper method that encodes data into output with our adaptive model, updating it as we go, returning the encoded length
+	bool decodeAdaptiveFrame(const unsigned char* data, size_t length, unsigned char* output, size_t outputLength); // Helper method that decodes exactly outputLength symbols out of length bytes of data (plus 8 readable bytes past it) with our adaptive model, returning false if they ran out
+	void writeAdaptiveFrame(const unsigned char* data, size_t length, vector<unsigned char>& encoded); // Helper method that encodes data and writes it out as one frame, with its lengths in front
+	void decodeAdaptive(); // Helper method that decodes the frames of an adaptive file or stream, right after its magic bytes
+	bool readVarint(unsigned long long& value); // Helper method that reads one varint from our input, returning false if the input ran out
+	static size_t storeVarint(unsigned char* bytes, unsigned long long value); // Helper method that stores value as a varint, 7 bits per byte with the high bit set on every byte but the last, returning how many bytes it took
+	size_t readAvailable(void* destination, size_t length); // Helper method that reads whatever standard input has ready, waiting only if it has nothing, up to length bytes
+	void writeOutput(const void* data, size_t length); // Helper method that writes data to our output and counts it in bytesOut
+	ostream& messageStream(); // Helper method that returns where messages should go, standard error if our output is going to standard output
 	void closeFiles(); // Helper method to close our files when we are done
-	void deleteSubtree(node* startingNode); // Helper method that deletes the subtrees of a node - used for destructing our huffman object
+	void deleteTree(); // Helper method that deletes our whole tree, so we can build a new one
 
 	void printActionDetail(); // Helper method to print out information about how the file ran, i.e., elapsed time and bytes in / out
-	string formatNumber(unsigned int num); // Helper method that formats an unsigned int to contain commas in the correct places
+	int enterPhase(int phase); // Helper method that switches the phase we are timing to phase, returning the one we were in
+	double elapsedSeconds(); // Helper method that returns the wall time since the current operation started, bringing the phase times up to date
+	string formatNumber(unsigned long long num); // Helper method that formats a number to contain commas in the correct places
 
-	bool isLeaf(node* node); // Helper method that we use to check if we are at a leaf
+	bool isLeaf(unsigned short index); // Helper method that we use to check if the node at index is a leaf
 };
\ No newline at end of file
@@ -9,13 +9,89 @@
 */
 
 #include "Huffman.h"
+#include "Archive.h"
+#include "Daemon.h"
+#include "MappedFile.h"
 #include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <chrono>
+#include <filesystem>
+
+static void runClient(int argc, char* argv[])
+{
+    // Sends one -client request to the server and writes out its answer, just like the matching
+    // command would have. argv[2] is the socket and argv[3] the operation, followed by its files
+    string op = argc >= 4 ? argv[3] : "";
+    int fileCount = argc - 4; // How many files the operation was given
+    bool valid = (op == "-et" && (fileCount == 2 || fileCount == 3)) || (op == "-ec" && (fileCount == 1 || fileCount == 2))
+        || (op == "-d" && fileCount == 2) || (op == "-stop" && fileCount == 0);
+    if (!valid)
+    {
+        cout << "Invalid command: -client takes a socket and then -et file1 file2 [file3], -ec file1 [file2], -d file1 file2 or -stop" << endl;
+        return;
+    }
+    auto start = chrono::steady_clock::now(); // Start timing from now
+    DaemonClient client;
+    vector<unsigned char> output; // The server's answer
+    if (!client.Connect(argv[2]))
+    {
+        cout << client.LastError() << endl;
+        return;
+    }
+    if (op == "-stop")
+    {
+        if (!client.Call(Daemon::opStop, "", nullptr, 0, output))
+            cout << client.LastError() << endl;
+        return;
+    }
+    string inputFile = argv[4];
+    string treeFile = op == "-et" ? argv[5] : ""; // The server may not share our working directory, so we send it the full path
+    if (!treeFile.empty())
+        treeFile = filesystem::absolute(treeFile).string();
+    string outputFile = op == "-et" ? (fileCount == 3 ? argv[6] : "") : (fileCount == 2 ? argv[5] : "");
+    if (outputFile.empty())
+        outputFile = inputFile.substr(0, inputFile.find(".")) + ".huf"; // Replace the extension of the input, like the encoders do
+    MappedFile input;
+    if (!input.Open(inputFile))
+    {
+        // If we can't open our input, let the user know and exit
+        cout << "Unable to open input file: " << inputFile << endl;
+        return;
+    }
+    int request = op == "-et" ? Daemon::opEncodeWithTree : op == "-ec" ? Daemon::opEncodeCanonical : Daemon::opDecode;
+    if (!client.Call(request, treeFile, input.Data(), input.Size(), output))
+    {
+        cout << client.LastError() << endl;
+        return;
+    }
+    ofstream outputStream(outputFile, ios::binary);
+    outputStream.write((const char*)output.data(), output.size());
+    if (outputStream.fail())
+    {
+        cout << "Unable to write output file: " << outputFile << endl;
+        return;
+    }
+    double secondsElapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count(); // Determine the wall time elapsed since we started
+    cout << "Time: " << secondsElapsed << " seconds.   ";
+    cout << "Bytes in / Bytes Out: " << input.Size() << " / " << output.size() << endl;
+}
 
 
 int main(int argc, char* argv[])
 {
     // Instantiate a huffman object to work with
     Huffman* huffman = new Huffman();
+    while (argc >= 2 && (string(argv[1]) == "-stats" || string(argv[1]) == "-json" || string(argv[1]) == "-sample"))
+    {
+        // If we were asked for stats or sampling, set that up and then carry on as if the option wasn't there
+        if (string(argv[1]) == "-sample")
+            huffman->SetSampledHistogram(true);
+        else
+            huffman->SetStatsFormat(string(argv[1]) == "-json" ? Huffman::statsJson : Huffman::statsText);
+        argv++;
+        argc--;
+    }
     if (argc < 2)
     {
         // If we have less than 2 arguments, then we must only have the name of the program
@@ -26,6 +102,8 @@ int main(int argc, char* argv[])
         return 0;
     }
     string flag = argv[1]; // Create a string variable to hold the contents of argv[1] so we can compare it to strings
+    if (getenv("HUFF_TREES") != nullptr)
+        huffman->SetTreeStore(getenv("HUFF_TREES")); // Trained trees live in HUFF_TREES if it is set, instead of the trees directory
     if (flag == "-e")
     {
         if (argc == 3)
@@ -96,6 +174,303 @@ int main(int argc, char* argv[])
         }
 
     }
+    else if (flag == "-ek")
+    {
+        if (argc == 3 || argc == 4)
+        {
+            // If we have 3 or 4 args, encode with canonical codes and checkpoints, with an empty outputFile string if we weren't given one
+            huffman->SetCheckpointInterval(64 * 1024);
+            huffman->EncodeFileCanonical(argv[2], argc == 4 ? argv[3] : "");
+        }
+        else if (argc < 3)
+        {
+            cout << "Invalid command: too few arguments to run a checkpointed encode" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to run a checkpointed encode" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-dr")
+    {
+        if (argc == 6)
+        {
+            // If we have 6 args, decode just the range we were asked for
+            huffman->DecodeFileRange(argv[2], strtoull(argv[3], nullptr, 10), strtoull(argv[4], nullptr, 10), argv[5]);
+        }
+        else if (argc < 6)
+        {
+            cout << "Invalid command: too few arguments to decode a range" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to decode a range" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-ec" || flag == "-tc")
+    {
+        string outputFile = argc == 4 ? argv[3] : ""; // The output file is optional, without it we figure one out from the input
+        if (argc == 3 || argc == 4)
+        {
+            // If we have 3 or 4 args, encode with canonical codes for -ec, or make a canonical tree file for -tc
+            if (flag == "-ec")
+                huffman->EncodeFileCanonical(argv[2], outputFile);
+            else
+                huffman->MakeCanonicalTreeBuilder(argv[2], outputFile);
+        }
+        else if (argc < 3)
+        {
+            cout << "Invalid command: too few arguments to run a canonical encode or build a canonical tree" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to run a canonical encode or build a canonical tree" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-ep")
+    {
+        if (argc == 3)
+        {
+            // If we have 3 args and our flag is -ep, encode the file in parallel blocks with an empty outputFile string
+            huffman->EncodeFileParallel(argv[2], "");
+        }
+        else if (argc == 4)
+        {
+            // If we have 4 args and our flag is -ep, encode the file in parallel blocks
+            huffman->EncodeFileParallel(argv[2], argv[3]);
+        }
+        else if (argc < 3)
+        {
+            cout << "Invalid command: too few arguments to run a parallel encode" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to run a parallel encode" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-ei" || flag == "-ei8")
+    {
+        int streamCount = flag == "-ei8" ? 8 : 4; // The number of streams to split each block into
+        if (argc == 3)
+        {
+            // If we have 3 args, encode the file into interleaved streams with an empty outputFile string
+            huffman->EncodeFileInterleaved(argv[2], "", streamCount);
+        }
+        else if (argc == 4)
+        {
+            // If we have 4 args, encode the file into interleaved streams
+            huffman->EncodeFileInterleaved(argv[2], argv[3], streamCount);
+        }
+        else if (argc < 3)
+        {
+            cout << "Invalid command: too few arguments to run an interleaved encode" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to run an interleaved encode" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-ea")
+    {
+        if (argc >= 4)
+        {
+            // If we have an archive and at least one input, pack every input into the archive
+            Archive archive;
+            archive.Create(argv[2], vector<string>(argv + 3, argv + argc));
+        }
+        else
+        {
+            cout << "Invalid command: too few arguments to create an archive" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-da" || flag == "-la")
+    {
+        Archive archive;
+        if (argc == 3 || (argc == 4 && flag == "-da"))
+        {
+            // If we have an archive (and for -da, maybe a directory), unpack it for -da or list it for -la
+            if (flag == "-da")
+                archive.ExtractAll(argv[2], argc == 4 ? argv[3] : "");
+            else
+                archive.List(argv[2]);
+        }
+        else if (argc < 3)
+        {
+            cout << "Invalid command: too few arguments to unpack or list an archive" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to unpack or list an archive" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-xa")
+    {
+        if (argc == 4 || argc == 5)
+        {
+            // If we have an archive and an entry name (and maybe an output file), unpack just that entry
+            Archive archive;
+            archive.ExtractEntry(argv[2], argv[3], argc == 5 ? argv[4] : "");
+        }
+        else if (argc < 4)
+        {
+            cout << "Invalid command: too few arguments to unpack an entry" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to unpack an entry" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-tr")
+    {
+        vector<pair<string, string>> files; // Every file in our corpus
+        if (argc < 3)
+        {
+            cout << "Invalid command: too few arguments to train a tree" << endl;
+            exit(0);
+        }
+        else if (Archive::CollectFiles(vector<string>(argv + 2, argv + argc), files))
+        {
+            // If we found our corpus, train a tree from all of it
+            vector<string> corpusFiles;
+            for (const auto& file : files)
+                corpusFiles.push_back(file.first);
+            huffman->TrainTree(corpusFiles);
+        }
+    }
+    else if (flag == "-er")
+    {
+        if (argc == 4 || argc == 5)
+        {
+            // If we have 4 or 5 args, encode the file with a trained tree, with an empty outputFile string if we weren't given one
+            huffman->EncodeFileWithTrainedTree(argv[2], argv[3], argc == 5 ? argv[4] : "");
+        }
+        else if (argc < 4)
+        {
+            cout << "Invalid command: too few arguments to encode with a trained tree" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to encode with a trained tree" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-e1")
+    {
+        if (argc == 3 || argc == 4)
+        {
+            // If we have 3 or 4 args, encode with order 1 codes, with an empty outputFile string if we weren't given one
+            huffman->EncodeFileContext(argv[2], argc == 4 ? argv[3] : "");
+        }
+        else if (argc < 3)
+        {
+            cout << "Invalid command: too few arguments to run an order 1 encode" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to run an order 1 encode" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-e16")
+    {
+        if (argc == 3 || argc == 4)
+        {
+            // If we have 3 or 4 args, encode with 16 bit symbols, with an empty outputFile string if we weren't given one
+            huffman->EncodeFileWide(argv[2], argc == 4 ? argv[3] : "");
+        }
+        else if (argc < 3)
+        {
+            cout << "Invalid command: too few arguments to run a 16 bit encode" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to run a 16 bit encode" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-ef")
+    {
+        if (argc == 4 || argc == 5)
+        {
+            // If we have 4 or 5 args, filter and encode, with an empty outputFile string if we weren't given one
+            huffman->EncodeFileFiltered(argv[3], argc == 5 ? argv[4] : "", argv[2]);
+        }
+        else if (argc < 4)
+        {
+            cout << "Invalid command: too few arguments to run a filtered encode" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to run a filtered encode" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-eo")
+    {
+        if (argc == 3 || argc == 4)
+        {
+            // If we have 3 or 4 args, encode in one pass with adaptive codes, with an empty outputFile string if we weren't given one
+            huffman->EncodeFileAdaptive(argv[2], argc == 4 ? argv[3] : "");
+        }
+        else if (argc < 3)
+        {
+            cout << "Invalid command: too few arguments to run an adaptive encode" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to run an adaptive encode" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-eso")
+    {
+        if (argc == 2)
+        {
+            // If we only have the flag, stream from standard input to standard output with adaptive codes
+            huffman->EncodeStreamAdaptive();
+        }
+        else
+        {
+            cout << "Invalid command: streaming reads standard input and writes standard output, so it takes no files" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-es" || flag == "-ds")
+    {
+        if (argc == 2)
+        {
+            // If we only have the flag, stream from standard input to standard output, encoding for -es and decoding for -ds
+            if (flag == "-es")
+                huffman->EncodeStream();
+            else
+                huffman->DecodeStream();
+        }
+        else
+        {
+            cout << "Invalid command: streaming reads standard input and writes standard output, so it takes no files" << endl;
+            exit(0);
+        }
+    }
     else if (flag == "-et")
     {
         if (argc == 4)
@@ -119,6 +494,50 @@ int main(int argc, char* argv[])
             exit(0);
         }
     }
+    else if (flag == "-gen")
+    {
+        if (argc == 4 || argc == 5)
+        {
+            // If we have a tree file and a name (and maybe an output file), write a compile time codec header for the tree
+            huffman->GenerateCodec(argv[2], argv[3], argc == 5 ? argv[4] : "");
+        }
+        else if (argc < 4)
+        {
+            cout << "Invalid command: too few arguments to generate a codec" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to generate a codec" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-serve")
+    {
+        if (argc == 3 || argc == 4)
+        {
+            // If we have a socket (and maybe a cache size), answer requests on it until a client stops us
+            Daemon daemon(argc == 4 ? strtoull(argv[3], nullptr, 10) : 64);
+            if (getenv("HUFF_TREES") != nullptr)
+                daemon.SetTreeStore(getenv("HUFF_TREES"));
+            daemon.Serve(argv[2]);
+        }
+        else if (argc < 3)
+        {
+            cout << "Invalid command: too few arguments to start a server" << endl;
+            exit(0);
+        }
+        else
+        {
+            cout << "Invalid command: too many arguments to start a server" << endl;
+            exit(0);
+        }
+    }
+    else if (flag == "-client")
+    {
+        // Send the request to a running server instead of doing the work ourselves
+        runClient(argc, argv);
+    }
     else
     {
         cout << "Invalid command: flag not recognized" << endl;
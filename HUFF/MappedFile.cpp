@@ -0,0 +1,153 @@
+/*
+	File: MappedFile.cpp - Implementation of a read only view of an input file
+	c.f.: MappedFile.h
+
+	This class gives us the whole input file as one block of memory. Regular
+	files are memory mapped, so the operating system pages them in as we go and
+	we never copy them through a stream one byte at a time. If a file can't be
+	mapped we fall back to reading it in with large reads.
+
+	Author: Quinn Kleinfelter
+	Class: EECS 2510-001 Non Linear Data Structures Spring 2020
+	Instructor: Dr. Thomas
+	Copyright: Copyright 2020 by Quinn Kleinfelter. All rights reserved.
+*/
+
+#include "MappedFile.h"
+#include <fstream>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	// Constructor, nothing to do until we open a file
+}
+
+MappedFile::~MappedFile()
+{
+	// Destructor, make sure we let go of any file we have open
+	Close();
+}
+
+bool MappedFile::Open(string fileName)
+{
+	// Opens up fileName, mapping it if we can. Empty files and files that can't be
+	// mapped (pipes, devices, etc.) are read in with readWholeFile instead
+	Close(); // Let go of any file we already had open
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false; // If we can't open the file at all there's nothing more we can do
+	LARGE_INTEGER fileSize;
+	if (GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+	{
+		// We have a regular file with something in it, so try to map it
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		void* view = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (view != NULL)
+		{
+			fileHandle = file; // Hold onto our handles so we can close them later
+			mappingHandle = mapping;
+			data = (const unsigned char*)view;
+			size = (size_t)fileSize.QuadPart;
+			isMapped = isOpen = true;
+			return true;
+		}
+		if (mapping != NULL) CloseHandle(mapping); // Mapping failed, so clean up and fall back to reading
+	}
+	CloseHandle(file);
+#else
+	int file = open(fileName.c_str(), O_RDONLY);
+	if (file < 0) return false; // If we can't open the file at all there's nothing more we can do
+	struct stat fileInfo;
+	if (fstat(file, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) && fileInfo.st_size > 0)
+	{
+		// We have a regular file with something in it, so try to map it
+		void* view = mmap(nullptr, (size_t)fileInfo.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (view != MAP_FAILED)
+		{
+			madvise(view, (size_t)fileInfo.st_size, MADV_SEQUENTIAL); // We read from front to back, so tell the kernel to read ahead aggressively
+			close(file); // The mapping stays valid without the file descriptor
+			data = (const unsigned char*)view;
+			size = (size_t)fileInfo.st_size;
+			isMapped = isOpen = true;
+			return true;
+		}
+	}
+	close(file);
+#endif
+	return readWholeFile(fileName); // If we couldn't map the file, read it in instead
+}
+
+void MappedFile::Wrap(const unsigned char* buffer, size_t length)
+{
+	// Points us at a buffer that is already in memory, so everything that reads a mapped file can
+	// read the buffer the same way. The caller keeps ownership, so Close just lets go of it
+	Close(); // Let go of any file we already had open
+	data = buffer;
+	size = length;
+	isOpen = true;
+}
+
+void MappedFile::Close()
+{
+	// Lets go of the file we have open, unmapping it or freeing our buffer
+	if (isMapped)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+#else
+		munmap((void*)data, size);
+#endif
+	}
+	vector<unsigned char>().swap(fallbackBuffer); // Actually give the memory back instead of just clearing it
+	data = nullptr;
+	size = 0;
+	isMapped = isOpen = false;
+}
+
+const unsigned char* MappedFile::Data()
+{
+	// Returns a pointer to the start of the file
+	return data;
+}
+
+size_t MappedFile::Size()
+{
+	// Returns the size of the file in bytes
+	return size;
+}
+
+bool MappedFile::IsOpen()
+{
+	// Returns whether we have a file open
+	return isOpen;
+}
+
+bool MappedFile::readWholeFile(string fileName)
+{
+	// Helper method that reads all of fileName into fallbackBuffer. We don't always know
+	// the size ahead of time (pipes), so we keep reading large chunks until we hit the end
+	const size_t chunkSize = 1 << 22; // The amount we try to read at a time
+	ifstream file(fileName, ios::binary); // Open up the file in binary mode
+	if (file.fail()) return false; // If we can't open it, let the caller know
+	size_t length = 0; // How much we have read so far
+	while (file)
+	{
+		fallbackBuffer.resize(length + chunkSize); // Make room for the next chunk
+		file.read((char*)fallbackBuffer.data() + length, chunkSize); // Read it in
+		length += (size_t)file.gcount(); // And keep track of how much we actually got
+	}
+	fallbackBuffer.resize(length); // Trim off the room we didn't use
+	data = fallbackBuffer.data();
+	size = length;
+	isOpen = true;
+	return true;
+}
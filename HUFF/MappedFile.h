@@ -0,0 +1,41 @@
+/*
+	Quinn Kleinfelter
+	EECS 2520-001 Non Linear Data Structures Spring 2020
+	Dr. Thomas
+
+	Header file to contain the class definition for a read only
+	view of an input file. Regular files are memory mapped so we can
+	read them in place, anything that can't be mapped (pipes, special
+	files) is read into memory with large reads instead.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+using namespace std;
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+	bool Open(string fileName); // Maps fileName into memory, or reads it in if it can't be mapped, returning false if it couldn't be opened
+	void Wrap(const unsigned char* buffer, size_t length); // Points at a buffer the caller owns instead of a file, without copying it
+	void Close(); // Unmaps or frees the file, if we have one open
+	const unsigned char* Data(); // Returns a pointer to the contents of the file
+	size_t Size(); // Returns the size of the file in bytes
+	bool IsOpen(); // Returns whether we currently have a file open
+
+private:
+	const unsigned char* data = nullptr; // The contents of the file, either the mapping or fallbackBuffer
+	size_t size = 0; // The size of the file in bytes
+	bool isOpen = false; // Whether we currently have a file open
+	bool isMapped = false; // Whether data points at a mapping (as opposed to fallbackBuffer)
+	vector<unsigned char> fallbackBuffer; // Holds the file when we couldn't map it
+#ifdef _WIN32
+	void* fileHandle = nullptr; // Windows handle for the file we mapped
+	void* mappingHandle = nullptr; // Windows handle for the mapping itself
+#endif
+
+	bool readWholeFile(string fileName); // Helper method that reads the entire file into fallbackBuffer with large reads
+};
@@ -0,0 +1,236 @@
+/*
+	File: Pipeline.cpp - Implementation of the stages we run alongside encoding and decoding
+	c.f.: Pipeline.h
+
+	Without these, one thread takes turns waiting on the disk (while the
+	mapping faults in our input, or while a write of our output goes through)
+	and working on the bits, so the disk is idle while we compute and the CPU
+	is idle while we wait. On slow or network mounted volumes that costs about
+	half of our throughput. Here the waiting happens on threads of their own:
+	the prefetch thread reads ahead of the work, and the writer thread writes
+	behind it, with the buffers passed between threads through lock free queues.
+
+	Author: Quinn Kleinfelter
+	Class: EECS 2510-001 Non Linear Data Structures Spring 2020
+	Instructor: Dr. Thomas
+	Copyright: Copyright 2020 by Quinn Kleinfelter. All rights reserved.
+*/
+
+#include "Pipeline.h"
+#include <cstring>
+#include <chrono>
+
+namespace
+{
+	void backOff(int& attempts)
+	{
+		// Waits a little before trying a queue again. The first few tries just give up our time slice,
+		// after that we sleep, so a thread waiting on a slow disk doesn't burn a core spinning
+		if (attempts++ < 64)
+			this_thread::yield();
+		else
+			this_thread::sleep_for(chrono::microseconds(50));
+	}
+}
+
+SpscQueue::SpscQueue(size_t capacity) : slots(capacity + 1)
+{
+	// Constructor, the ring needs one slot more than we can hold so a full queue doesn't look empty
+}
+
+bool SpscQueue::TryPush(size_t value)
+{
+	// Adds value into the slot at tail. Only the pushing thread writes tail, and it only publishes the
+	// new tail (with release) after the value is in place, so the popping thread never sees a half written slot
+	size_t position = tail.load(memory_order_relaxed);
+	size_t next = position + 1 == slots.size() ? 0 : position + 1;
+	if (next == head.load(memory_order_acquire)) return false; // The queue is full
+	slots[position] = value;
+	tail.store(next, memory_order_release);
+	return true;
+}
+
+bool SpscQueue::TryPop(size_t& value)
+{
+	// Takes the value out of the slot at head, the mirror image of TryPush
+	size_t position = head.load(memory_order_relaxed);
+	if (position == tail.load(memory_order_acquire)) return false; // The queue is empty
+	value = slots[position];
+	head.store(position + 1 == slots.size() ? 0 : position + 1, memory_order_release);
+	return true;
+}
+
+void SpscQueue::Push(size_t value)
+{
+	// Pushes value, waiting until there is room for it
+	int attempts = 0;
+	while (!TryPush(value))
+		backOff(attempts);
+}
+
+size_t SpscQueue::Pop()
+{
+	// Pops the oldest value, waiting until there is one
+	size_t value;
+	int attempts = 0;
+	while (!TryPop(value))
+		backOff(attempts);
+	return value;
+}
+
+AsyncWriter::~AsyncWriter()
+{
+	// Destructor, make sure our thread is done before our buffers go away
+	Finish();
+}
+
+void AsyncWriter::Start(ostream* output)
+{
+	// Starts up the writer thread with every buffer free
+	Finish(); // Wrap up anything we were doing before
+	target = output;
+	failed = false;
+	for (size_t i = 0; i < (size_t)bufferCount; i++)
+	{
+		buffers[i].resize(bufferSize); // Only allocates the first time
+		freeBuffers.Push(i);
+	}
+	current = endMarker;
+	currentLength = 0;
+	running = true;
+	writerThread = thread(&AsyncWriter::writerLoop, this);
+}
+
+void AsyncWriter::Write(const void* data, size_t length)
+{
+	// Copies data into our buffers, handing each one to the writer thread as it fills up.
+	// Copying costs far less than encoding or decoding the data did, and means the caller
+	// can reuse its own buffer as soon as we return
+	const unsigned char* bytes = (const unsigned char*)data;
+	while (length > 0)
+	{
+		if (current == endMarker)
+		{
+			current = freeBuffers.Pop(); // Wait for a free buffer, which only happens when the writer is behind
+			currentLength = 0;
+		}
+		size_t amount = min(length, bufferSize - currentLength); // How much fits in the current buffer
+		memcpy(buffers[current].data() + currentLength, bytes, amount);
+		currentLength += amount;
+		bytes += amount;
+		length -= amount;
+		if (currentLength == bufferSize)
+		{
+			// The buffer is full, so hand it off to be written
+			lengths[current] = currentLength;
+			fullBuffers.Push(current);
+			current = endMarker;
+		}
+	}
+}
+
+bool AsyncWriter::Finish()
+{
+	// Hands off whatever is in the current buffer, tells the writer thread that's everything,
+	// and waits for it to get it all written out
+	if (!running) return !failed;
+	if (current != endMarker && currentLength > 0)
+	{
+		lengths[current] = currentLength;
+		fullBuffers.Push(current);
+	}
+	else if (current != endMarker)
+		freeBuffers.Push(current); // An empty buffer just goes back to the free queue so the queues stay balanced
+	current = endMarker;
+	fullBuffers.Push(endMarker);
+	writerThread.join();
+	size_t buffer;
+	while (freeBuffers.TryPop(buffer)) {} // Empty out the free queue so the next Start begins from scratch
+	running = false;
+	return !failed;
+}
+
+bool AsyncWriter::IsRunning()
+{
+	// Returns whether we have a writer thread going
+	return running;
+}
+
+void AsyncWriter::writerLoop()
+{
+	// The loop the writer thread runs: write out each buffer as it arrives and hand it back,
+	// until we get the end marker. After a failed write we keep handing buffers back without
+	// writing them, so the other side never gets stuck waiting for one
+	while (true)
+	{
+		size_t buffer = fullBuffers.Pop();
+		if (buffer == endMarker) break;
+		if (!failed)
+		{
+			target->write((const char*)buffers[buffer].data(), lengths[buffer]);
+			if (target->fail()) failed = true;
+		}
+		freeBuffers.Push(buffer);
+	}
+	if (!failed)
+	{
+		target->flush(); // Push everything down to the operating system before we say we are done
+		if (target->fail()) failed = true;
+	}
+}
+
+InputPrefetcher::~InputPrefetcher()
+{
+	// Destructor, make sure our thread is done
+	Stop();
+}
+
+void InputPrefetcher::Start(const unsigned char* input, size_t inputLength)
+{
+	// Starts the prefetch thread on a new input
+	Stop(); // Wrap up anything we were doing before
+	data = input;
+	length = inputLength;
+	consumed = 0;
+	stopping = false;
+	prefetchThread = thread(&InputPrefetcher::prefetchLoop, this);
+}
+
+void InputPrefetcher::Advance(size_t position)
+{
+	// Lets the prefetch thread know how far our work has gotten. Our passes over the input can start
+	// over from the beginning, but everything before the furthest point has already been read in
+	if (position > consumed.load(memory_order_relaxed))
+		consumed.store(position, memory_order_relaxed);
+}
+
+void InputPrefetcher::Stop()
+{
+	// Tells the prefetch thread to exit and waits for it
+	if (!prefetchThread.joinable()) return;
+	stopping = true;
+	prefetchThread.join();
+}
+
+void InputPrefetcher::prefetchLoop()
+{
+	// The loop the prefetch thread runs: touch one byte of every page from where we left off up to
+	// window bytes past the work, then wait for the work to move along. Touching the page is what makes
+	// the operating system read it in, and it is this thread that waits for it instead of the work
+	size_t touched = 0; // How far we have touched
+	volatile unsigned char sink = 0; // Somewhere to put the bytes we read, so the reads can't be optimized away
+	int attempts = 0;
+	while (!stopping && touched < length)
+	{
+		size_t target = min(length, consumed.load(memory_order_relaxed) + window); // How far ahead we want to be
+		if (touched >= target)
+		{
+			backOff(attempts); // We are far enough ahead, so wait for the work to catch up
+			continue;
+		}
+		attempts = 0;
+		for (; touched < target && !stopping; touched += pageSize)
+			sink = data[touched];
+	}
+	(void)sink;
+}
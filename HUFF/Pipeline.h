@@ -0,0 +1,82 @@
+/*
+	Quinn Kleinfelter
+	EECS 2520-001 Non Linear Data Structures Spring 2020
+	Dr. Thomas
+
+	Header file to contain the class definitions for the stages
+	we run alongside encoding and decoding, so that reading our input,
+	working on it, and writing our output all happen at the same time.
+	An InputPrefetcher pulls the pages of a mapped input into memory a
+	few megabytes ahead of where we are working, and an AsyncWriter hands
+	full output buffers to a thread of its own to write out. Buffers move
+	between threads through small lock free queues.
+*/
+
+#pragma once
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <ostream>
+using namespace std;
+
+class SpscQueue // A bounded lock free queue of numbers with exactly one thread pushing and one thread popping
+{
+public:
+	SpscQueue(size_t capacity); // Makes a queue that can hold capacity numbers
+	bool TryPush(size_t value); // Adds value onto the queue, returning false if it is full
+	bool TryPop(size_t& value); // Takes the oldest number off of the queue into value, returning false if it is empty
+	void Push(size_t value); // Adds value onto the queue, waiting for room if it is full
+	size_t Pop(); // Takes the oldest number off of the queue, waiting for one if it is empty
+
+private:
+	vector<size_t> slots; // The ring of slots, one more than our capacity so full and empty look different
+	atomic<size_t> head{ 0 }; // The next slot to pop from, only moved by the popping thread
+	atomic<size_t> tail{ 0 }; // The next slot to push into, only moved by the pushing thread
+};
+
+class AsyncWriter // Collects our output into large buffers and writes them out on a thread of its own
+{
+public:
+	~AsyncWriter();
+	void Start(ostream* target); // Starts up the writer thread, which writes everything we give it to target
+	void Write(const void* data, size_t length); // Copies data into the current buffer, handing it to the writer thread whenever it fills up
+	bool Finish(); // Writes out whatever is left, waits for the writer thread to finish, and returns false if any write failed
+	bool IsRunning(); // Returns whether we have a writer thread going
+
+private:
+	const static int bufferCount = 3; // Triple buffering: one being filled, one being written, and one spare so neither side waits on a hiccup
+	const static size_t bufferSize = (size_t)1 << 20; // The size of each buffer
+	const static size_t endMarker = ~(size_t)0; // Pushed onto fullBuffers to tell the writer thread there is nothing more coming
+	vector<unsigned char> buffers[bufferCount]; // Our buffers
+	size_t lengths[bufferCount] = { 0 }; // How much of each full buffer is valid
+	SpscQueue freeBuffers{ bufferCount }; // Buffers the writer thread is done with, passed back to us
+	SpscQueue fullBuffers{ bufferCount + 1 }; // Buffers ready to be written, passed to the writer thread (plus room for the end marker)
+	thread writerThread; // The thread that does the writing
+	ostream* target = nullptr; // Where the writer thread writes to
+	atomic<bool> failed{ false }; // Set by the writer thread if a write fails
+	size_t current = endMarker; // The buffer we are filling, endMarker if we don't have one yet
+	size_t currentLength = 0; // How much of the current buffer we have filled
+	bool running = false; // Whether the writer thread is going
+
+	void writerLoop(); // The loop the writer thread runs, writing out each full buffer and handing it back
+};
+
+class InputPrefetcher // Touches the pages of a mapped input ahead of where we are working, so the operating system reads them in while we work on the ones before
+{
+public:
+	~InputPrefetcher();
+	void Start(const unsigned char* data, size_t length); // Starts the prefetch thread on length bytes of data
+	void Advance(size_t position); // Lets the prefetch thread know we have worked up to position, so it can move further ahead
+	void Stop(); // Stops the prefetch thread, if we have one going
+
+private:
+	const static size_t window = (size_t)8 << 20; // How far ahead of our work the prefetch thread stays
+	const static size_t pageSize = 4096; // The smallest page size we run into, touching one byte in each is enough to bring it in
+	const unsigned char* data = nullptr; // The input we are prefetching
+	size_t length = 0; // Its length
+	atomic<size_t> consumed{ 0 }; // How far the work has gotten
+	atomic<bool> stopping{ false }; // Set when the prefetch thread should exit
+	thread prefetchThread; // The thread touching the pages
+
+	void prefetchLoop(); // The loop the prefetch thread runs
+};
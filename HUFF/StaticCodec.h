@@ -0,0 +1,313 @@
+/*
+	Quinn Kleinfelter
+	EECS 2520-001 Non Linear Data Structures Spring 2020
+	Dr. Thomas
+
+	Header file containing a codec for one fixed tree, worked out
+	entirely at compile time. HUFF -gen turns a tree file into a small
+	header holding the tree, and StaticCodec<Tree> builds the code and
+	decode tables for it as constant expressions, so they are part of
+	the binary and using the codec needs no startup work and no heap.
+	Since the tree is known to the compiler, it can leave out the
+	branches for long or missing codes when the tree has none. Files
+	written by Encode are exactly what -et writes with the same tree
+	file, and Decode reads those files.
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include "BitIO.h"
+
+const static int staticLookupBits = 11; // Number of bits a static codec's first decode table looks at
+const static int staticSubtableBits = 8; // Number of bits each of its second level tables looks at, for codes longer than staticLookupBits
+const static unsigned short staticNoChild = 0xFFFF; // The child of a generated tree node that doesn't have one
+const static unsigned short staticFirstNode = 256; // Generated tree children below this are leaves (the symbol itself), the rest are this plus the node's index
+
+struct staticCode // The code for one symbol of a static codec
+{
+	unsigned long long words[4] = {}; // The bits of the code, first bit highest, 64 to a word (codes from original trees can be up to 255 bits)
+	unsigned int length = 0; // The number of bits in the code, 0 for a symbol without a code
+};
+
+template <int subtableCount>
+struct staticCodecTables // Everything a static codec works out from its tree at compile time
+{
+	staticCode codes[256] = {}; // The code for every symbol
+	unsigned short lookup[1 << staticLookupBits] = {}; // For every value of the next staticLookupBits bits, the length and symbol of the code they start with, 0x8000 plus the second level table to go on with for a longer code, or 0 for no code
+	unsigned short subtables[subtableCount > 0 ? subtableCount : 1][1 << staticSubtableBits] = {}; // The second level tables, the same as lookup for the staticSubtableBits after where the last table stopped
+	unsigned int padding = 0; // The first 8 bits of the path we pad the last byte with, the same one Huffman picks
+	unsigned int maxLength = 0; // The length of the longest code
+	bool complete = true; // Whether every symbol has a code
+};
+
+constexpr bool isStaticSubtableDepth(unsigned int depth)
+{
+	// Returns whether a parent depth deep gets a second level table, which is when a decode table stops right at it.
+	// That happens staticLookupBits deep, and then every staticSubtableBits deeper than that
+	return depth >= staticLookupBits && (depth - staticLookupBits) % staticSubtableBits == 0;
+}
+
+template <class Tree>
+constexpr void findStaticDepths(unsigned int* depths)
+{
+	// Fills in how deep every parent of Tree is. The generator numbers parents a level at a time, so a parent
+	// always comes before its children and one pass down the list is enough
+	for (size_t i = 0; i < sizeof(Tree::children) / sizeof(Tree::children[0]); i++)
+	{
+		for (int side = 0; side < 2; side++)
+		{
+			unsigned short child = Tree::children[i][side];
+			if (child != staticNoChild && child >= staticFirstNode)
+				depths[child - staticFirstNode] = depths[i] + 1;
+		}
+	}
+}
+
+template <class Tree>
+constexpr int countStaticSubtables()
+{
+	// Returns how many second level tables Tree needs, so we know how big to make them
+	unsigned int depths[sizeof(Tree::children) / sizeof(Tree::children[0])] = {};
+	findStaticDepths<Tree>(depths);
+	int count = 0;
+	for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++)
+		count += isStaticSubtableDepth(depths[i]);
+	return count;
+}
+
+template <class Tree>
+constexpr void fillStaticTable(unsigned short* table, int bits, unsigned short start, const unsigned short* subtableIndexes)
+{
+	// Fills in a decode table that looks at bits bits, starting from parent start. For every value of those bits
+	// we follow them down the tree, until we reach a leaf or use them up at a parent that has its own table
+	for (unsigned int value = 0; value < (1u << bits); value++)
+	{
+		unsigned short current = start;
+		unsigned short entry = 0; // No code starts with these bits, unless we find one
+		for (int depth = 0; depth < bits; depth++)
+		{
+			unsigned short child = Tree::children[current][(value >> (bits - 1 - depth)) & 1];
+			if (child == staticNoChild) break;
+			if (child < staticFirstNode)
+			{
+				entry = (unsigned short)(((depth + 1) << 8) | child); // A whole code, with its length and symbol
+				break;
+			}
+			current = child - staticFirstNode;
+			if (depth == bits - 1)
+				entry = (unsigned short)(0x8000 | subtableIndexes[current]); // A longer code, which goes on in that parent's table
+		}
+		table[value] = entry;
+	}
+}
+
+template <class Tree, int subtableCount>
+constexpr staticCodecTables<subtableCount> buildStaticCodecTables()
+{
+	// Builds the tables for Tree at compile time. We walk the tree depth first, left before right, which is the
+	// same order Huffman builds its encoding strings in, so the padding path comes out the same as its paddingBits
+	staticCodecTables<subtableCount> result{};
+	unsigned short stackNodes[512] = {}; // The nodes (or leaves) still to visit
+	unsigned int stackDepths[512] = {}; // How deep each of them is
+	unsigned long long stackPaths[512][4] = {}; // The path from the root to each of them
+	int stackSize = 1; // The root starts out on the stack, at depth 0 with an empty path
+	stackNodes[0] = staticFirstNode;
+	while (stackSize > 0)
+	{
+		stackSize--;
+		unsigned short current = stackNodes[stackSize];
+		unsigned int depth = stackDepths[stackSize];
+		unsigned long long path[4] = { stackPaths[stackSize][0], stackPaths[stackSize][1], stackPaths[stackSize][2], stackPaths[stackSize][3] };
+		if (current < staticFirstNode)
+		{
+			// A leaf, so its path is the code for its symbol
+			staticCode& code = result.codes[current];
+			for (int i = 0; i < 4; i++)
+				code.words[i] = path[i];
+			code.length = depth;
+			if (depth > result.maxLength) result.maxLength = depth;
+			if (depth > 7) result.padding = (unsigned int)(path[0] >> 56); // The last long enough path we visit is our padding
+			continue;
+		}
+		for (int side = 1; side >= 0; side--)
+		{
+			// Push the right child first, so the left one comes off the stack first
+			unsigned short child = Tree::children[current - staticFirstNode][side];
+			if (child == staticNoChild) continue;
+			stackNodes[stackSize] = child;
+			stackDepths[stackSize] = depth + 1;
+			for (int i = 0; i < 4; i++)
+				stackPaths[stackSize][i] = path[i];
+			if (side == 1)
+				stackPaths[stackSize][depth / 64] |= 1ULL << (63 - depth % 64);
+			stackSize++;
+		}
+	}
+	for (int i = 0; i < 256; i++)
+		result.complete = result.complete && result.codes[i].length != 0;
+
+	// Every parent a decode table stops at gets a second level table of its own, then we fill in every table
+	unsigned int depths[sizeof(Tree::children) / sizeof(Tree::children[0])] = {};
+	findStaticDepths<Tree>(depths);
+	unsigned short subtableIndexes[sizeof(depths) / sizeof(depths[0])] = {}; // The second level table of each parent that has one
+	unsigned short subtableNodes[subtableCount > 0 ? subtableCount : 1] = {}; // And the parent each second level table starts from
+	int subtableNumber = 0;
+	for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++)
+	{
+		if (!isStaticSubtableDepth(depths[i])) continue;
+		subtableIndexes[i] = (unsigned short)subtableNumber;
+		subtableNodes[subtableNumber++] = (unsigned short)i;
+	}
+	fillStaticTable<Tree>(result.lookup, staticLookupBits, 0, subtableIndexes);
+	for (int i = 0; i < subtableCount; i++)
+		fillStaticTable<Tree>(result.subtables[i], staticSubtableBits, subtableNodes[i], subtableIndexes);
+	return result;
+}
+
+template <class Tree>
+class StaticCodec
+{
+public:
+	constexpr static size_t headerSize = Tree::canonical ? 11 + sizeof(Tree::tree) : sizeof(Tree::tree); // The size of the header of every file we write
+
+	static size_t EncodedBound(size_t length)
+	{
+		// Returns the most bytes Encode can take for length bytes of data, if every one of them used our longest code
+		return headerSize + length / 8 * table.maxLength + table.maxLength + 1;
+	}
+
+	static bool Encode(const unsigned char* data, size_t length, unsigned char* output, size_t capacity, size_t& outputLength)
+	{
+		// Encodes data into a buffer of capacity bytes, writing exactly what -et writes with our tree file. Returns false
+		// if data has a symbol our tree has no code for or it didn't fit, which we only count up when it might not
+		if (capacity < EncodedBound(length))
+		{
+			unsigned long long bits = 0; // The exact size of the encoded data, in bits
+			for (size_t i = 0; i < length; i++)
+				bits += table.codes[data[i]].length;
+			if (capacity < headerSize + (bits + 7) / 8) return false;
+		}
+		if constexpr (Tree::canonical)
+		{
+			// A canonical file starts with our magic bytes and format, the original length and the compact tree
+			output[0] = 'H';
+			output[1] = 'F';
+			output[2] = 'C';
+			storeLittleEndian64(output + 3, length);
+			memcpy(output + 11, Tree::tree, sizeof(Tree::tree));
+		}
+		else
+			memcpy(output, Tree::tree, sizeof(Tree::tree)); // An original file starts with the tree builder information
+		BitWriter writer;
+		writer.position = output + headerSize;
+		for (size_t i = 0; i < length; i++)
+		{
+			const staticCode& code = table.codes[data[i]];
+			if constexpr (!table.complete)
+			{
+				if (code.length == 0) return false; // A canonical tree can leave symbols out
+			}
+			if constexpr (table.maxLength <= 32)
+				writer.putBits((unsigned int)(code.words[0] >> (64 - code.length)), code.length); // Every code fits in one write
+			else if (code.length <= 32)
+				writer.putBits((unsigned int)(code.words[0] >> (64 - code.length)), code.length);
+			else
+			{
+				for (unsigned int bit = 0; bit < code.length; bit += 32)
+				{
+					// Longer codes go out 32 bits at a time
+					unsigned int count = code.length - bit < 32 ? code.length - bit : 32;
+					unsigned long long word = code.words[bit / 64] << (bit % 64); // The next bits, at the top of the word
+					writer.putBits((unsigned int)(word >> (64 - count)), count);
+				}
+			}
+		}
+		writer.flushBytes();
+		if (writer.bitCount > 0)
+		{
+			// Pad out the last byte with the start of a path longer than 7 bits, just like Huffman does
+			int paddingCount = 8 - writer.bitCount;
+			writer.putBits(table.padding >> (8 - paddingCount), paddingCount);
+			writer.flushBytes();
+		}
+		outputLength = writer.position - output;
+		return true;
+	}
+
+	static bool Decode(const unsigned char* data, size_t length, unsigned char* output, size_t capacity, size_t& outputLength)
+	{
+		// Decodes a file written by Encode, or by -et with our tree file, into a buffer of capacity bytes. Returns false
+		// if it was written with a different tree, is corrupt or didn't fit
+		if (length < headerSize) return false;
+		unsigned long long originalLength = 0; // How many symbols a canonical file holds
+		if constexpr (Tree::canonical)
+		{
+			if (data[0] != 'H' || data[1] != 'F' || data[2] != 'C' || memcmp(data + 11, Tree::tree, sizeof(Tree::tree)) != 0) return false;
+			originalLength = loadLittleEndian64(data + 3);
+			if (originalLength > capacity) return false;
+		}
+		else if (memcmp(data, Tree::tree, sizeof(Tree::tree)) != 0)
+			return false;
+		const unsigned char* bits = data + headerSize; // The encoded data after our header
+		size_t byteCount = length - headerSize;
+		unsigned long long bitPosition = 0;
+		size_t written = 0;
+		while (Tree::canonical ? written < originalLength : bitPosition < byteCount * 8)
+		{
+			int symbol = decodeSymbol(bits, byteCount, bitPosition);
+			if (symbol == endOfData && !Tree::canonical) break; // What's left is the padding at the end of an original file
+			if (symbol < 0 || written == capacity) return false;
+			output[written++] = (unsigned char)symbol;
+		}
+		outputLength = written;
+		return true;
+	}
+
+private:
+	constexpr static int subtableCount = countStaticSubtables<Tree>(); // How many second level decode tables our tree needs
+	constexpr static staticCodecTables<subtableCount> table = buildStaticCodecTables<Tree, subtableCount>(); // Our tables, built by the compiler
+	const static int endOfData = -1; // decodeSymbol ran out of data partway through a code
+	const static int badCode = -2; // decodeSymbol found bits that don't start any code
+
+	static unsigned int peek(const unsigned char* bits, size_t byteCount, unsigned long long bitPosition, int count)
+	{
+		// Helper method that returns the next count bits at bitPosition. Away from the end we grab them all
+		// in one go, and near the end we gather them one at a time, treating bits past the end as 0s
+		if ((bitPosition >> 3) + 8 <= byteCount)
+			return peekBits(bits, bitPosition, count);
+		unsigned int value = 0;
+		for (int i = 0; i < count; i++)
+		{
+			unsigned long long position = bitPosition + i;
+			value = (value << 1) | (position < (unsigned long long)byteCount * 8 ? (bits[position >> 3] >> (7 - (position & 7))) & 1 : 0);
+		}
+		return value;
+	}
+
+	static int decodeSymbol(const unsigned char* bits, size_t byteCount, unsigned long long& bitPosition)
+	{
+		// Helper method that decodes the symbol at bitPosition and moves past it, going on into the second
+		// level tables for codes longer than our first table looks at
+		unsigned long long totalBits = (unsigned long long)byteCount * 8;
+		unsigned long long position = bitPosition; // Where the table we are looking in starts
+		int tableBits = staticLookupBits; // And how many bits it looks at
+		unsigned short entry = table.lookup[peek(bits, byteCount, position, tableBits)];
+		if constexpr (subtableCount > 0)
+		{
+			while (entry & 0x8000)
+			{
+				// The code goes on past this table, into the next one
+				position += tableBits;
+				if (position >= totalBits) return endOfData;
+				tableBits = staticSubtableBits;
+				entry = table.subtables[entry & 0x7FFF][peek(bits, byteCount, position, tableBits)];
+			}
+		}
+		if (entry == 0) return position + tableBits > totalBits ? endOfData : badCode; // Bits past the end don't count against us
+		position += entry >> 8;
+		if (position > totalBits) return endOfData;
+		bitPosition = position;
+		return entry & 0xFF;
+	}
+};
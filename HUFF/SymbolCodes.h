@@ -0,0 +1,225 @@
+/*
+	Quinn Kleinfelter
+	EECS 2520-001 Non Linear Data Structures Spring 2020
+	Dr. Thomas
+
+	Header file containing the parts of canonical Huffman coding that
+	don't care how big a symbol is, as templates on the symbol type.
+	Bytes (unsigned char) are what every one of our formats codes, and
+	16 bit symbols (unsigned short) let numeric data and UTF-16 text be
+	coded a whole value at a time. Everything is sized by the symbols
+	actually in use rather than the whole alphabet wherever it matters,
+	since only a few thousand of the 65536 possible 16 bit symbols show
+	up in most data.
+*/
+
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "BitIO.h"
+using namespace std;
+
+template <class Symbol>
+struct symbolTraits // The sizes that go with each symbol type
+{
+	const static size_t alphabetSize = (size_t)1 << (8 * sizeof(Symbol)); // How many different symbols there are
+	const static int maxCodeLength = sizeof(Symbol) == 1 ? 15 : 20; // The longest code we allow, long enough that every symbol can have a code
+	const static int lookupBits = 11; // Number of bits a canonicalCodes lookup table looks at, longer codes are found by comparing against its limits
+};
+
+template <class Symbol>
+void buildLimitedLengths(const unsigned long long* counts, bool allSymbols, unsigned char* lengths)
+{
+	// Figures out how long each symbol's code should be from how often each one appears, storing them in lengths.
+	// Symbols that never appear get a length of 0 (no code), unless allSymbols is set, in which case we pretend
+	// they appeared once. No length is ever longer than maxCodeLength, if the real Huffman lengths are we shorten
+	// them while keeping the code complete. Small alphabets work on the stack, since adaptive models do this
+	// thousands of times per file, and big ones work on the heap, sized by the symbols that actually appear
+	const size_t alphabetSize = symbolTraits<Symbol>::alphabetSize;
+	const int maxLength = symbolTraits<Symbol>::maxCodeLength;
+	const size_t stackNodes = alphabetSize <= 256 ? 2 * alphabetSize : 1; // How many nodes fit in our stack arrays
+	unsigned long long stackWeights[stackNodes]; // Weights of our leaves (sorted smallest first) followed by the parents we make
+	int stackSymbols[stackNodes]; // The symbol each leaf belongs to
+	int stackParents[stackNodes]; // The parent of each leaf or parent node
+	int stackDepths[stackNodes]; // How deep each node is in the tree
+	vector<unsigned long long> heapWeights; // The same for big alphabets
+	vector<int> heapSymbols, heapParents, heapDepths;
+	unsigned long long* weights = stackWeights;
+	int* symbols = stackSymbols;
+	int* parents = stackParents;
+	int* depths = stackDepths;
+	int leafCount = 0; // The number of symbols getting a code
+	fill(lengths, lengths + alphabetSize, 0); // Start out with nobody having a code
+	if (alphabetSize > 256)
+	{
+		for (size_t i = 0; i < alphabetSize; i++)
+			leafCount += counts[i] > 0 || allSymbols;
+		heapWeights.resize(2 * (size_t)leafCount);
+		heapSymbols.resize(leafCount);
+		heapParents.resize(2 * (size_t)leafCount);
+		heapDepths.resize(2 * (size_t)leafCount);
+		weights = heapWeights.data();
+		symbols = heapSymbols.data();
+		parents = heapParents.data();
+		depths = heapDepths.data();
+		leafCount = 0;
+	}
+	for (size_t i = 0; i < alphabetSize; i++)
+	{
+		if (counts[i] > 0 || allSymbols)
+			symbols[leafCount++] = (int)i; // Every symbol that needs a code gets a leaf
+	}
+	if (leafCount == 0) return; // An empty input doesn't need any codes at all
+	if (leafCount == 1)
+	{
+		// A single symbol still needs a 1 bit code, and we give its neighbor the other
+		// 1 bit code so the code stays complete and every path in the tree leads somewhere
+		lengths[symbols[0]] = 1;
+		lengths[symbols[0] ^ 1] = 1;
+		return;
+	}
+	sort(symbols, symbols + leafCount, [counts](int a, int b) { return counts[a] < counts[b] || (counts[a] == counts[b] && a < b); }); // Sort our leaves from smallest to largest
+	for (int i = 0; i < leafCount; i++)
+		weights[i] = counts[symbols[i]] > 0 ? counts[symbols[i]] : 1; // Symbols that never appear count as appearing once
+
+	// Since our leaves are sorted and every parent we make is at least as heavy as the one before it,
+	// the two smallest nodes are always at the front of either the leaves or the parents
+	int nextLeaf = 0; // The smallest leaf we haven't merged yet
+	int nextParent = leafCount; // The smallest parent we haven't merged yet
+	for (int newParent = leafCount; newParent < 2 * leafCount - 1; newParent++)
+	{
+		int smallest[2]; // The two nodes we are going to merge
+		for (int j = 0; j < 2; j++)
+		{
+			// Take whichever is smaller out of the next leaf and the next parent
+			if (nextLeaf < leafCount && (nextParent >= newParent || weights[nextLeaf] <= weights[nextParent]))
+				smallest[j] = nextLeaf++;
+			else
+				smallest[j] = nextParent++;
+		}
+		weights[newParent] = weights[smallest[0]] + weights[smallest[1]]; // The new parent weighs as much as both together
+		parents[smallest[0]] = parents[smallest[1]] = newParent;
+	}
+	depths[2 * leafCount - 2] = 0; // The last parent we made is the root
+	for (int i = 2 * leafCount - 3; i >= 0; i--)
+		depths[i] = depths[parents[i]] + 1; // Parents always come after their children, so their depth is already known
+
+	int lengthCounts[maxLength + 1] = { 0 }; // How many codes there are of each length
+	bool tooLong = false; // Whether any code came out longer than we allow
+	for (int i = 0; i < leafCount; i++)
+	{
+		tooLong |= depths[i] > maxLength;
+		lengthCounts[min(depths[i], maxLength)]++; // Any code that is too long gets cut down to the longest length we allow
+	}
+	if (tooLong)
+	{
+		// Cutting codes down means they no longer fit together, so keep fixing it until they do. Each pass takes
+		// one code off of the longest length, and moves a shorter code down a level to make room for it
+		unsigned int total = 0; // How much of the code space our lengths use, in units of the longest code
+		for (int length = maxLength; length > 0; length--)
+			total += (unsigned int)lengthCounts[length] << (maxLength - length);
+		while (total > (1u << maxLength))
+		{
+			lengthCounts[maxLength]--;
+			for (int length = maxLength - 1; length > 0; length--)
+			{
+				if (lengthCounts[length] != 0)
+				{
+					lengthCounts[length]--;
+					lengthCounts[length + 1] += 2;
+					break;
+				}
+			}
+			total--;
+		}
+	}
+	// Finally hand out the lengths, the least frequent symbols (at the front) get the longest codes
+	int leaf = 0;
+	for (int length = maxLength; length > 0; length--)
+	{
+		for (int i = 0; i < lengthCounts[length]; i++)
+			lengths[symbols[leaf++]] = (unsigned char)length;
+	}
+}
+
+template <class Symbol>
+struct canonicalCodes // Canonical codes for one set of code lengths, with the tables to encode and decode them
+{
+	const static int maxLength = symbolTraits<Symbol>::maxCodeLength;
+	const static int lookupBits = symbolTraits<Symbol>::lookupBits;
+	vector<unsigned int> codes; // The code of every symbol, its bits shifted up 5 with its length in the low 5 bits, so encoding touches one word per symbol
+	vector<unsigned int> lookup; // For every value of the next lookupBits bits, the symbol of a code that fits in them shifted up 8 with its length in the low byte, or 0 for a longer code
+	unsigned int limits[maxLength + 1] = {}; // For each code length, one past the last code of that length, left aligned to maxLength bits
+	unsigned int firstCodes[maxLength + 1] = {}; // The first code of each length
+	int offsets[maxLength + 1] = {}; // Where the codes of each length start in symbols
+	vector<Symbol> symbols; // Every symbol with a code, in order of code length and then symbol, which is the order canonical codes are handed out in
+
+	bool Build(const unsigned char* lengths)
+	{
+		// Hands out canonical codes for lengths, the same way Huffman does for bytes, and builds our tables.
+		// Returns false if the lengths don't make a complete code (unless there are none at all), since then
+		// some bits wouldn't decode to anything
+		int lengthCounts[maxLength + 1] = { 0 }; // How many codes there are of each length
+		unsigned long long total = 0; // How much of the code space the lengths use, in units of the longest code
+		for (size_t i = 0; i < symbolTraits<Symbol>::alphabetSize; i++)
+		{
+			if (lengths[i] > maxLength) return false;
+			lengthCounts[lengths[i]]++;
+			if (lengths[i] != 0)
+				total += 1ULL << (maxLength - lengths[i]);
+		}
+		lengthCounts[0] = 0; // Symbols without a code don't take up any room
+		if (total != (1ULL << maxLength) && total != 0) return false;
+		unsigned int nextCode[maxLength + 1]; // The next code to hand out for each length
+		unsigned int code = 0;
+		int offset = 0;
+		for (int length = 1; length <= maxLength; length++)
+		{
+			// The first code of each length comes right after the last code of the length before it, with a 0 added on
+			code = (code + lengthCounts[length - 1]) << 1;
+			nextCode[length] = firstCodes[length] = code;
+			offsets[length] = offset;
+			limits[length] = (code + lengthCounts[length]) << (maxLength - length);
+			offset += lengthCounts[length];
+		}
+		codes.assign(symbolTraits<Symbol>::alphabetSize, 0);
+		lookup.assign((size_t)1 << lookupBits, 0); // Longer codes leave their entries empty
+		symbols.resize(offset);
+		for (size_t i = 0; i < symbolTraits<Symbol>::alphabetSize; i++)
+		{
+			unsigned int length = lengths[i]; // The length of this symbol's code
+			if (length == 0) continue;
+			unsigned int symbolCode = nextCode[length]++; // Hand out the next code of this length
+			codes[i] = (symbolCode << 5) | length;
+			symbols[offsets[length] + symbolCode - firstCodes[length]] = (Symbol)i;
+			if (length <= (unsigned int)lookupBits)
+			{
+				// Every value of the lookup bits that starts with this code decodes to this symbol
+				unsigned int first = symbolCode << (lookupBits - length);
+				fill(lookup.begin() + first, lookup.begin() + first + (1 << (lookupBits - length)), (unsigned int)((i << 8) | length));
+			}
+		}
+		return true;
+	}
+
+	inline Symbol Decode(const unsigned char* data, size_t& bitPosition) const
+	{
+		// Decodes one symbol. Every value of the next maxLength bits decodes to some symbol since our codes
+		// are complete, so this never fails, the caller makes sure 8 bytes can be read at bitPosition and
+		// checks that we didn't run off of the end
+		unsigned int bits = peekBits(data, bitPosition, maxLength); // Enough bits for any code
+		unsigned int entry = lookup[bits >> (maxLength - lookupBits)];
+		if (entry != 0)
+		{
+			// Most codes are short enough to look up directly
+			bitPosition += entry & 0xFF;
+			return (Symbol)(entry >> 8);
+		}
+		// Longer codes have to find their length first, then their place among the codes of that length
+		unsigned int codeLength = lookupBits + 1;
+		while (codeLength < (unsigned int)maxLength && bits >= limits[codeLength])
+			codeLength++;
+		bitPosition += codeLength;
+		return symbols[offsets[codeLength] + (bits >> (maxLength - codeLength)) - firstCodes[codeLength]];
+	}
+};
@@ -0,0 +1,120 @@
+/*
+	File: ThreadPool.cpp - Implementation of a simple pool of worker threads
+	c.f.: ThreadPool.h
+
+	This class keeps a set of worker threads alive, so that we don't pay to
+	start up new threads every time we have a batch of blocks to work on.
+
+	Author: Quinn Kleinfelter
+	Class: EECS 2510-001 Non Linear Data Structures Spring 2020
+	Instructor: Dr. Thomas
+	Copyright: Copyright 2020 by Quinn Kleinfelter. All rights reserved.
+*/
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	// Constructor, figure out how many threads we want and start them up.
+	// The thread calling ParallelFor helps out too, so we start one less worker than we want running
+	if (threadCount == 0)
+		threadCount = thread::hardware_concurrency(); // Default to one thread per core
+	if (threadCount == 0)
+		threadCount = 1; // hardware_concurrency can return 0 if it doesn't know, in which case just use the calling thread
+	for (unsigned int i = 1; i < threadCount; i++)
+	{
+		workers.emplace_back(&ThreadPool::workerLoop, this); // Start up a worker running our loop
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	// Destructor, tell all of the workers to stop and wait for them to finish
+	{
+		lock_guard<mutex> lock(tasksMutex);
+		stopping = true;
+	}
+	tasksChanged.notify_all(); // Wake everyone up so they see we are stopping
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join(); // Wait for each worker to exit
+	}
+}
+
+void ThreadPool::Submit(function<void()> task)
+{
+	// Adds a task to our queue and wakes up a worker to run it
+	{
+		lock_guard<mutex> lock(tasksMutex);
+		tasks.push(move(task));
+	}
+	tasksChanged.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count, const function<void(size_t)>& work)
+{
+	// Runs work for every index from 0 to count - 1. Every thread (including this one) grabs
+	// the next index that hasn't been taken yet until there are none left, so uneven blocks of
+	// work still balance out. The shared state lives in a shared_ptr since a worker might only
+	// get around to starting after all of the work is already done and we have returned
+	struct sharedState
+	{
+		atomic<size_t> nextIndex{ 0 }; // The next index that nobody has started yet
+		atomic<size_t> finished{ 0 }; // How many indexes have been completed
+		size_t count = 0; // The total number of indexes
+		function<void(size_t)> work; // The work to run for each index
+		mutex doneMutex; // Mutex used to wait for the work to finish
+		condition_variable done; // Signalled when the last index completes
+	};
+	if (count == 0) return; // Nothing to do
+	shared_ptr<sharedState> state = make_shared<sharedState>();
+	state->count = count;
+	state->work = work;
+	auto runner = [state]()
+	{
+		// Keep grabbing indexes until they are all taken
+		for (size_t i = state->nextIndex++; i < state->count; i = state->nextIndex++)
+		{
+			state->work(i);
+			if (++state->finished == state->count)
+			{
+				// If we finished the last one, let the caller know
+				lock_guard<mutex> lock(state->doneMutex);
+				state->done.notify_all();
+			}
+		}
+	};
+	size_t helpers = workers.size() < count - 1 ? workers.size() : count - 1; // No point in waking up more workers than we have indexes
+	for (size_t i = 0; i < helpers; i++)
+	{
+		Submit(runner); // Hand a runner to each worker we want to help
+	}
+	runner(); // Pitch in ourselves
+	unique_lock<mutex> lock(state->doneMutex);
+	state->done.wait(lock, [&state]() { return state->finished == state->count; }); // And wait until everything is finished
+}
+
+unsigned int ThreadPool::Size()
+{
+	// Returns the number of threads work can run on, our workers plus the calling thread
+	return (unsigned int)workers.size() + 1;
+}
+
+void ThreadPool::workerLoop()
+{
+	// The loop each of our worker threads runs, waiting for tasks and running them
+	while (true)
+	{
+		function<void()> task; // The task we are going to run
+		{
+			unique_lock<mutex> lock(tasksMutex);
+			tasksChanged.wait(lock, [this]() { return stopping || !tasks.empty(); }); // Sleep until there is a task or we are stopping
+			if (stopping && tasks.empty()) return; // If we are stopping and there's nothing left to do, exit the thread
+			task = move(tasks.front()); // Otherwise grab the next task
+			tasks.pop();
+		}
+		task(); // And run it outside of the lock
+	}
+}
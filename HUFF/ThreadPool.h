@@ -0,0 +1,37 @@
+/*
+	Quinn Kleinfelter
+	EECS 2520-001 Non Linear Data Structures Spring 2020
+	Dr. Thomas
+
+	Header file to contain the class definition for a simple pool
+	of worker threads, which we use to spread blocks of work out
+	across all of the cores of the machine.
+*/
+
+#pragma once
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+using namespace std;
+
+class ThreadPool
+{
+public:
+	ThreadPool(unsigned int threadCount = 0); // Starts up threadCount worker threads, or one per core if threadCount is 0
+	~ThreadPool();
+	void Submit(function<void()> task); // Queues up a task for the next free worker thread to run
+	void ParallelFor(size_t count, const function<void(size_t)>& work); // Runs work(0) through work(count - 1) spread across the pool (and the calling thread), returning once they have all finished
+	unsigned int Size(); // Returns the number of threads that work gets spread across, including the calling thread
+
+private:
+	vector<thread> workers; // Our worker threads
+	queue<function<void()>> tasks; // Tasks waiting for a worker to pick them up
+	mutex tasksMutex; // Mutex protecting tasks and stopping
+	condition_variable tasksChanged; // Used to wake up workers when a task is added or we are stopping
+	bool stopping = false; // Set when the pool is being destroyed so the workers know to exit
+
+	void workerLoop(); // The loop each worker thread runs, pulling tasks off of the queue until we are stopping
+};